@@ -10,6 +10,111 @@
 #include <fstream>
 #include <cmath>
 #include <map>
+#include <cstdio>
+#include <cctype>
+#include <cstdint>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <queue>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <array>
+#include <utility>
+#include <numeric>
+#include <list>
+#include <memory>
+#include <cerrno>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
+
+// ========== Random Number Generation ==========
+
+// xoshiro256** generator, seeded through splitmix64.
+// Satisfies UniformRandomBitGenerator so it can drive std::shuffle.
+class Rng {
+public:
+    using result_type = uint64_t;
+
+    explicit Rng(uint64_t seed = 0) { reseed(seed); }
+
+    void reseed(uint64_t seed) {
+        for (int i = 0; i < 4; ++i) s[i] = splitmix64(seed);
+    }
+
+    uint64_t operator()() {
+        uint64_t result = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+
+    // Uniform integer in [0, n) (multiply-shift, bias is negligible for the small n we use)
+    int below(uint64_t n) { return (int)((((*this)() >> 32) * n) >> 32); }
+
+    static constexpr uint64_t min() { return 0; }
+    static constexpr uint64_t max() { return UINT64_MAX; }
+
+    static uint64_t splitmix64(uint64_t& x) {
+        uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+private:
+    uint64_t s[4];
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+};
+
+// Seeds we hand out are kept below 2^53 so they survive JSON parsers that use doubles (JS)
+const uint64_t SEED_MASK = (1ULL << 53) - 1;
+
+// Derive the seed of exercise #index from a batch seed (independent of the thread count)
+uint64_t deriveSeed(uint64_t baseSeed, uint64_t index) {
+    uint64_t x = baseSeed ^ (index * 0xD1B54A32D192ED03ULL);
+    return Rng::splitmix64(x) & SEED_MASK;
+}
+
+// Union-find with path halving and union by size
+struct DisjointSet {
+    std::vector<int> parent, size;
+
+    explicit DisjointSet(int n) : parent(n), size(n, 1) {
+        for (int i = 0; i < n; ++i) parent[i] = i;
+    }
+
+    int find(int x) {
+        while (parent[x] != x) {
+            parent[x] = parent[parent[x]];
+            x = parent[x];
+        }
+        return x;
+    }
+
+    // Returns false if a and b were already in the same set
+    bool unite(int a, int b) {
+        a = find(a);
+        b = find(b);
+        if (a == b) return false;
+        if (size[a] < size[b]) std::swap(a, b);
+        parent[b] = a;
+        size[a] += size[b];
+        return true;
+    }
+};
 
 // Constants for Drawing
 const int GRID_SIZE = 100; // Pixels between nodes
@@ -32,6 +137,97 @@ enum ExerciseType {
     AC_STEADY_STATE
 };
 
+// Persistent worker threads for fork-join loops. run(count, fn) calls fn(0..count-1) across
+// the workers and the calling thread, and returns once every call has finished. Several
+// threads may run loops on one pool at the same time; each loop is shared out in order.
+class ThreadPool {
+public:
+    explicit ThreadPool(int threads) {
+        for (int t = 1; t < threads; ++t) workers.emplace_back([this]() { work(); });
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& th : workers) th.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const { return (int)workers.size() + 1; }
+
+    void run(int count, const std::function<void(int)>& fn) {
+        if (count <= 1 || workers.empty()) {
+            for (int i = 0; i < count; ++i) fn(i);
+            return;
+        }
+        Loop loop(fn, count);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.push_back(&loop);
+        }
+        wake.notify_all();
+        loop.claim();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        auto it = std::find(pending.begin(), pending.end(), &loop);
+        if (it != pending.end()) pending.erase(it);
+        finished.wait(lock, [&]() { return loop.done.load() == count && loop.helpers == 0; });
+    }
+
+private:
+    struct Loop {
+        const std::function<void(int)>& fn;
+        int count;
+        std::atomic<int> next{0}, done{0};
+        int helpers = 0; // Workers inside claim(), guarded by the pool mutex
+
+        Loop(const std::function<void(int)>& f, int n) : fn(f), count(n) {}
+
+        void claim() {
+            for (int i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+                fn(i);
+                done.fetch_add(1);
+            }
+        }
+    };
+
+    void work() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            wake.wait(lock, [&]() { return stopping || !pending.empty(); });
+            if (stopping) return;
+            Loop* loop = pending.front();
+            if (loop->next.load() >= loop->count) { // Every index handed out: retire the loop
+                pending.pop_front();
+                continue;
+            }
+            loop->helpers++;
+            lock.unlock();
+            loop->claim();
+            lock.lock();
+            loop->helpers--;
+            finished.notify_all();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::deque<Loop*> pending;
+    std::mutex mutex;
+    std::condition_variable wake, finished;
+    bool stopping = false;
+};
+
+// Pool shared by the parallel solvers, one thread per core, created on first use
+inline ThreadPool& sharedThreadPool() {
+    static ThreadPool pool((int)std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+}
+
 // Complex number for phasor calculations
 struct Complex {
     double real, imag;
@@ -93,6 +289,26 @@ struct Complex {
     }
 };
 
+// Single-precision phasor: the factor type of the mixed-precision AC solve (see
+// solveMixedPrecision). Only the arithmetic the sparse LU needs.
+struct ComplexFloat {
+    float real, imag;
+
+    ComplexFloat(float r = 0.0f, float i = 0.0f) : real(r), imag(i) {}
+    explicit ComplexFloat(const Complex& z) : real((float)z.real), imag((float)z.imag) {}
+
+    ComplexFloat operator+(const ComplexFloat& o) const { return ComplexFloat(real + o.real, imag + o.imag); }
+    ComplexFloat operator-(const ComplexFloat& o) const { return ComplexFloat(real - o.real, imag - o.imag); }
+    ComplexFloat operator*(const ComplexFloat& o) const {
+        return ComplexFloat(real * o.real - imag * o.imag, real * o.imag + imag * o.real);
+    }
+    ComplexFloat operator/(const ComplexFloat& o) const {
+        float denom = o.real * o.real + o.imag * o.imag;
+        if (std::abs(denom) < 1e-12f) return ComplexFloat(0, 0);
+        return ComplexFloat((real * o.real + imag * o.imag) / denom, (imag * o.real - real * o.imag) / denom);
+    }
+};
+
 struct Point {
     int x, y;
     bool operator==(const Point& other) const { return x == other.x && y == other.y; }
@@ -166,1316 +382,7207 @@ struct Component {
 
 
 // --- Matrix Helper Class for Solver ---
+
+// Allocator returning 64-byte aligned storage (one cache line / one AVX-512 register)
+template <class T, size_t Align = 64>
+struct AlignedAllocator {
+    typedef T value_type;
+    template <class U> struct rebind { typedef AlignedAllocator<U, Align> other; };
+
+    AlignedAllocator() = default;
+    template <class U> AlignedAllocator(const AlignedAllocator<U, Align>&) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Align))); }
+    void deallocate(T* p, size_t) { ::operator delete(p, std::align_val_t(Align)); }
+
+    bool operator==(const AlignedAllocator&) const { return true; }
+    bool operator!=(const AlignedAllocator&) const { return false; }
+};
+
+typedef std::vector<double, AlignedAllocator<double>> AlignedVector;
+
+// Dense row-major matrix in a single aligned buffer. Rows are padded to a multiple
+// of 8 doubles so every row starts on a cache line.
 class Matrix {
 public:
     int rows, cols;
-    std::vector<std::vector<double>> data;
+    int stride;
+    std::vector<double, AlignedAllocator<double>> data;
 
-    Matrix(int r, int c) : rows(r), cols(c) {
-        data.resize(r, std::vector<double>(c, 0.0));
+    Matrix(int r, int c) : rows(r), cols(c), stride((c + 7) & ~7) {
+        data.assign((size_t)r * stride, 0.0);
     }
 
     // Accessor
-    double& at(int r, int c) { return data[r][c]; }
-    const double& at(int r, int c) const { return data[r][c]; }
+    double& at(int r, int c) { return data[(size_t)r * stride + c]; }
+    const double& at(int r, int c) const { return data[(size_t)r * stride + c]; }
+
+    double* row(int r) { return data.data() + (size_t)r * stride; }
+    const double* row(int r) const { return data.data() + (size_t)r * stride; }
 
     // Gaussian Elimination to solve Ax = b
-    // Returns x vector. Assumes A is square (N x N) and b is N x 1
-    static std::vector<double> solve(Matrix A, std::vector<double> b) {
-        int n = A.rows;
-        // Augmented matrix [A | b]
-        for (int i = 0; i < n; i++) {
-            A.data[i].push_back(b[i]);
-        }
+    // Returns x vector. Assumes A is square (N x N) and b is N x 1.
+    // A is taken by value: pass it with std::move to factor it in place without a copy.
+    static std::vector<double> solve(Matrix A, const std::vector<double>& b);
+};
+
+// In-place LU factorization with partial pivoting: P A = L U, stored over A's buffer.
+// Factor once, then solve any number of right-hand sides with triangular substitutions.
+// A column whose best pivot is below 1e-9 is skipped and its unknown is set to 0,
+// matching the original augmented-matrix elimination.
+class LUFactorization {
+public:
+    explicit LUFactorization(Matrix A) : lu(std::move(A)), perm(lu.rows) {
+        int n = lu.rows;
+        for (int i = 0; i < n; i++) perm[i] = i;
 
-        // Forward Elimination
         for (int i = 0; i < n; i++) {
             // Pivoting
             int pivot = i;
+            double best = std::abs(lu.at(i, i));
             for (int j = i + 1; j < n; j++) {
-                if (std::abs(A.data[j][i]) > std::abs(A.data[pivot][i])) pivot = j;
+                double v = std::abs(lu.at(j, i));
+                if (v > best) { best = v; pivot = j; }
+            }
+            if (pivot != i) {
+                std::swap_ranges(lu.row(i), lu.row(i) + n, lu.row(pivot));
+                std::swap(perm[i], perm[pivot]);
             }
-            std::swap(A.data[i], A.data[pivot]);
 
-            if (std::abs(A.data[i][i]) < 1e-9) continue; // Singular or nearly singular
+            if (best < 1e-9) {
+                // Singular or nearly singular: no elimination with this column
+                for (int j = i + 1; j < n; j++) lu.at(j, i) = 0.0;
+                continue;
+            }
 
+            const double* ri = lu.row(i);
             for (int j = i + 1; j < n; j++) {
-                double factor = A.data[j][i] / A.data[i][i];
-                for (int k = i; k <= n; k++) {
-                    A.data[j][k] -= factor * A.data[i][k];
+                double* rj = lu.row(j);
+                double factor = rj[i] / ri[i];
+                rj[i] = factor; // Multiplier stored in place of the eliminated entry (L)
+                if (factor == 0.0) continue;
+                for (int k = i + 1; k < n; k++) {
+                    rj[k] -= factor * ri[k];
                 }
             }
         }
+    }
+
+    int size() const { return lu.rows; }
 
+    // Solve in place: b (length n) is overwritten with x. No allocations.
+    void solveInPlace(double* b, double* work) const {
+        int n = lu.rows;
+        // Forward substitution with the unit lower factor, rows in pivot order
+        for (int i = 0; i < n; i++) {
+            const double* ri = lu.row(i);
+            double sum = b[perm[i]];
+            for (int j = 0; j < i; j++) sum -= ri[j] * work[j];
+            work[i] = sum;
+        }
         // Back Substitution
-        std::vector<double> x(n);
         for (int i = n - 1; i >= 0; i--) {
-            double sum = 0;
-            for (int j = i + 1; j < n; j++) {
-                sum += A.data[i][j] * x[j];
-            }
-            if (std::abs(A.data[i][i]) > 1e-9)
-                x[i] = (A.data[i][n] - sum) / A.data[i][i];
-            else 
-                x[i] = 0; // Or handle error
+            const double* ri = lu.row(i);
+            double sum = work[i];
+            for (int j = i + 1; j < n; j++) sum -= ri[j] * b[j];
+            b[i] = (std::abs(ri[i]) > 1e-9) ? sum / ri[i] : 0.0;
         }
+    }
+
+    std::vector<double> solve(const std::vector<double>& b) const {
+        std::vector<double> x(b), work(lu.rows);
+        solveInPlace(x.data(), work.data());
         return x;
     }
+
+    // Solve for several right-hand sides stored back to back (nrhs * n values)
+    void solveMany(std::vector<double>& B, int nrhs) const {
+        std::vector<double> work(lu.rows);
+        for (int r = 0; r < nrhs; r++) solveInPlace(B.data() + (size_t)r * lu.rows, work.data());
+    }
+
+private:
+    Matrix lu;
+    std::vector<int> perm; // perm[i] = original row now at position i
 };
 
-class Circuit {
+// --- Complex Dense Solver for AC Analysis ---
+
+// Complex matrix split into a plane of real parts and a plane of imaginary parts, each
+// with Matrix's padded row layout. The elimination then streams plain doubles, which
+// vectorizes without shuffling interleaved (re, im) pairs.
+class ComplexMatrix {
 public:
-    std::vector<Point> nodes;
-    std::vector<Component> components;
-    int width, height; // Grid dimensions
-    
-    // Exercise State
-    ExerciseType exerciseType;
-    double omega;              // Angular frequency (rad/s) for AC
-    double frequency;          // Frequency (Hz) for AC
-    std::string sourceWaveform; // "sin" or "cos" for AC exercises
-    int sourceAmplitude;       // Amplitude in Amps (integer value like 1, 2, 5, 10)
-    std::string questionText;
-    
-    std::vector<Component*> targetResistors; // Resistors for power calculation (AC)
-    Component* targetComp;     // Target component for transient analysis (DC)
-    int questionType = -1; // 0=V, 1=I, 2=P, 3=E(Energy), 4=Q(Charge)
+    int rows, cols;
+    int stride;
+    std::vector<double, AlignedAllocator<double>> re, im;
 
-    Circuit(int w, int h) : width(w), height(h), exerciseType(DC_TRANSIENT), 
-                            omega(0), frequency(0), sourceWaveform("sin"), sourceAmplitude(1), targetComp(nullptr) {
-        // Initialize grid nodes
-        for (int y = 0; y < h; ++y) {
-            for (int x = 0; x < w; ++x) {
-                nodes.push_back({x, y});
-            }
-        }
+    ComplexMatrix(int r, int c) : rows(r), cols(c), stride((c + 7) & ~7) {
+        re.assign((size_t)r * stride, 0.0);
+        im.assign((size_t)r * stride, 0.0);
     }
 
-    void addComponent(Component c) {
-        components.push_back(c);
+    Complex get(int r, int c) const {
+        size_t k = (size_t)r * stride + c;
+        return Complex(re[k], im[k]);
     }
-    
-    void generateQuestion() {
-        // Find suitable components for questions (R, L, C)
-        std::vector<Component*> targets;
-        for (auto& c : components) {
-            if (c.type == RESISTOR || c.type == CAPACITOR || c.type == INDUCTOR) {
-                targets.push_back(&c);
+
+    void add(int r, int c, const Complex& v) {
+        size_t k = (size_t)r * stride + c;
+        re[k] += v.real;
+        im[k] += v.imag;
+    }
+
+    double* reRow(int r) { return re.data() + (size_t)r * stride; }
+    double* imRow(int r) { return im.data() + (size_t)r * stride; }
+    const double* reRow(int r) const { return re.data() + (size_t)r * stride; }
+    const double* imRow(int r) const { return im.data() + (size_t)r * stride; }
+
+    // Complex counterpart of Matrix::solve
+    static std::vector<Complex> solve(ComplexMatrix A, const std::vector<Complex>& b);
+};
+
+// Elimination kernel y[k] -= f * x[k] for k in [begin, end), on split planes.
+// This row update is the O(n^3) part of the factorization.
+typedef void (*ComplexAxpyFn)(double* yRe, double* yIm, const double* xRe, const double* xIm,
+                              double fRe, double fIm, int begin, int end);
+
+// Lane kernels of the batched solver: one lane per system, so the multiplier varies per lane.
+// y[s] -= f[s] * x[s] for s in [0, lanes) wherever f[s] != 0; lanes is a multiple of 8 and
+// the vectors are 64-byte aligned (see BatchedLanes).
+typedef void (*LaneAxpyFn)(double* y, const double* x, const double* f, int lanes);
+typedef void (*LaneComplexAxpyFn)(double* yRe, double* yIm, const double* xRe, const double* xIm,
+                                  const double* fRe, const double* fIm, int lanes);
+
+// Trailing update of the blocked LU: C -= A B on LU_TILE x LU_TILE row-major, 64-byte aligned
+// tiles. Each kernel sums A_ik B_kj over k in order into a register block, then subtracts.
+const int LU_TILE = 64;
+typedef void (*TileUpdateFn)(double* C, const double* A, const double* B);
+typedef void (*TileUpdateFloatFn)(float* C, const float* A, const float* B);
+
+// All kernels use a separate multiply and subtract (no FMA) so every kernel, and the
+// batched and one-system solvers, give bit-identical results on any CPU.
+inline void complexAxpyScalar(double* yRe, double* yIm, const double* xRe, const double* xIm,
+                              double fRe, double fIm, int begin, int end) {
+    for (int k = begin; k < end; ++k) {
+        double xr = xRe[k], xi = xIm[k];
+        yRe[k] -= fRe * xr - fIm * xi;
+        yIm[k] -= fRe * xi + fIm * xr;
+    }
+}
+
+template <class F>
+inline void tileUpdateScalar(F* C, const F* A, const F* B) {
+    const int T = LU_TILE;
+    for (int i = 0; i < T; i += 4) {
+        for (int j = 0; j < T; j += 8) {
+            F acc[4][8] = {};
+            for (int k = 0; k < T; ++k) {
+                const F* bk = B + k * T + j;
+                for (int r = 0; r < 4; ++r) {
+                    F a = A[(i + r) * T + k];
+                    for (int c = 0; c < 8; ++c) acc[r][c] += a * bk[c];
+                }
+            }
+            for (int r = 0; r < 4; ++r) {
+                for (int c = 0; c < 8; ++c) C[(i + r) * T + j + c] -= acc[r][c];
             }
         }
-        
-        if (targets.empty()) {
-            questionText = "Calculate the total power supplied by the sources.";
-            return;
-        }
-        
-        targetComp = targets[rand() % targets.size()]; // Point to element in vector (WARNING: reallocation invalidates ptr)
-        // Better store index, but vector resizing shouldn't happen after generation.
-        // Actually, let's fix the pointer issue by using index or just ensuring no push_backs happen after.
-        // Let's store pointer, but be careful.
-        
-        // Pick type
-        int type = targetComp->type;
-        std::stringstream ss;
-        
-        if (type == RESISTOR) {
-            questionType = rand() % 3; // 0=V, 1=I, 2=P
-            if (questionType == 0) ss << "Calculate the Voltage (V) across " << targetComp->name << ".";
-            else if (questionType == 1) ss << "Calculate the Current (I) flowing through " << targetComp->name << ".";
-            else ss << "Calculate the Power (P) dissipated by " << targetComp->name << ".";
-        } else if (type == CAPACITOR) {
-            questionType = rand() % 3; // 0=V, 1=Q, 2=E
-            if (questionType == 0) ss << "Calculate the DC Steady State Voltage across " << targetComp->name << ".";
-            else if (questionType == 1) { ss << "Calculate the Charge (Q) stored in " << targetComp->name << " at DC Steady State."; questionType = 4; } // Map to 4 for Q
-            else { ss << "Calculate the Energy (E) stored in " << targetComp->name << " at DC Steady State."; questionType = 3; } // Map to 3 for E
-        } else if (type == INDUCTOR) {
-            questionType = rand() % 3; // 0=I, 1=V(0), 2=E
-            if (questionType == 0) { ss << "Calculate the DC Steady State Current through " << targetComp->name << "."; questionType = 1; } // I
-            else if (questionType == 1) { ss << "Calculate the Voltage across " << targetComp->name << " at DC Steady State."; questionType = 0; } // V (should be 0)
-            else { ss << "Calculate the Energy (E) stored in " << targetComp->name << " at DC Steady State."; questionType = 3; } // E
-        }
-        
-        questionText = ss.str();
     }
-    
-    // MNA Solver for DC Steady State
-    // switchState: true = initial state (t<0), false = final state (t>0)
-    // killSources: if true, turn off all V/I sources (for Thevenin)
-    // injectCurrent: if > 0, injects this current into targetComp nodes (for Thevenin)
-    std::vector<double> solveMNA(bool switchStateInitial, bool killSources, double injectCurrent = 0.0) {
-        int numNodes = nodes.size();
-        std::vector<int> voltSourceIndices;
-        
-        // Identify Voltage Sources (Component Indices)
-        for(size_t i=0; i<components.size(); ++i) {
-            // If killing sources, treating V source as Short (0V) -> but MNA handles 0V source fine.
-            // Actually, if killing sources, V source becomes Wire. 
-            // Better to keep them as "Voltage Source with 0V".
-            if(components[i].type == VOLTAGE_SOURCE) voltSourceIndices.push_back(i);
-        }
-        int numV = voltSourceIndices.size();
-        
-        int mSize = numNodes - 1 + numV; 
-        Matrix A(mSize, mSize);
-        std::vector<double> z(mSize, 0.0);
+}
 
-        auto getIdx = [](int n) { return n - 1; };
+inline void laneAxpyScalar(double* y, const double* x, const double* f, int lanes) {
+    for (int s = 0; s < lanes; ++s) {
+        if (f[s] != 0.0) y[s] -= f[s] * x[s];
+    }
+}
 
-        // Fill Conductances
-        for(const auto& c : components) {
-            double g = 0.0;
-            
-            if (c.type == RESISTOR) {
-                g = 1.0 / c.value;
-            } else if (c.type == INDUCTOR) {
-                // DC Short
-                g = 1.0 / 1e-6; 
-            } else if (c.type == CAPACITOR) {
-                // DC Open
-                g = 0.0; 
-            } else if (c.type == SWITCH) {
-                // Check state
-                bool isOpen = c.startsOpen; 
-                if (!switchStateInitial) isOpen = !isOpen; // Flip state for t>0
+inline void laneComplexAxpyScalar(double* yRe, double* yIm, const double* xRe, const double* xIm,
+                                  const double* fRe, const double* fIm, int lanes) {
+    for (int s = 0; s < lanes; ++s) {
+        if (fRe[s] == 0.0 && fIm[s] == 0.0) continue;
+        yRe[s] -= fRe[s] * xRe[s] - fIm[s] * xIm[s];
+        yIm[s] -= fRe[s] * xIm[s] + fIm[s] * xRe[s];
+    }
+}
 
-                if (isOpen) g = 0.0;
-                else g = 1.0 / 1e-6; // Closed = Short
-            } else if (c.type == CURRENT_SOURCE) {
-                if (killSources) continue; // It's 0A -> Open circuit -> Ignore
-                
-                int nA = c.nodeA_idx;
-                int nB = c.nodeB_idx;
-                if (nA > 0) z[getIdx(nA)] -= c.value;
-                if (nB > 0) z[getIdx(nB)] += c.value;
-                continue; 
-            } else {
-                continue; // V sources handled below
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CG_X86_SIMD 1
+#endif
+
+#ifdef CG_X86_SIMD
+// Compiled for AVX2/AVX-512 regardless of -march; only called after a runtime CPU check.
+// fp-contract=off keeps GCC from fusing the multiply and subtract into an FMA.
+#define CG_SIMD_FN(isa) __attribute__((target(isa), optimize("fp-contract=off")))
+
+// Unaligned loads: the update starts right after the pivot column, anywhere in the row.
+CG_SIMD_FN("avx2")
+inline void complexAxpyAVX2(double* yRe, double* yIm, const double* xRe, const double* xIm,
+                            double fRe, double fIm, int begin, int end) {
+    const __m256d fr = _mm256_set1_pd(fRe), fi = _mm256_set1_pd(fIm);
+    int k = begin;
+    for (; k + 4 <= end; k += 4) {
+        __m256d xr = _mm256_loadu_pd(xRe + k), xi = _mm256_loadu_pd(xIm + k);
+        __m256d yr = _mm256_loadu_pd(yRe + k), yi = _mm256_loadu_pd(yIm + k);
+        yr = _mm256_sub_pd(yr, _mm256_sub_pd(_mm256_mul_pd(fr, xr), _mm256_mul_pd(fi, xi)));
+        yi = _mm256_sub_pd(yi, _mm256_add_pd(_mm256_mul_pd(fr, xi), _mm256_mul_pd(fi, xr)));
+        _mm256_storeu_pd(yRe + k, yr);
+        _mm256_storeu_pd(yIm + k, yi);
+    }
+    for (; k < end; ++k) {
+        double xr = xRe[k], xi = xIm[k];
+        yRe[k] -= fRe * xr - fIm * xi;
+        yIm[k] -= fRe * xi + fIm * xr;
+    }
+}
+
+CG_SIMD_FN("avx512f")
+inline void complexAxpyAVX512(double* yRe, double* yIm, const double* xRe, const double* xIm,
+                              double fRe, double fIm, int begin, int end) {
+    const __m512d fr = _mm512_set1_pd(fRe), fi = _mm512_set1_pd(fIm);
+    for (int k = begin; k < end; k += 8) {
+        // Masked loads/stores cover the tail instead of a scalar loop
+        __mmask8 m = (end - k >= 8) ? (__mmask8)0xFF : (__mmask8)((1u << (end - k)) - 1);
+        __m512d xr = _mm512_maskz_loadu_pd(m, xRe + k), xi = _mm512_maskz_loadu_pd(m, xIm + k);
+        __m512d yr = _mm512_maskz_loadu_pd(m, yRe + k), yi = _mm512_maskz_loadu_pd(m, yIm + k);
+        yr = _mm512_sub_pd(yr, _mm512_sub_pd(_mm512_mul_pd(fr, xr), _mm512_mul_pd(fi, xi)));
+        yi = _mm512_sub_pd(yi, _mm512_add_pd(_mm512_mul_pd(fr, xi), _mm512_mul_pd(fi, xr)));
+        _mm512_mask_storeu_pd(yRe + k, m, yr);
+        _mm512_mask_storeu_pd(yIm + k, m, yi);
+    }
+}
+
+// 4x8 register block: eight accumulators, one broadcast of A and two loads of B per step
+CG_SIMD_FN("avx2")
+inline void tileUpdateAVX2(double* C, const double* A, const double* B) {
+    const int T = LU_TILE;
+    for (int i = 0; i < T; i += 4) {
+        for (int j = 0; j < T; j += 8) {
+            __m256d acc[4][2];
+            for (int r = 0; r < 4; ++r) acc[r][0] = acc[r][1] = _mm256_setzero_pd();
+            for (int k = 0; k < T; ++k) {
+                __m256d b0 = _mm256_load_pd(B + k * T + j), b1 = _mm256_load_pd(B + k * T + j + 4);
+                for (int r = 0; r < 4; ++r) {
+                    __m256d a = _mm256_broadcast_sd(A + (i + r) * T + k);
+                    acc[r][0] = _mm256_add_pd(acc[r][0], _mm256_mul_pd(a, b0));
+                    acc[r][1] = _mm256_add_pd(acc[r][1], _mm256_mul_pd(a, b1));
+                }
             }
+            for (int r = 0; r < 4; ++r) {
+                double* c = C + (i + r) * T + j;
+                _mm256_store_pd(c, _mm256_sub_pd(_mm256_load_pd(c), acc[r][0]));
+                _mm256_store_pd(c + 4, _mm256_sub_pd(_mm256_load_pd(c + 4), acc[r][1]));
+            }
+        }
+    }
+}
 
-            if (g > 0.0) {
-                int nA = c.nodeA_idx;
-                int nB = c.nodeB_idx;
-                if (nA > 0) A.at(getIdx(nA), getIdx(nA)) += g;
-                if (nB > 0) A.at(getIdx(nB), getIdx(nB)) += g;
-                if (nA > 0 && nB > 0) {
-                    A.at(getIdx(nA), getIdx(nB)) -= g;
-                    A.at(getIdx(nB), getIdx(nA)) -= g;
+// 8x16 register block: sixteen accumulators out of the 32 zmm registers
+CG_SIMD_FN("avx512f")
+inline void tileUpdateAVX512(double* C, const double* A, const double* B) {
+    const int T = LU_TILE;
+    for (int i = 0; i < T; i += 8) {
+        for (int j = 0; j < T; j += 16) {
+            __m512d acc[8][2];
+            for (int r = 0; r < 8; ++r) acc[r][0] = acc[r][1] = _mm512_setzero_pd();
+            for (int k = 0; k < T; ++k) {
+                __m512d b0 = _mm512_load_pd(B + k * T + j), b1 = _mm512_load_pd(B + k * T + j + 8);
+                for (int r = 0; r < 8; ++r) {
+                    __m512d a = _mm512_set1_pd(A[(i + r) * T + k]);
+                    acc[r][0] = _mm512_add_pd(acc[r][0], _mm512_mul_pd(a, b0));
+                    acc[r][1] = _mm512_add_pd(acc[r][1], _mm512_mul_pd(a, b1));
                 }
             }
+            for (int r = 0; r < 8; ++r) {
+                double* c = C + (i + r) * T + j;
+                _mm512_store_pd(c, _mm512_sub_pd(_mm512_load_pd(c), acc[r][0]));
+                _mm512_store_pd(c + 8, _mm512_sub_pd(_mm512_load_pd(c + 8), acc[r][1]));
+            }
         }
-        
-        // Test Current Injection (Thevenin)
-        if (injectCurrent != 0.0 && targetComp) {
-            // Inject 1A from B to A (Active sign convention measures V_A - V_B)
-            // Or typically we inject INTO A and OUT of B to measure R = (Va - Vb)/I.
-            int nA = targetComp->nodeA_idx;
-            int nB = targetComp->nodeB_idx;
-            // Inject INTO nA (+I), OUT of nB (-I)
-            if (nA > 0) z[getIdx(nA)] += injectCurrent;
-            if (nB > 0) z[getIdx(nB)] -= injectCurrent; // Wait, MNA RHS is sum of currents entering.
-            // If Source is external injecting INTO node A, then it adds to RHS. Correct.
-        }
-
-        // Voltage Sources
-        for (int i = 0; i < numV; ++i) {
-            int compIdx = voltSourceIndices[i];
-            const auto& c = components[compIdx];
-            int row = numNodes - 1 + i;
-            
-            int nA = c.nodeA_idx;
-            int nB = c.nodeB_idx;
-            
-            if (nA > 0) {
-                A.at(row, getIdx(nA)) = 1;
-                A.at(getIdx(nA), row) = 1;
+    }
+}
+
+// Single precision (mixed-precision solve): the same blocks with twice the lanes
+CG_SIMD_FN("avx2")
+inline void tileUpdateFloatAVX2(float* C, const float* A, const float* B) {
+    const int T = LU_TILE;
+    for (int i = 0; i < T; i += 4) {
+        for (int j = 0; j < T; j += 16) {
+            __m256 acc[4][2];
+            for (int r = 0; r < 4; ++r) acc[r][0] = acc[r][1] = _mm256_setzero_ps();
+            for (int k = 0; k < T; ++k) {
+                __m256 b0 = _mm256_load_ps(B + k * T + j), b1 = _mm256_load_ps(B + k * T + j + 8);
+                for (int r = 0; r < 4; ++r) {
+                    __m256 a = _mm256_broadcast_ss(A + (i + r) * T + k);
+                    acc[r][0] = _mm256_add_ps(acc[r][0], _mm256_mul_ps(a, b0));
+                    acc[r][1] = _mm256_add_ps(acc[r][1], _mm256_mul_ps(a, b1));
+                }
             }
-            if (nB > 0) {
-                A.at(row, getIdx(nB)) = -1;
-                A.at(getIdx(nB), row) = -1;
+            for (int r = 0; r < 4; ++r) {
+                float* c = C + (i + r) * T + j;
+                _mm256_store_ps(c, _mm256_sub_ps(_mm256_load_ps(c), acc[r][0]));
+                _mm256_store_ps(c + 8, _mm256_sub_ps(_mm256_load_ps(c + 8), acc[r][1]));
             }
-            
-            // If killSources is true, all V sources become 0V wires
-            z[row] = killSources ? 0.0 : c.value;
         }
+    }
+}
 
-        std::vector<double> x = Matrix::solve(A, z);
-        
-        // Extract Node Voltages
-        std::vector<double> V_nodes(numNodes, 0.0);
-        for(int i=1; i<numNodes; ++i) V_nodes[i] = x[getIdx(i)];
-        
-        return V_nodes;
+CG_SIMD_FN("avx512f")
+inline void tileUpdateFloatAVX512(float* C, const float* A, const float* B) {
+    const int T = LU_TILE;
+    for (int i = 0; i < T; i += 8) {
+        for (int j = 0; j < T; j += 32) {
+            __m512 acc[8][2];
+            for (int r = 0; r < 8; ++r) acc[r][0] = acc[r][1] = _mm512_setzero_ps();
+            for (int k = 0; k < T; ++k) {
+                __m512 b0 = _mm512_load_ps(B + k * T + j), b1 = _mm512_load_ps(B + k * T + j + 16);
+                for (int r = 0; r < 8; ++r) {
+                    __m512 a = _mm512_set1_ps(A[(i + r) * T + k]);
+                    acc[r][0] = _mm512_add_ps(acc[r][0], _mm512_mul_ps(a, b0));
+                    acc[r][1] = _mm512_add_ps(acc[r][1], _mm512_mul_ps(a, b1));
+                }
+            }
+            for (int r = 0; r < 8; ++r) {
+                float* c = C + (i + r) * T + j;
+                _mm512_store_ps(c, _mm512_sub_ps(_mm512_load_ps(c), acc[r][0]));
+                _mm512_store_ps(c + 16, _mm512_sub_ps(_mm512_load_ps(c + 16), acc[r][1]));
+            }
+        }
     }
+}
 
-    // Helper to get voltage/current of target
-    double getComponentValue(const std::vector<double>& V_nodes, Component* target, bool isInductor) {
-         double v = V_nodes[target->nodeA_idx] - V_nodes[target->nodeB_idx];
-         if (isInductor) {
-             // For inductor in DC, I = V/R_small? Or we need the branch current?
-             // MNA variables for voltage sources give currents directly.
-             // But L is modeled as discrete resistor 1e-6.
-             // So I = V / 1e-6.
-             return v / 1e-6; // Approx I
-         } else {
-             // Capacitor -> V
-             return v;
-         }
+CG_SIMD_FN("avx2")
+inline void laneAxpyAVX2(double* y, const double* x, const double* f, int lanes) {
+    const __m256d zero = _mm256_setzero_pd();
+    for (int s = 0; s < lanes; s += 4) {
+        __m256d fv = _mm256_load_pd(f + s), yv = _mm256_load_pd(y + s);
+        __m256d upd = _mm256_sub_pd(yv, _mm256_mul_pd(fv, _mm256_load_pd(x + s)));
+        _mm256_store_pd(y + s, _mm256_blendv_pd(yv, upd, _mm256_cmp_pd(fv, zero, _CMP_NEQ_UQ)));
     }
+}
 
-    struct TransientResult {
-        double initialVal;
-        double finalVal;
-        double tau;
-    };
+CG_SIMD_FN("avx512f")
+inline void laneAxpyAVX512(double* y, const double* x, const double* f, int lanes) {
+    const __m512d zero = _mm512_setzero_pd();
+    for (int s = 0; s < lanes; s += 8) {
+        __m512d fv = _mm512_load_pd(f + s), yv = _mm512_load_pd(y + s);
+        __mmask8 m = _mm512_cmp_pd_mask(fv, zero, _CMP_NEQ_UQ);
+        _mm512_store_pd(y + s, _mm512_mask_sub_pd(yv, m, yv, _mm512_mul_pd(fv, _mm512_load_pd(x + s))));
+    }
+}
 
-    TransientResult solveTransient() {
-        if (!targetComp) return {0,0,0};
-        
-        bool isInductor = (targetComp->type == INDUCTOR);
+CG_SIMD_FN("avx2")
+inline void laneComplexAxpyAVX2(double* yRe, double* yIm, const double* xRe, const double* xIm,
+                                const double* fRe, const double* fIm, int lanes) {
+    const __m256d zero = _mm256_setzero_pd();
+    for (int s = 0; s < lanes; s += 4) {
+        __m256d fr = _mm256_load_pd(fRe + s), fi = _mm256_load_pd(fIm + s);
+        __m256d xr = _mm256_load_pd(xRe + s), xi = _mm256_load_pd(xIm + s);
+        __m256d yr = _mm256_load_pd(yRe + s), yi = _mm256_load_pd(yIm + s);
+        __m256d m = _mm256_or_pd(_mm256_cmp_pd(fr, zero, _CMP_NEQ_UQ), _mm256_cmp_pd(fi, zero, _CMP_NEQ_UQ));
+        __m256d ur = _mm256_sub_pd(yr, _mm256_sub_pd(_mm256_mul_pd(fr, xr), _mm256_mul_pd(fi, xi)));
+        __m256d ui = _mm256_sub_pd(yi, _mm256_add_pd(_mm256_mul_pd(fr, xi), _mm256_mul_pd(fi, xr)));
+        _mm256_store_pd(yRe + s, _mm256_blendv_pd(yr, ur, m));
+        _mm256_store_pd(yIm + s, _mm256_blendv_pd(yi, ui, m));
+    }
+}
 
-        // 1. Initial State (t < 0)
-        // Switch is in 'startsOpen' state.
-        std::vector<double> vNodesInit = solveMNA(true, false);
-        double valInit = getComponentValue(vNodesInit, targetComp, isInductor);
-        
-        // 2. Final State (t = inf)
-        // Switch is in '!startsOpen' state.
-        std::vector<double> vNodesFinal = solveMNA(false, false);
-        double valFinal = getComponentValue(vNodesFinal, targetComp, isInductor);
-        
-        // 3. Time Constant (Tau)
-        // State: t > 0 (Final State switch)
-        // Sources: Killed.
-        // Component: Removed (Open).
-        // Injection: 1A at component terminals.
-        // Req = V_terminals / 1A.
-        
-        // Important: When calculating Req seen by L/C, the L/C itself must be removed from the circuit.
-        // My solveMNA counts L/C as Short/Open based on DC rules. 
-        // For Req Calculation, we want L/C to be "Open" (removed) so we can measure resistance across valid terminals.
-        // My MNA Loop:
-        // if c.type == CAPACITOR -> g=0 (already open).
-        // if c.type == INDUCTOR -> g=large (Short).
-        // I need to force the targetComp to be OPEN during Req calculation even if it is an Inductor.
-        // I'll assume targetComp 'g' contribution is 0 manually or handle it.
-        // Wait, MNA loop iterates all components.
-        // I should have a flag 'excludeTarget' in solveMNA? Or just temporarily set its type/value.
-        // Let's modify solveMNA to ignore targetComp.
-        
-        // Actually, let's keep it simple:
-        // Temporarily change targetComp type to CAPACITOR (Open) if it's INDUCTOR, 
-        // calculate, then swap back.
-        ComponentType oldType = targetComp->type;
-        targetComp->type = CAPACITOR; // Force Open
-        
-        std::vector<double> vNodesReq = solveMNA(false, true, 1.0); // t>0 switch, kill sources, inject 1A
-        
-        targetComp->type = oldType; // Restore
-        
-        double vTh = vNodesReq[targetComp->nodeA_idx] - vNodesReq[targetComp->nodeB_idx];
-        double Req = std::abs(vTh / 1.0);
-        
-        double tau = 0.0;
-        if (isInductor) {
-            // L / R
-            // targetComp->value is mH -> 1e-3 H
-            tau = (targetComp->value * 1e-3) / Req;
-        } else {
-            // R * C
-            // targetComp->value is uF -> 1e-6 F
-            tau = Req * (targetComp->value * 1e-6);
-        }
-        
-        return {valInit, valFinal, tau};
+CG_SIMD_FN("avx512f")
+inline void laneComplexAxpyAVX512(double* yRe, double* yIm, const double* xRe, const double* xIm,
+                                  const double* fRe, const double* fIm, int lanes) {
+    const __m512d zero = _mm512_setzero_pd();
+    for (int s = 0; s < lanes; s += 8) {
+        __m512d fr = _mm512_load_pd(fRe + s), fi = _mm512_load_pd(fIm + s);
+        __m512d xr = _mm512_load_pd(xRe + s), xi = _mm512_load_pd(xIm + s);
+        __m512d yr = _mm512_load_pd(yRe + s), yi = _mm512_load_pd(yIm + s);
+        __mmask8 m = _mm512_cmp_pd_mask(fr, zero, _CMP_NEQ_UQ) | _mm512_cmp_pd_mask(fi, zero, _CMP_NEQ_UQ);
+        _mm512_store_pd(yRe + s, _mm512_mask_sub_pd(yr, m, yr, _mm512_sub_pd(_mm512_mul_pd(fr, xr), _mm512_mul_pd(fi, xi))));
+        _mm512_store_pd(yIm + s, _mm512_mask_sub_pd(yi, m, yi, _mm512_add_pd(_mm512_mul_pd(fr, xi), _mm512_mul_pd(fi, xr))));
     }
+}
+#endif
 
-    // ============ AC Analysis Methods ============
-    
-    struct ACResult {
-        std::map<std::string, double> avgPower;  // resistor name -> power (W)
-        double powerFactor;
-        bool hasPowerFactor;  // true if single source exists
-    };
-    
-    // Calculate impedance in phasor domain
-    Complex calculateImpedance(const Component& c, double omega_val) {
-        if (c.type == RESISTOR) {
-            return Complex(c.value, 0);  // Z = R
-        } else if (c.type == INDUCTOR) {
-            // Z = jωL, L in mH -> H
-            double L_henry = c.value * 1e-3;
-            return Complex(0, omega_val * L_henry);  // jωL
-        } else if (c.type == CAPACITOR) {
-            // Z = 1/(jωC) = -j/(ωC), C in µF -> F
-            double C_farad = c.value * 1e-6;
-            return Complex(0, -1.0 / (omega_val * C_farad));  // -j/(ωC)
-        }
-        return Complex(0, 0);
+// One implementation of every elimination kernel for a given instruction set
+struct SimdKernels {
+    const char* name;
+    ComplexAxpyFn complexAxpy;
+    LaneAxpyFn laneAxpy;
+    LaneComplexAxpyFn laneComplexAxpy;
+    TileUpdateFn tileUpdate;
+    TileUpdateFloatFn tileUpdateFloat;
+};
+
+// Kernel sets this CPU can run, slowest first (the scalar loops are always available)
+inline std::vector<SimdKernels> availableSimdKernels() {
+    std::vector<SimdKernels> kernels = {{"scalar", complexAxpyScalar, laneAxpyScalar, laneComplexAxpyScalar, tileUpdateScalar<double>,
+                                                tileUpdateScalar<float>}};
+#ifdef CG_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.push_back({"avx2", complexAxpyAVX2, laneAxpyAVX2, laneComplexAxpyAVX2, tileUpdateAVX2, tileUpdateFloatAVX2});
     }
-    
-    // Simple complex linear system solver
-    std::vector<Complex> solveComplexLinearSystem(std::vector<std::vector<Complex>> A, std::vector<Complex> b) {
-        int n = A.size();
-        
-        // Augment matrix
-        for (int i = 0; i < n; i++) {
-            A[i].push_back(b[i]);
-        }
-        
-        // Forward elimination
+    if (__builtin_cpu_supports("avx512f")) {
+        kernels.push_back({"avx512", complexAxpyAVX512, laneAxpyAVX512, laneComplexAxpyAVX512, tileUpdateAVX512,
+                           tileUpdateFloatAVX512});
+    }
+#endif
+    return kernels;
+}
+
+// Widest kernel set supported by the CPU, picked once
+inline const SimdKernels& bestSimdKernels() {
+    static const SimdKernels best = availableSimdKernels().back();
+    return best;
+}
+
+// In-place complex LU with partial pivoting, the AC counterpart of LUFactorization.
+// Pivots are compared by squared magnitude (no sqrt per candidate) and a column whose
+// best pivot has |z| < 1e-12 is skipped, its unknown set to 0.
+class ComplexLUFactorization {
+public:
+    explicit ComplexLUFactorization(ComplexMatrix A, const SimdKernels& kernels = bestSimdKernels())
+        : lu(std::move(A)), perm(lu.rows) {
+        int n = lu.rows;
+        for (int i = 0; i < n; i++) perm[i] = i;
+
         for (int i = 0; i < n; i++) {
             // Pivoting
             int pivot = i;
+            double best = sq(lu.reRow(i)[i], lu.imRow(i)[i]);
             for (int j = i + 1; j < n; j++) {
-                if (A[j][i].magnitude() > A[pivot][i].magnitude()) pivot = j;
+                double v = sq(lu.reRow(j)[i], lu.imRow(j)[i]);
+                if (v > best) { best = v; pivot = j; }
             }
-            std::swap(A[i], A[pivot]);
-            
-            if (A[i][i].magnitude() < 1e-12) continue;
-            
+            if (pivot != i) {
+                std::swap_ranges(lu.reRow(i), lu.reRow(i) + n, lu.reRow(pivot));
+                std::swap_ranges(lu.imRow(i), lu.imRow(i) + n, lu.imRow(pivot));
+                std::swap(perm[i], perm[pivot]);
+            }
+
+            if (best < 1e-24) {
+                // Singular or nearly singular: no elimination with this column
+                for (int j = i + 1; j < n; j++) lu.reRow(j)[i] = lu.imRow(j)[i] = 0.0;
+                continue;
+            }
+
+            const double* riRe = lu.reRow(i);
+            const double* riIm = lu.imRow(i);
+            // factor = a_ji / a_ii = a_ji * conj(a_ii) / |a_ii|^2
+            double invRe = riRe[i] / best, invIm = -riIm[i] / best;
             for (int j = i + 1; j < n; j++) {
-                Complex factor = A[j][i] / A[i][i];
-                for (int k = i; k <= n; k++) {
-                    A[j][k] = A[j][k] - factor * A[i][k];
-                }
+                double* rjRe = lu.reRow(j);
+                double* rjIm = lu.imRow(j);
+                double aRe = rjRe[i], aIm = rjIm[i];
+                if (aRe == 0.0 && aIm == 0.0) continue;
+                double fRe = aRe * invRe - aIm * invIm;
+                double fIm = aRe * invIm + aIm * invRe;
+                rjRe[i] = fRe; // Multiplier stored in place of the eliminated entry (L)
+                rjIm[i] = fIm;
+                kernels.complexAxpy(rjRe, rjIm, riRe, riIm, fRe, fIm, i + 1, n);
             }
         }
-        
-        // Back substitution
-        std::vector<Complex> x(n);
+    }
+
+    int size() const { return lu.rows; }
+
+    std::vector<Complex> solve(const std::vector<Complex>& b) const {
+        int n = lu.rows;
+        std::vector<double> yRe(n), yIm(n);
+        // Forward substitution with the unit lower factor, rows in pivot order
+        for (int i = 0; i < n; i++) {
+            const double* rRe = lu.reRow(i);
+            const double* rIm = lu.imRow(i);
+            double sRe = b[perm[i]].real, sIm = b[perm[i]].imag;
+            for (int j = 0; j < i; j++) {
+                sRe -= rRe[j] * yRe[j] - rIm[j] * yIm[j];
+                sIm -= rRe[j] * yIm[j] + rIm[j] * yRe[j];
+            }
+            yRe[i] = sRe;
+            yIm[i] = sIm;
+        }
+        // Back Substitution (overwrites y with x)
         for (int i = n - 1; i >= 0; i--) {
-            Complex sum(0, 0);
+            const double* rRe = lu.reRow(i);
+            const double* rIm = lu.imRow(i);
+            double sRe = yRe[i], sIm = yIm[i];
             for (int j = i + 1; j < n; j++) {
-                sum = sum + A[i][j] * x[j];
+                sRe -= rRe[j] * yRe[j] - rIm[j] * yIm[j];
+                sIm -= rRe[j] * yIm[j] + rIm[j] * yRe[j];
             }
-            if (A[i][i].magnitude() > 1e-12) {
-                x[i] = (A[i][n] - sum) / A[i][i];
+            double d = sq(rRe[i], rIm[i]);
+            if (d >= 1e-24) {
+                yRe[i] = (sRe * rRe[i] + sIm * rIm[i]) / d;
+                yIm[i] = (sIm * rRe[i] - sRe * rIm[i]) / d;
             } else {
-                x[i] = Complex(0, 0);
+                yRe[i] = yIm[i] = 0.0;
             }
         }
+        std::vector<Complex> x(n);
+        for (int i = 0; i < n; i++) x[i] = Complex(yRe[i], yIm[i]);
         return x;
     }
-    
-    // Solve AC circuit using complex MNA
-    ACResult solveAC() {
-        ACResult result;
-        result.hasPowerFactor = false;
-        result.powerFactor = 0.0;
-        
-        int numNodes = nodes.size();
-        
-        // Count voltage sources for MNA size
-        std::vector<int> voltSourceIndices;
-        int numSources = 0;
-        for(size_t i=0; i<components.size(); ++i) {
-            if(components[i].type == VOLTAGE_SOURCE) {
-                voltSourceIndices.push_back(i);
-                numSources++;
-            } else if(components[i].type == CURRENT_SOURCE) {
-                numSources++;
-            }
+
+private:
+    static double sq(double re, double im) { return re * re + im * im; }
+
+    ComplexMatrix lu;
+    std::vector<int> perm; // perm[i] = original row now at position i
+};
+
+inline double magSq(double v) { return v * v; }
+inline double magSq(const Complex& z) { return z.real * z.real + z.imag * z.imag; }
+inline double magSq(float v) { return (double)v * v; }
+inline double magSq(const ComplexFloat& z) { return (double)z.real * z.real + (double)z.imag * z.imag; }
+
+// Same singularity thresholds as the dense solvers (|a| < 1e-9 real, |z| < 1e-12 complex), squared
+inline double singularTolSq(double) { return 1e-18; }
+inline double singularTolSq(const Complex&) { return 1e-24; }
+inline double singularTolSq(float) { return 1e-18; }
+inline double singularTolSq(const ComplexFloat&) { return 1e-24; }
+
+// Cache-blocked, right-looking LU with partial pivoting for medium and large dense systems,
+// real or complex. The matrix is copied into TILE x TILE tiles, each contiguous, and every
+// step factors one column of tiles (the panel), then
+//  - applies the panel's row swaps to the other tile columns and solves the unit lower
+//    triangle of the diagonal tile into the tiles right of it (one task per tile column),
+//  - updates the trailing matrix A_IJ -= L_IK U_KJ (one task per tile, skipping tiles
+//    whose L_IK or U_KJ is all zero, which is most of them for circuit matrices).
+// The update is the O(n^3) part and runs through the SIMD tile kernel; complex tiles are
+// split into real and imaginary planes first and updated as three real products.
+// Tasks run on a ThreadPool. Singular columns are handled as in LUFactorization: a column
+// without a pivot above the threshold is not eliminated and its unknown is set to 0.
+template <class T>
+class BlockedLU {
+public:
+    static const int TILE = LU_TILE;
+
+    explicit BlockedLU(const Matrix& A, ThreadPool& pool = sharedThreadPool(),
+                       const SimdKernels& kernels = bestSimdKernels()) : BlockedLU(A.rows) {
+        for (int r = 0; r < n; ++r) {
+            for (int c = 0; c < n; ++c) at(r, c) = T(A.at(r, c));
         }
-        
-        // Check if we have exactly one source for power factor
-        result.hasPowerFactor = (numSources == 1);
-        
-        int numV = voltSourceIndices.size();
-        int mSize = numNodes - 1 + numV;
-        
-        // Complex MNA matrices
-        std::vector<std::vector<Complex>> A(mSize, std::vector<Complex>(mSize, Complex(0, 0)));
-        std::vector<Complex> z(mSize, Complex(0, 0));
-        
-        auto getIdx = [](int n) { return n - 1; };
-        
-        // Fill complex admittances
-        for(const auto& c : components) {
-            Complex Y(0, 0);  // Admittance
-            
-            if (c.type == RESISTOR || c.type == INDUCTOR || c.type == CAPACITOR) {
-                Complex Z = calculateImpedance(c, omega);
-                if (Z.magnitude() > 1e-12) {
-                    Y = Complex(1, 0) / Z;  // Y = 1/Z
-                }
-            } else if (c.type == CURRENT_SOURCE) {
-                // Current sources contribute to RHS
-                int nA = c.nodeA_idx;
-                int nB = c.nodeB_idx;
-                // Assuming AC source with amplitude c.value and phase 0
-                Complex I_source(c.value, 0);
-                if (nA > 0) z[getIdx(nA)] = z[getIdx(nA)] - I_source;
-                if (nB > 0) z[getIdx(nB)] = z[getIdx(nB)] + I_source;
-                continue;
-            } else {
-                continue; // V sources handled below
-            }
-            
-            // Stamp admittance
-            if (Y.magnitude() > 1e-12) {
-                int nA = c.nodeA_idx;
-                int nB = c.nodeB_idx;
-                if (nA > 0) A[getIdx(nA)][getIdx(nA)] = A[getIdx(nA)][getIdx(nA)] + Y;
-                if (nB > 0) A[getIdx(nB)][getIdx(nB)] = A[getIdx(nB)][getIdx(nB)] + Y;
-                if (nA > 0 && nB > 0) {
-                    A[getIdx(nA)][getIdx(nB)] = A[getIdx(nA)][getIdx(nB)] - Y;
-                    A[getIdx(nB)][getIdx(nA)] = A[getIdx(nB)][getIdx(nA)] - Y;
-                }
-            }
+        factor(pool, kernels);
+    }
+
+    explicit BlockedLU(const ComplexMatrix& A, ThreadPool& pool = sharedThreadPool(),
+                       const SimdKernels& kernels = bestSimdKernels()) : BlockedLU(A.rows) {
+        for (int r = 0; r < n; ++r) {
+            for (int c = 0; c < n; ++c) at(r, c) = T(A.get(r, c));
         }
-        
-        // Voltage sources (same MNA technique but with complex values)
-        for (int i = 0; i < numV; ++i) {
-            int compIdx = voltSourceIndices[i];
-            const auto& c = components[compIdx];
-            int row = numNodes - 1 + i;
-            
-            int nA = c.nodeA_idx;
-            int nB = c.nodeB_idx;
-            
-            if (nA > 0) {
-                A[row][getIdx(nA)] = Complex(1, 0);
-                A[getIdx(nA)][row] = Complex(1, 0);
-            }
-            if (nB > 0) {
-                A[row][getIdx(nB)] = Complex(-1, 0);
-                A[getIdx(nB)][row] = Complex(-1, 0);
+        factor(pool, kernels);
+    }
+
+    int size() const { return n; }
+
+    std::vector<T> solve(const std::vector<T>& b) const {
+        std::vector<T> x(b);
+        x.resize((size_t)tiles * TILE, T(0)); // Padding unknowns stay 0
+        for (int i = 0; i < n; ++i) std::swap(x[i], x[ipiv[i]]);
+        for (int i = 0; i < n; ++i) { // Forward substitution with the unit lower factor
+            T sum = x[i];
+            for (int J = 0; J <= i / TILE; ++J) {
+                const T* row = tileRow(i, J);
+                const T* xj = x.data() + J * TILE;
+                int end = J == i / TILE ? i % TILE : TILE;
+                for (int k = 0; k < end; ++k) sum = sum - row[k] * xj[k];
             }
-            
-            // Voltage source phasor (amplitude with phase 0)
-            z[row] = Complex(c.value, 0);
+            x[i] = sum;
         }
-        
-        // Solve complex system (Gaussian elimination)
-        std::vector<Complex> x = solveComplexLinearSystem(A, z);
-        
-        // Extract node voltages
-        std::vector<Complex> V_nodes(numNodes, Complex(0, 0));
-        for(int i=1; i<numNodes; ++i) {
-            if (getIdx(i) < (int)x.size()) {
-                V_nodes[i] = x[getIdx(i)];
+        for (int i = n - 1; i >= 0; --i) { // Back substitution
+            T sum = x[i];
+            for (int J = i / TILE; J < tiles; ++J) {
+                const T* row = tileRow(i, J);
+                const T* xj = x.data() + J * TILE;
+                for (int k = J == i / TILE ? i % TILE + 1 : 0; k < TILE; ++k) sum = sum - row[k] * xj[k];
             }
+            T d = at(i, i);
+            x[i] = magSq(d) >= singularTolSq(d) ? sum / d : T(0);
         }
-        
-        // Calculate powers for target resistors
-        for (Component* targetR : targetResistors) {
-            if (targetR && targetR->type == RESISTOR) {
-                Complex V_comp = V_nodes[targetR->nodeA_idx] - V_nodes[targetR->nodeB_idx];
-                double V_mag = V_comp.magnitude();
-                // P_avg = |V|^2 / (2*R)
-                double P_avg = (V_mag * V_mag) / (2.0 * targetR->value);
-                result.avgPower[targetR->name] = P_avg;
-            }
+        x.resize(n);
+        return x;
+    }
+
+private:
+    typedef std::vector<T, AlignedAllocator<T>> TileStore;
+
+    int n, tiles;
+    TileStore data;        // Tile (I, J) at (I * tiles + J) * TILE * TILE, row-major inside
+    std::vector<int> ipiv; // Row i was swapped with row ipiv[i] >= i at step i
+
+    explicit BlockedLU(int size)
+        : n(size), tiles((size + TILE - 1) / TILE), data((size_t)tiles * tiles * TILE * TILE, T(0)), ipiv(size) {}
+
+    T* tile(int I, int J) { return data.data() + ((size_t)I * tiles + J) * TILE * TILE; }
+    T* tileRow(int r, int J) { return tile(r / TILE, J) + (r % TILE) * TILE; }
+    const T* tileRow(int r, int J) const { return const_cast<BlockedLU*>(this)->tileRow(r, J); }
+    T& at(int r, int c) { return tileRow(r, c / TILE)[c % TILE]; }
+    const T& at(int r, int c) const { return const_cast<BlockedLU*>(this)->at(r, c); }
+
+    static bool isZero(const T* t) {
+        for (int k = 0; k < TILE * TILE; ++k) {
+            if (magSq(t[k]) != 0.0) return false;
         }
-        
-        // Calculate power factor if single source
-        if (result.hasPowerFactor) {
-            // Find the source
-            Component* source = nullptr;
-            int sourceType = -1; // 0=V, 1=I
-            for (auto& c : components) {
-                if (c.type == VOLTAGE_SOURCE) {
-                    source = &c;
-                    sourceType = 0;
-                    break;
-                } else if (c.type == CURRENT_SOURCE) {
-                    source = &c;
-                    sourceType = 1;
-                    break;
+        return true;
+    }
+
+    void factor(ThreadPool& pool, const SimdKernels& kernels) {
+        std::vector<char> lowerNonZero(tiles), upperNonZero(tiles);
+        std::vector<std::pair<int, int>> updates;
+        for (int K = 0; K < tiles; ++K) {
+            int c0 = K * TILE, c1 = std::min(n, c0 + TILE);
+            factorPanel(K, c0, c1);
+
+            pool.run(tiles - 1, [&](int t) {
+                int J = t < K ? t : t + 1;
+                for (int c = c0; c < c1; ++c) {
+                    if (ipiv[c] != c) std::swap_ranges(tileRow(c, J), tileRow(c, J) + TILE, tileRow(ipiv[c], J));
                 }
-            }
-            
-            if (source) {
-                Complex V_source, I_source;
-                
-                if (sourceType == 0) {
-                    // Voltage source: V is known, I is in MNA solution
-                    V_source = Complex(source->value, 0);
-                    // Current through V source is the corresponding MNA variable
-                    // It's at position numNodes-1 (first voltage source)
-                    if ((int)x.size() > numNodes - 1) {
-                        I_source = x[numNodes - 1];
+                if (J < K) return;
+                // U_KJ = L_KK^-1 A_KJ
+                const T* L = tile(K, K);
+                T* U = tile(K, J);
+                for (int i = 1; i < c1 - c0; ++i) {
+                    for (int k = 0; k < i; ++k) {
+                        T l = L[i * TILE + k];
+                        if (magSq(l) == 0.0) continue;
+                        for (int j = 0; j < TILE; ++j) U[i * TILE + j] = U[i * TILE + j] - l * U[k * TILE + j];
                     }
-                } else {
-                    // Current source: I is known, V across it is node difference
-                    I_source = Complex(source->value, 0);
-                    V_source = V_nodes[source->nodeA_idx] - V_nodes[source->nodeB_idx];
                 }
-                
-                // Power factor = cos(angle(V) - angle(I))
-                double phi = V_source.phase() - I_source.phase();
-                result.powerFactor = std::cos(phi);
+                upperNonZero[J] = !isZero(U);
+            });
+
+            updates.clear();
+            for (int I = K + 1; I < tiles; ++I) lowerNonZero[I] = !isZero(tile(I, K));
+            for (int I = K + 1; I < tiles; ++I) {
+                for (int J = K + 1; J < tiles; ++J) {
+                    if (lowerNonZero[I] && upperNonZero[J]) updates.push_back({I, J});
+                }
             }
+            pool.run((int)updates.size(), [&](int t) {
+                int I = updates[t].first, J = updates[t].second;
+                multiplySubtract(tile(I, J), tile(I, K), tile(K, J), kernels);
+            });
         }
-        
-        return result;
     }
 
-    void exportSVG(const std::string& filename) {
-        std::ofstream svg(filename);
-        int gridWidth = (width - 1) * GRID_SIZE + 2 * MARGIN;
-        int gridHeight = (height - 1) * GRID_SIZE + 2 * MARGIN;
-        
-        // Ensure minimum width for text
-        int imgWidth = std::max(gridWidth, 500);
-        int imgHeight = gridHeight + 40; // Extra space for text
+    // Unblocked elimination of columns c0..c1-1 within the panel (tile column K)
+    void factorPanel(int K, int c0, int c1) {
+        for (int c = c0; c < c1; ++c) {
+            int lc = c - c0;
+            int pivot = c;
+            double best = magSq(at(c, c));
+            for (int r = c + 1; r < n; ++r) {
+                double v = magSq(at(r, c));
+                if (v > best) { best = v; pivot = r; }
+            }
+            ipiv[c] = pivot;
+            if (pivot != c) std::swap_ranges(tileRow(c, K), tileRow(c, K) + TILE, tileRow(pivot, K));
 
-        svg << "<svg width=\"" << imgWidth << "\" height=\"" << imgHeight << "\" xmlns=\"http://www.w3.org/2000/svg\">" << std::endl;
-        
-        // Definitions
-        svg << "<defs>" << std::endl;
-        svg << "<marker id=\"arrow\" markerWidth=\"10\" markerHeight=\"10\" refX=\"9\" refY=\"3\" orient=\"auto\" markerUnits=\"strokeWidth\">" << std::endl;
-        svg << "<path d=\"M0,0 L0,6 L9,3 z\" fill=\"black\" />" << std::endl;
-        svg << "</marker>" << std::endl;
-        svg << "</defs>" << std::endl;
-        
-        svg << "<style>" << std::endl;
-        svg << ".wire { stroke: black; stroke-width: 2; fill: none; }" << std::endl;
-        svg << ".node { fill: black; }" << std::endl;
-        svg << ".text { font-family: sans-serif; font-size: 12px; }" << std::endl;
-        svg << ".qtext { font-family: sans-serif; font-size: 14px; font-weight: bold; fill: #0000AA; }" << std::endl;
-        svg << "</style>" << std::endl;
-        
-        // Background
-        svg << "<rect width=\"100%\" height=\"100%\" fill=\"white\" />" << std::endl;
+            if (best < singularTolSq(T())) {
+                // Singular or nearly singular: no elimination with this column
+                for (int r = c + 1; r < n; ++r) at(r, c) = T(0);
+                continue;
+            }
 
-        // Draw Components
-        for (const auto& c : components) {
-            drawComponent(svg, c);
+            const T* pr = tileRow(c, K);
+            for (int r = c + 1; r < n; ++r) {
+                T* rr = tileRow(r, K);
+                T l = rr[lc] / pr[lc];
+                rr[lc] = l; // Multiplier stored in place of the eliminated entry (L)
+                if (magSq(l) == 0.0) continue;
+                for (int k = lc + 1; k < c1 - c0; ++k) rr[k] = rr[k] - l * pr[k];
+            }
         }
+    }
 
-        // Draw Nodes (Dots)
-        for (const auto& p : nodes) {
-            bool used = false;
-            for(const auto& c : components) {
-                if(c.pA == p || c.pB == p) { used = true; break; }
-            }
-            if (used) {
-                int px = MARGIN + p.x * GRID_SIZE;
-                int py = MARGIN + p.y * GRID_SIZE;
-                svg << "<circle cx=\"" << px << "\" cy=\"" << py << "\" r=\"4\" class=\"node\" />" << std::endl;
-            }
+    // C -= A B on tiles
+    static void multiplySubtract(double* C, const double* A, const double* B, const SimdKernels& kernels) {
+        kernels.tileUpdate(C, A, B);
+    }
+
+    static void multiplySubtract(float* C, const float* A, const float* B, const SimdKernels& kernels) {
+        kernels.tileUpdateFloat(C, A, B);
+    }
+
+    static void multiplySubtract(Complex* C, const Complex* A, const Complex* B, const SimdKernels& kernels) {
+        multiplySubtractPlanes<double>(C, A, B, kernels.tileUpdate);
+    }
+
+    static void multiplySubtract(ComplexFloat* C, const ComplexFloat* A, const ComplexFloat* B,
+                                 const SimdKernels& kernels) {
+        multiplySubtractPlanes<float>(C, A, B, kernels.tileUpdateFloat);
+    }
+
+    // Three real products instead of four: with P1 = Re A Re B, P2 = Im A Im B and
+    // P3 = (Re A + Im A)(Re B + Im B), A B = (P1 - P2) + i (P3 - P1 - P2)
+    template <class F, class Z>
+    static void multiplySubtractPlanes(Z* C, const Z* A, const Z* B, void (*update)(F*, const F*, const F*)) {
+        const int S = TILE * TILE;
+        static thread_local std::vector<F, AlignedAllocator<F>> planes(9 * S);
+        F *aRe = planes.data(), *aIm = aRe + S, *aSum = aIm + S, *bRe = aSum + S, *bIm = bRe + S;
+        F *bSum = bIm + S, *p1 = bSum + S, *p2 = p1 + S, *p3 = p2 + S;
+        for (int k = 0; k < S; ++k) {
+            aRe[k] = A[k].real; aIm[k] = A[k].imag; aSum[k] = A[k].real + A[k].imag;
+            bRe[k] = B[k].real; bIm[k] = B[k].imag; bSum[k] = B[k].real + B[k].imag;
+            p1[k] = p2[k] = p3[k] = 0;
         }
-        
-        // Question text removed - shown in GUI instead
-        
-        svg << "</svg>" << std::endl;
-        svg.close();
-        std::cout << "Exported circuit to " << filename << std::endl;
+        update(p1, aRe, bRe); // The kernel subtracts: p = -P
+        update(p2, aIm, bIm);
+        update(p3, aSum, bSum);
+        for (int k = 0; k < S; ++k) C[k] = Z(C[k].real + (p1[k] - p2[k]), C[k].imag + (p3[k] - p1[k] - p2[k]));
     }
+};
 
-private:
-    void drawComponent(std::ofstream& svg, const Component& c) {
-        int x1 = MARGIN + c.pA.x * GRID_SIZE;
-        int y1 = MARGIN + c.pA.y * GRID_SIZE;
-        int x2 = MARGIN + c.pB.x * GRID_SIZE;
-        int y2 = MARGIN + c.pB.y * GRID_SIZE;
+// Systems from this size up are factored by BlockedLU. On full matrices it is ahead from
+// 256 unknowns (4x at 1024 on one core), but circuit matrices are mostly zeros, which the
+// unblocked elimination skips row by row, and there the two draw level around 512-1024.
+const int BLOCKED_LU_MIN_SIZE = 512;
 
-        int mx = (x1 + x2) / 2;
-        int my = (y1 + y2) / 2;
+inline std::vector<double> Matrix::solve(Matrix A, const std::vector<double>& b) {
+    if (A.rows >= BLOCKED_LU_MIN_SIZE) return BlockedLU<double>(A).solve(b);
+    return LUFactorization(std::move(A)).solve(b);
+}
 
-        // Check orientation
-        bool isHorizontal = (y1 == y2);
-        
-        if (c.type == WIRE) {
-            svg << "<line x1=\"" << x1 << "\" y1=\"" << y1 << "\" x2=\"" << x2 << "\" y2=\"" << y2 << "\" class=\"wire\" />" << std::endl;
-            return;
+inline std::vector<Complex> ComplexMatrix::solve(ComplexMatrix A, const std::vector<Complex>& b) {
+    if (A.rows >= BLOCKED_LU_MIN_SIZE) return BlockedLU<Complex>(A).solve(b);
+    return ComplexLUFactorization(std::move(A)).solve(b);
+}
+
+// --- Sparse Linear Algebra for Large Circuits ---
+
+// Backend used for the MNA systems built by solveMNA()/solveAC()
+enum LinearSolverKind {
+    SOLVER_AUTO,     // Dense elimination for small systems, banded LU from SPARSE_MIN_SIZE unknowns,
+                     // sparse LU from BANDED_MAX_SIZE, PCG for DC systems from ITERATIVE_MIN_SIZE
+    SOLVER_DENSE,
+    SOLVER_SPARSE,
+    SOLVER_ITERATIVE, // Multigrid PCG on the nodal form of DC systems (see solveNodalPCG), sparse LU otherwise
+    SOLVER_BANDED,    // Reverse Cuthill-McKee ordering and banded LU (see BandedLU)
+    SOLVER_NESTED,    // Sparse LU with geometric nested dissection ordering (see nestedDissectionOrdering)
+    SOLVER_BLOCKS     // Parts split at articulation points solved in parallel (see solveByBlocks), sparse LU otherwise
+};
+
+const int SPARSE_MIN_SIZE = 64;
+// RCM gives grid circuits a bandwidth of about 1.2x the grid width, so banded LU does
+// O(n^2) work against sparse LU's near-linear fill: it is ahead up to about 24x24 grids
+const int BANDED_MAX_SIZE = 1024;
+// Multigrid-preconditioned CG needs about 30 iterations at any grid size, so its O(n) cost
+// draws level with minimum degree sparse LU on 256x256 grids and wins from there (3x at 10^6 nodes)
+const int ITERATIVE_MIN_SIZE = 1 << 16;
+
+// DC factorizations a Circuit keeps for reuse, least recently used dropped first (see
+// Circuit::cachedFactorization)
+const int FACTORIZATION_CACHE_SIZE = 8;
+LinearSolverKind defaultSolverKind = SOLVER_AUTO; // Set once from the command line
+bool defaultMixedPrecision = false;                // Likewise (see solveMixedPrecision)
+bool exactAnswers = false;                         // Likewise: DC answers also as exact fractions
+bool niceExercises = false;                        // Likewise: DC exercises only with simple fractions (see isNice)
+
+// MNA system collected as (row, col, value) stamps. Duplicate stamps are summed on assembly.
+template <class T>
+struct MNASystem {
+    int n;
+    std::vector<int> rows, cols;
+    std::vector<T> vals;
+    std::vector<T> rhs;
+
+    explicit MNASystem(int size) : n(size), rhs(size, T(0)) {}
+
+    void reserve(size_t stamps) {
+        rows.reserve(stamps);
+        cols.reserve(stamps);
+        vals.reserve(stamps);
+    }
+
+    // Set by builders that compact the unknowns (see Circuit::compactNodes): the circuit's
+    // full layout has x[expand[k]] at position k, or 0 where expand[k] == -1.
+    // Empty when the system already uses the full layout.
+    std::vector<int> expand;
+
+    std::vector<T> expanded(const std::vector<T>& x) const {
+        if (expand.empty()) return x;
+        std::vector<T> full(expand.size(), T(0));
+        for (size_t k = 0; k < expand.size(); ++k) {
+            if (expand[k] >= 0) full[k] = x[expand[k]];
         }
+        return full;
+    }
 
-        // Clip the line in the middle specifically for symbol
-        // We want to draw a line from p1 to start of symbol, and end of symbol to p2
-        // Symbol size approx 30px
-        int gap = 15;
-        
-        int sx1, sy1, sx2, sy2; // Symbol Drawing Coordinates
-        if (isHorizontal) {
-            int dx = (x2 > x1) ? 1 : -1;
-            sx1 = mx - gap * dx; sy1 = my;
-            sx2 = mx + gap * dx; sy2 = my;
-            // Wires to symbol
-            svg << "<line x1=\"" << x1 << "\" y1=\"" << y1 << "\" x2=\"" << sx1 << "\" y2=\"" << sy1 << "\" class=\"wire\" />" << std::endl;
-            svg << "<line x1=\"" << sx2 << "\" y1=\"" << sy2 << "\" x2=\"" << x2 << "\" y2=\"" << y2 << "\" class=\"wire\" />" << std::endl;
-        } else {
-            int dy = (y2 > y1) ? 1 : -1;
-            sx1 = mx; sy1 = my - gap * dy;
-            sx2 = mx; sy2 = my + gap * dy;
-            // Wires to symbol
-            svg << "<line x1=\"" << x1 << "\" y1=\"" << y1 << "\" x2=\"" << sx1 << "\" y2=\"" << sy1 << "\" class=\"wire\" />" << std::endl;
-            svg << "<line x1=\"" << sx2 << "\" y1=\"" << sy2 << "\" x2=\"" << x2 << "\" y2=\"" << y2 << "\" class=\"wire\" />" << std::endl;
+    // Inverse of expanded(): a full-layout vector (e.g. a previous solution used as a
+    // starting guess) restricted to this system's unknowns
+    std::vector<T> compacted(const std::vector<T>& full) const {
+        if (expand.empty()) return full;
+        std::vector<T> x(n, T(0));
+        for (size_t k = 0; k < expand.size(); ++k) {
+            if (expand[k] >= 0) x[expand[k]] = full[k];
         }
+        return x;
+    }
 
-        // Draw Symbol
-        if (c.type == RESISTOR) {
-            // Choose color based on highlightRed flag
-            std::string color = c.highlightRed ? "red" : "black";
-            
-            // Zigzag
-            svg << "<path d=\"";
-            if (isHorizontal) {
-                 // 6 segments
-                 double step = (double)(sx2 - sx1) / 6.0;
-                 svg << "M " << sx1 << " " << sy1 << " ";
-                 for(int i=1; i<=6; i++) {
-                     double tx = sx1 + i * step;
-                     double ty = sy1 + ((i%2==0) ? -5 : 5) * ((i==6) ? 0 : 1); // Zigzag offset
-                     if (i==6) ty = sy2; // Snap to end
-                     svg << "L " << tx << " " << ty << " ";
-                 }
-            } else {
-                 double step = (double)(sy2 - sy1) / 6.0;
-                 svg << "M " << sx1 << " " << sy1 << " ";
-                 for(int i=1; i<=6; i++) {
-                     double ty = sy1 + i * step;
-                     double tx = sx1 + ((i%2==0) ? -5 : 5) * ((i==6) ? 0 : 1);
-                     if (i==6) tx = sx2;
-                     svg << "L " << tx << " " << ty << " ";
-                 }
+    // Set by the DC builder: the last `branches` unknowns are voltage-source currents, and
+    // their rows only hold the +1/-1 incidence of v_a - v_b = rhs (see NodalReduction)
+    int branches = 0;
+
+    void add(int r, int c, const T& v) {
+        rows.push_back(r);
+        cols.push_back(c);
+        vals.push_back(v);
+    }
+
+    // rhs - A x, straight from the stamps
+    std::vector<T> residual(const std::vector<T>& x) const {
+        std::vector<T> r(rhs);
+        for (size_t k = 0; k < vals.size(); ++k) r[rows[k]] = r[rows[k]] - vals[k] * x[cols[k]];
+        return r;
+    }
+};
+
+// Dense copy of an assembled system (for the small-system solvers)
+inline Matrix denseMatrix(const MNASystem<double>& sys) {
+    Matrix A(sys.n, sys.n);
+    for (size_t k = 0; k < sys.vals.size(); ++k) A.at(sys.rows[k], sys.cols[k]) += sys.vals[k];
+    return A;
+}
+
+inline ComplexMatrix denseMatrix(const MNASystem<Complex>& sys) {
+    ComplexMatrix A(sys.n, sys.n);
+    for (size_t k = 0; k < sys.vals.size(); ++k) A.add(sys.rows[k], sys.cols[k], sys.vals[k]);
+    return A;
+}
+
+// Compressed sparse column matrix (row indices sorted within each column)
+template <class T>
+struct SparseMatrix {
+    int n = 0;
+    std::vector<int> colPtr, rowIdx;
+    std::vector<T> vals;
+
+    // If slots is given, (*slots)[k] receives the position in vals that stamp k was summed
+    // into, so the same pattern can later be refilled with new values (see refill).
+    static SparseMatrix fromSystem(const MNASystem<T>& sys, std::vector<int>* slots = nullptr) {
+        int n = sys.n;
+        size_t nz = sys.vals.size();
+
+        // Bucket stamps by row first, then transpose: columns come out with sorted rows
+        std::vector<int> rowPtr(n + 1, 0);
+        for (size_t k = 0; k < nz; ++k) rowPtr[sys.rows[k] + 1]++;
+        for (int i = 0; i < n; ++i) rowPtr[i + 1] += rowPtr[i];
+        std::vector<int> rCols(nz), rStamp(slots ? nz : 0);
+        std::vector<T> rVals(nz);
+        std::vector<int> next(rowPtr.begin(), rowPtr.end() - 1);
+        for (size_t k = 0; k < nz; ++k) {
+            int p = next[sys.rows[k]]++;
+            rCols[p] = sys.cols[k];
+            rVals[p] = sys.vals[k];
+            if (slots) rStamp[p] = (int)k;
+        }
+
+        SparseMatrix A;
+        A.n = n;
+        A.colPtr.assign(n + 1, 0);
+        for (size_t k = 0; k < nz; ++k) A.colPtr[rCols[k] + 1]++;
+        for (int j = 0; j < n; ++j) A.colPtr[j + 1] += A.colPtr[j];
+        std::vector<int> cRows(nz), cStamp(slots ? nz : 0);
+        std::vector<T> cVals(nz);
+        next.assign(A.colPtr.begin(), A.colPtr.end() - 1);
+        for (int i = 0; i < n; ++i) {
+            for (int p = rowPtr[i]; p < rowPtr[i + 1]; ++p) {
+                int q = next[rCols[p]]++;
+                cRows[q] = i;
+                cVals[q] = rVals[p];
+                if (slots) cStamp[q] = rStamp[p];
             }
-            svg << "\" stroke=\"" << color << "\" stroke-width=\"2\" fill=\"none\" />" << std::endl;
-            
-            // Text Label
-            svg << "<text x=\"" << (mx + (isHorizontal ? 0 : 10)) << "\" y=\"" << (my + (isHorizontal ? -10 : 0)) << "\" class=\"text\">" << c.getValueLabel() << "</text>" << std::endl;
+        }
 
-        } else if (c.type == VOLTAGE_SOURCE) {
-            // Circle
-            svg << "<circle cx=\"" << mx << "\" cy=\"" << my << "\" r=\"" << gap << "\" class=\"wire\" />" << std::endl;
-            // Name label - use Value
-             svg << "<text x=\"" << (mx + (isHorizontal ? 0 : 15)) << "\" y=\"" << (my + (isHorizontal ? -15 : 0)) << "\" class=\"text\">" << c.getValueLabel() << "</text>" << std::endl;
-             
-             // + and - signs inside the circle, oriented towards nodes
-             if (isHorizontal) {
-                 int dir = (x1 < x2) ? -1 : 1;
-                 svg << "<text x=\"" << mx + (dir * 7) - 3 << "\" y=\"" << my + 4 << "\" font-size=\"12\" font-weight=\"bold\">+</text>";
-                 svg << "<text x=\"" << mx - (dir * 7) - 3 << "\" y=\"" << my + 4 << "\" font-size=\"12\" font-weight=\"bold\">-</text>";
-             } else {
-                 int dir = (y1 < y2) ? -1 : 1;
-                 svg << "<text x=\"" << mx - 3 << "\" y=\"" << my + (dir * 7) + 3 << "\" font-size=\"12\" font-weight=\"bold\">+</text>";
-                 svg << "<text x=\"" << mx - 3 << "\" y=\"" << my - (dir * 7) + 3 << "\" font-size=\"12\" font-weight=\"bold\">-</text>";
-             }
+        // Sum duplicates (adjacent after the transpose)
+        A.rowIdx.reserve(nz);
+        A.vals.reserve(nz);
+        if (slots) slots->assign(nz, -1);
+        int start = 0;
+        for (int j = 0; j < n; ++j) {
+            int end = A.colPtr[j + 1];
+            A.colPtr[j] = (int)A.rowIdx.size();
+            for (int p = start; p < end; ++p) {
+                if (p > start && cRows[p] == cRows[p - 1]) {
+                    A.vals.back() = A.vals.back() + cVals[p];
+                } else {
+                    A.rowIdx.push_back(cRows[p]);
+                    A.vals.push_back(cVals[p]);
+                }
+                if (slots) (*slots)[cStamp[p]] = (int)A.vals.size() - 1;
+            }
+            start = end;
+        }
+        A.colPtr[n] = (int)A.rowIdx.size();
+        return A;
+    }
 
-        } else if (c.type == CURRENT_SOURCE) {
-            svg << "<circle cx=\"" << mx << "\" cy=\"" << my << "\" r=\"" << gap << "\" class=\"wire\" />" << std::endl;
-             svg << "<text x=\"" << (mx + (isHorizontal ? 0 : 15)) << "\" y=\"" << (my + (isHorizontal ? -15 : 0)) << "\" class=\"text\">" << c.getValueLabel() << "</text>" << std::endl;
-            // Arrow (simple line)
-             if (isHorizontal) {
-                  svg << "<line x1=\"" << mx - 8 << "\" y1=\"" << my << "\" x2=\"" << mx + 8 << "\" y2=\"" << my << "\" class=\"wire\" />";
-                  svg << "<path d=\"M " << mx+4 << " " << my-4 << " L " << mx+8 << " " << my << " L " << mx+4 << " " << my+4 << "\" class=\"wire\" />";
-             } else {
-                  svg << "<line x1=\"" << mx << "\" y1=\"" << my - 8 << "\" x2=\"" << mx << "\" y2=\"" << my + 8 << "\" class=\"wire\" />";
-                  svg << "<path d=\"M " << mx-4 << " " << my+4 << " L " << mx << " " << my+8 << " L " << mx+4 << " " << my+4 << "\" class=\"wire\" />";
-             }
-        } else if (c.type == CAPACITOR) {
-            // Two parallel plates
-            // Gap is 15px. We need two lines separated by maybe 6px
-            int plateSep = 4;
-            int plateLen = 20;
+    // Replace the values, keeping the pattern: stamp k with value stampVals[k] is summed
+    // into vals[slots[k]] (slots from fromSystem on a system with the same stamps)
+    void refill(const std::vector<int>& slots, const std::vector<T>& stampVals) {
+        std::fill(vals.begin(), vals.end(), T(0));
+        for (size_t k = 0; k < slots.size(); ++k) vals[slots[k]] = vals[slots[k]] + stampVals[k];
+    }
 
-            if (isHorizontal) {
-                 // Lines at mx +/- plateSep
-                 // Vertical plates
-                 svg << "<line x1=\"" << mx - plateSep << "\" y1=\"" << my - plateLen/2 << "\" x2=\"" << mx - plateSep << "\" y2=\"" << my + plateLen/2 << "\" class=\"wire\" />";
-                 svg << "<line x1=\"" << mx + plateSep << "\" y1=\"" << my - plateLen/2 << "\" x2=\"" << mx + plateSep << "\" y2=\"" << my + plateLen/2 << "\" class=\"wire\" />";
-                 // Connecting wires
-                 svg << "<line x1=\"" << sx1 << "\" y1=\"" << sy1 << "\" x2=\"" << mx - plateSep << "\" y2=\"" << sy1 << "\" class=\"wire\" />";
-                 svg << "<line x1=\"" << sx2 << "\" y1=\"" << sy2 << "\" x2=\"" << mx + plateSep << "\" y2=\"" << sy2 << "\" class=\"wire\" />";
-            } else {
-                 // Lines at my +/- plateSep
-                 // Horizontal plates
-                 svg << "<line x1=\"" << mx - plateLen/2 << "\" y1=\"" << my - plateSep << "\" x2=\"" << mx + plateLen/2 << "\" y2=\"" << my - plateSep << "\" class=\"wire\" />";
-                 svg << "<line x1=\"" << mx - plateLen/2 << "\" y1=\"" << my + plateSep << "\" x2=\"" << mx + plateLen/2 << "\" y2=\"" << my + plateSep << "\" class=\"wire\" />";
-                 // Connecting wires
-                 svg << "<line x1=\"" << sx1 << "\" y1=\"" << sy1 << "\" x2=\"" << sx1 << "\" y2=\"" << my - plateSep << "\" class=\"wire\" />";
-                 svg << "<line x1=\"" << sx2 << "\" y1=\"" << sy2 << "\" x2=\"" << sx2 << "\" y2=\"" << my + plateSep << "\" class=\"wire\" />";
+    // Same pattern with the values converted to U (e.g. float for the mixed-precision solve)
+    template <class U>
+    SparseMatrix<U> converted() const {
+        SparseMatrix<U> B;
+        B.n = n;
+        B.colPtr = colPtr;
+        B.rowIdx = rowIdx;
+        B.vals.reserve(vals.size());
+        for (const T& v : vals) B.vals.push_back(U(v));
+        return B;
+    }
+
+    // Adjacency lists of the symmetrized pattern A + A^T (no self loops)
+    std::vector<std::vector<int>> symmetricAdjacency() const {
+        std::vector<std::vector<int>> adj(n);
+        for (int j = 0; j < n; ++j) {
+            for (int p = colPtr[j]; p < colPtr[j + 1]; ++p) {
+                int i = rowIdx[p];
+                if (i == j) continue;
+                adj[i].push_back(j);
+                adj[j].push_back(i);
             }
-             svg << "<text x=\"" << (mx + (isHorizontal ? 0 : 15)) << "\" y=\"" << (my + (isHorizontal ? -15 : 0)) << "\" class=\"text\">" << c.getValueLabel() << "</text>" << std::endl;
+        }
+        for (auto& a : adj) {
+            std::sort(a.begin(), a.end());
+            a.erase(std::unique(a.begin(), a.end()), a.end());
+        }
+        return adj;
+    }
+};
 
-        } else if (c.type == INDUCTOR) {
-            // Coils (Bumps)
-            int coilRadius = 5;
-            int numCoils = 4;
-            // Total length needed is roughly numCoils * 2 * radius
-            // We fit it between sx1 and sx2 (which is 2*gap = 30px)
-            // 4 coils * 10px = 40px might be too big. Let's do 3 coils aka 30px.
+// Fill-reducing approximate minimum degree ordering (AMD-style) on the pattern of A + A^T.
+// Works on the quotient graph: an eliminated node becomes an "element" holding the clique
+// of its neighbours instead of adding the clique edges explicitly, so memory stays O(nnz).
+// Degrees are the usual AMD upper bounds |A_i| + |L_p \ i| + sum |L_e \ L_p|.
+inline std::vector<int> minimumDegreeOrdering(std::vector<std::vector<int>> adj) {
+    int n = adj.size();
+    std::vector<int> order;
+    order.reserve(n);
 
-            svg << "<path d=\"M " << sx1 << " " << sy1 << " ";
-            
-            if (isHorizontal) {
-                // Determine step direction
-                int dx = (sx2 > sx1) ? 1 : -1;
-                // Draw arcs
-                double step = (double)(sx2 - sx1) / 3.0; // 3 coils
-                for(int i=0; i<3; i++) {
-                    double currX = sx1 + i * step;
-                    double nextX = sx1 + (i + 1) * step;
-                    // Cubic Bezier: control points up
-                    // q control end matches quadratic
-                    // svg arc: A rx ry rot large-arc-flag sweep-flag x y
-                    // Let's use simple Q for bump
-                    // Control point in middle-up
-                    double cx = (currX + nextX) / 2.0;
-                    double cy = sy1 - 10; // Bump up
-                    svg << "Q " << cx << " " << cy << " " << nextX << " " << sy1 << " ";
-                }
-            } else {
-                int dy = (sy2 > sy1) ? 1 : -1;
-                 double step = (double)(sy2 - sy1) / 3.0;
-                 for(int i=0; i<3; i++) {
-                    double currY = sy1 + i * step;
-                    double nextY = sy1 + (i + 1) * step;
-                    double cy = (currY + nextY) / 2.0;
-                    double cx = sx1 + 10; // Bump right
-                    svg << "Q " << cx << " " << cy << " " << sx1 << " " << nextY << " ";
-                 }
+    enum { VARIABLE, ELEMENT, ABSORBED };
+    std::vector<char> state(n, VARIABLE);
+    std::vector<std::vector<int>> elems(n);   // E_i: elements adjacent to variable i
+    std::vector<std::vector<int>> members(n); // L_e: variables of element e
+    std::vector<int> degree(n);
+    std::vector<int> mark(n, -1), wStamp(n, -1), w(n, 0);
+
+    typedef std::pair<int, int> Entry; // (degree, node), stale entries skipped lazily
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+    for (int i = 0; i < n; ++i) {
+        degree[i] = adj[i].size();
+        heap.push({degree[i], i});
+    }
+
+    for (int k = 0; k < n && !heap.empty(); ) {
+        Entry e = heap.top();
+        heap.pop();
+        int p = e.second;
+        if (state[p] != VARIABLE || e.first != degree[p]) continue;
+
+        // L_p = (A_p U members of adjacent elements) \ {p}; adjacent elements are absorbed
+        std::vector<int> Lp;
+        mark[p] = k;
+        for (int j : adj[p]) {
+            if (state[j] == VARIABLE && mark[j] != k) { mark[j] = k; Lp.push_back(j); }
+        }
+        for (int el : elems[p]) {
+            if (state[el] != ELEMENT) continue;
+            for (int j : members[el]) {
+                if (state[j] == VARIABLE && mark[j] != k) { mark[j] = k; Lp.push_back(j); }
             }
-            svg << "\" class=\"wire\" />" << std::endl;
-             svg << "<text x=\"" << (mx + (isHorizontal ? 0 : 15)) << "\" y=\"" << (my + (isHorizontal ? -15 : 0)) << "\" class=\"text\">" << c.getValueLabel() << "</text>" << std::endl;
-        
-        } else if (c.type == SWITCH) {
-            // Refined Switch Drawing
-            // Gap is between sx1 and sx2.
-            
-            // 1. Terminals (Dots)
-            svg << "<circle cx=\"" << sx1 << "\" cy=\"" << sy1 << "\" r=\"2.5\" class=\"node\" />" << std::endl;
-            svg << "<circle cx=\"" << sx2 << "\" cy=\"" << sy2 << "\" r=\"2.5\" class=\"node\" />" << std::endl;
-            
-            // 2. Lever Geometry
-            double leverLen = sqrt(pow(sx2-sx1,2) + pow(sy2-sy1,2)); // Distance
-            // Base at sx1.
-            
-            double baseAngle = atan2(sy2-sy1, sx2-sx1); // Angle of the wire line
-            
-            double openAngleOffset = -0.6; // ~35 degrees counter-clock-wise
-            
-            double tipX, tipY;
-            
-            if (c.startsOpen) {
-                // Draw Open Lever
-                tipX = sx1 + leverLen * cos(baseAngle + openAngleOffset);
-                tipY = sy1 + leverLen * sin(baseAngle + openAngleOffset);
-                
-                svg << "<line x1=\"" << sx1 << "\" y1=\"" << sy1 << "\" x2=\"" << tipX << "\" y2=\"" << tipY << "\" style=\"stroke:black; stroke-width:2;\" />" << std::endl;
+            state[el] = ABSORBED;
+            std::vector<int>().swap(members[el]);
+        }
+        state[p] = ELEMENT;
+        order.push_back(p);
+        std::vector<int>().swap(adj[p]);
+        std::vector<int>().swap(elems[p]);
 
-            } else {
-                // Draw Closed Lever
-                svg << "<line x1=\"" << sx1 << "\" y1=\"" << sy1 << "\" x2=\"" << sx2 << "\" y2=\"" << sy2 << "\" style=\"stroke:black; stroke-width:2;\" />" << std::endl;
+        // w[e] = |L_e \ L_p| for every live element touching L_p
+        for (int i : Lp) {
+            for (int el : elems[i]) {
+                if (state[el] != ELEMENT) continue;
+                if (wStamp[el] != k) { wStamp[el] = k; w[el] = members[el].size(); }
+                w[el]--;
             }
-            
-            // Label "t=0 Opening/Closing"
-            std::string label = c.startsOpen ? "t=0 Closing" : "t=0 Opening";
-            
-            // Position it above/below mid point
-            double mx_lab = (sx1 + sx2)/2;
-            double my_lab = (sy1 + sy2)/2;
-            
-            // Shift based on orientation/state to avoid overlap
-            if (isHorizontal) {
-                my_lab -= 20; 
+        }
+
+        int remaining = n - k - 1;
+        for (int i : Lp) {
+            // Drop absorbed elements (and those now covered by p), then link i to p
+            int ext = 0;
+            std::vector<int>& Ei = elems[i];
+            size_t out = 0;
+            for (int el : Ei) {
+                if (state[el] != ELEMENT) continue;
+                if (w[el] == 0) { state[el] = ABSORBED; std::vector<int>().swap(members[el]); continue; }
+                Ei[out++] = el;
+                ext += w[el];
+            }
+            Ei.resize(out);
+            Ei.push_back(p);
+
+            // Edges inside L_p are represented by element p from now on
+            std::vector<int>& Ai = adj[i];
+            out = 0;
+            for (int j : Ai) {
+                if (state[j] == VARIABLE && mark[j] != k) Ai[out++] = j;
+            }
+            Ai.resize(out);
+
+            int d = (int)Ai.size() + (int)Lp.size() - 1 + ext;
+            d = std::max(0, std::min(d, remaining - 1));
+            degree[i] = d;
+            heap.push({d, i});
+        }
+        members[p].swap(Lp);
+        k++;
+    }
+    return order;
+}
+
+// Reverse Cuthill-McKee ordering on the pattern of A + A^T: breadth-first from a
+// pseudo-peripheral node of each connected component, visiting neighbours by increasing
+// degree, then reversed. Adjacent nodes end up at nearby positions, so the reordered
+// matrix is banded (about the grid width for grid circuits) and BandedLU applies.
+inline std::vector<int> reverseCuthillMcKee(const std::vector<std::vector<int>>& adj) {
+    int n = adj.size();
+    std::vector<int> order;
+    order.reserve(n);
+    std::vector<char> placed(n, 0);
+    std::vector<int> seen(n, -1), level(n, 0), queue;
+    queue.reserve(n);
+    int search = 0;
+
+    // Breadth-first levels from root; returns the height and a minimum degree node of the last level
+    auto levels = [&](int root, int& far) {
+        queue.clear();
+        queue.push_back(root);
+        seen[root] = search;
+        level[root] = 0;
+        for (size_t h = 0; h < queue.size(); ++h) {
+            int u = queue[h];
+            for (int v : adj[u]) {
+                if (seen[v] == search) continue;
+                seen[v] = search;
+                level[v] = level[u] + 1;
+                queue.push_back(v);
+            }
+        }
+        int height = level[queue.back()];
+        far = queue.back();
+        for (int u : queue) {
+            if (level[u] == height && adj[u].size() < adj[far].size()) far = u;
+        }
+        search++;
+        return height;
+    };
+
+    for (int s = 0; s < n; ++s) {
+        if (placed[s]) continue;
+        int root = s, far = s;
+        int height = levels(root, far);
+        for (int tries = 0; tries < 8; ++tries) { // George-Liu pseudo-peripheral node search
+            int next;
+            int h = levels(far, next);
+            if (h <= height) break;
+            root = far;
+            height = h;
+            far = next;
+        }
+
+        size_t head = order.size();
+        order.push_back(root);
+        placed[root] = 1;
+        std::vector<int> nbrs;
+        for (; head < order.size(); ++head) {
+            nbrs.clear();
+            for (int v : adj[order[head]]) {
+                if (!placed[v]) { placed[v] = 1; nbrs.push_back(v); }
+            }
+            std::sort(nbrs.begin(), nbrs.end(), [&](int a, int b) {
+                return adj[a].size() != adj[b].size() ? adj[a].size() < adj[b].size() : a < b;
+            });
+            order.insert(order.end(), nbrs.begin(), nbrs.end());
+        }
+    }
+    std::reverse(order.begin(), order.end());
+    return order;
+}
+
+// Nested dissection ordering on the pattern of A + A^T: split the graph into two halves and
+// a separator, order each half recursively and the separator last, so eliminating one half
+// never fills into the other (O(n log n) fill on 2D grids). With coordinates, each split
+// cuts the longer side of the bounding box at the median; without them (or when all points
+// coincide) a breadth-first level structure from a pseudo-peripheral node is cut at the
+// level holding the median node. The separator is made of the nodes of one half that have a
+// neighbour in the other, so it is valid for any graph: merged shorts and branch unknowns
+// can join grid points that are not adjacent.
+inline std::vector<int> nestedDissectionOrdering(const std::vector<std::vector<int>>& adj,
+                                                 const std::vector<Point>* coords = nullptr) {
+    const size_t LEAF_SIZE = 256; // Subgraphs this small are ordered by minimum degree
+    int n = adj.size();
+    std::vector<int> order;
+    order.reserve(n);
+    std::vector<int> inSet(n, -1), seen(n, -1), level(n, 0), side(n, 0);
+    int stamp = 0, search = 0;
+
+    // Level structure of the subset from root (marked with stamp); returns the visit order
+    auto bfs = [&](int root, int id, std::vector<int>& visit) {
+        visit.clear();
+        visit.push_back(root);
+        seen[root] = search;
+        level[root] = 0;
+        for (size_t h = 0; h < visit.size(); ++h) {
+            int u = visit[h];
+            for (int v : adj[u]) {
+                if (inSet[v] != id || seen[v] == search) continue;
+                seen[v] = search;
+                level[v] = level[u] + 1;
+                visit.push_back(v);
+            }
+        }
+        search++;
+    };
+
+    // Leaves are ordered by minimum degree on their induced subgraph
+    std::vector<int> local(n, -1);
+    auto leaf = [&](const std::vector<int>& nodes) {
+        std::vector<std::vector<int>> sub(nodes.size());
+        for (size_t i = 0; i < nodes.size(); ++i) local[nodes[i]] = i;
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            for (int u : adj[nodes[i]]) {
+                if (local[u] >= 0) sub[i].push_back(local[u]);
+            }
+        }
+        for (int v : nodes) local[v] = -1;
+        for (int i : minimumDegreeOrdering(std::move(sub))) order.push_back(nodes[i]);
+    };
+
+    std::function<void(std::vector<int>&)> dissect = [&](std::vector<int>& nodes) {
+        if (nodes.size() <= LEAF_SIZE) {
+            leaf(nodes);
+            return;
+        }
+        int id = stamp++;
+        for (int v : nodes) inSet[v] = id;
+
+        bool split = false;
+        if (coords) {
+            int x0 = (*coords)[nodes[0]].x, x1 = x0, y0 = (*coords)[nodes[0]].y, y1 = y0;
+            for (int v : nodes) {
+                x0 = std::min(x0, (*coords)[v].x); x1 = std::max(x1, (*coords)[v].x);
+                y0 = std::min(y0, (*coords)[v].y); y1 = std::max(y1, (*coords)[v].y);
+            }
+            bool alongX = (x1 - x0) >= (y1 - y0);
+            auto key = [&](int v) { return alongX ? (*coords)[v].x : (*coords)[v].y; };
+            std::vector<int> keys;
+            keys.reserve(nodes.size());
+            for (int v : nodes) keys.push_back(key(v));
+            std::nth_element(keys.begin(), keys.begin() + keys.size() / 2, keys.end());
+            int median = keys[keys.size() / 2];
+            if (median > (alongX ? x0 : y0)) {
+                for (int v : nodes) side[v] = key(v) < median ? 0 : 1;
+                // Separator: nodes of the upper half with a neighbour in the lower half
+                for (int v : nodes) {
+                    if (side[v] != 1) continue;
+                    for (int u : adj[v]) {
+                        if (inSet[u] == id && side[u] == 0) { side[v] = 2; break; }
+                    }
+                }
+                split = true;
+            }
+        }
+        if (!split) {
+            std::vector<int> visit;
+            int root = nodes[0];
+            bfs(root, id, visit);
+            for (int tries = 0; tries < 4; ++tries) { // Pseudo-peripheral root
+                int far = visit.back();
+                std::vector<int> next;
+                bfs(far, id, next);
+                if (level[next.back()] <= level[visit.back()]) { bfs(root, id, visit); break; }
+                root = far;
+                visit.swap(next);
+            }
+            if (visit.size() < nodes.size()) {
+                // Disconnected: the reached component against the rest, no separator needed
+                for (int v : nodes) side[v] = 1;
+                for (int v : visit) side[v] = 0;
             } else {
-                mx_lab += 25; 
+                int mid = std::max(1, level[visit[visit.size() / 2]]);
+                for (int v : visit) side[v] = level[v] < mid ? 0 : (level[v] == mid ? 2 : 1);
+            }
+        }
+
+        std::vector<int> parts[3];
+        for (int v : nodes) parts[side[v]].push_back(v);
+        if (parts[0].empty() || parts[1].empty()) {
+            // No useful split (e.g. a clique-like block): take the subset as a leaf
+            leaf(nodes);
+            return;
+        }
+        std::vector<int>().swap(nodes);
+        dissect(parts[0]);
+        dissect(parts[1]);
+        order.insert(order.end(), parts[2].begin(), parts[2].end());
+    };
+
+    std::vector<int> all(n);
+    for (int i = 0; i < n; ++i) all[i] = i;
+    dissect(all);
+    return order;
+}
+
+// Left-looking sparse LU (Gilbert-Peierls) with threshold partial pivoting: P A Q = L U.
+// Q is the fill-reducing column order; rows are pivoted as columns are factored, preferring
+// the diagonal so the symmetric ordering keeps its fill estimate. Like the dense solvers,
+// a column without a usable pivot is treated as singular and its unknown is set to 0.
+template <class T>
+class SparseLU {
+public:
+    int n = 0;
+    std::vector<int> colOrder;          // Q: k-th pivot column
+    std::vector<int> pivotRow;          // P: original row of the k-th pivot (-1 if singular)
+    std::vector<int> Lp, Li, Up, Ui;    // L: original row indices (unit diagonal implicit), U: pivot indices
+    std::vector<T> Lx, Ux, Udiag;
+    int singularCount = 0;
+
+    bool factor(const SparseMatrix<T>& A, const std::vector<int>& order, double pivotTol = 0.1) {
+        n = A.n;
+        colOrder = order;
+        pivotRow.assign(n, -1);
+        Lp.assign(1, 0); Up.assign(1, 0);
+        Li.clear(); Lx.clear(); Ui.clear(); Ux.clear();
+        Udiag.assign(n, T(0));
+        singularCount = 0;
+        Li.reserve(4 * A.rowIdx.size()); Lx.reserve(4 * A.rowIdx.size());
+        Ui.reserve(4 * A.rowIdx.size()); Ux.reserve(4 * A.rowIdx.size());
+
+        std::vector<int> pinv(n, -1);
+        std::vector<T> x(n, T(0));
+        std::vector<int> stack(n), pstack(n), reach(n);
+        std::vector<int> mark(n, -1);
+        double tolSq = singularTolSq(T(0));
+
+        for (int k = 0; k < n; ++k) {
+            int col = colOrder[k];
+
+            // Pattern of L \ A(:,col): DFS from the column's rows through the L columns built so far
+            int top = n;
+            for (int p = A.colPtr[col]; p < A.colPtr[col + 1]; ++p) {
+                int start = A.rowIdx[p];
+                if (mark[start] == k) continue;
+                int head = 0;
+                stack[0] = start;
+                while (head >= 0) {
+                    int i = stack[head];
+                    int j = pinv[i];
+                    if (mark[i] != k) {
+                        mark[i] = k;
+                        pstack[head] = (j < 0) ? 0 : Lp[j];
+                    }
+                    bool done = true;
+                    if (j >= 0) {
+                        int end = Lp[j + 1];
+                        for (int q = pstack[head]; q < end; ++q) {
+                            int r = Li[q];
+                            if (mark[r] == k) continue;
+                            pstack[head] = q + 1;
+                            stack[++head] = r;
+                            done = false;
+                            break;
+                        }
+                    }
+                    if (done) {
+                        head--;
+                        reach[--top] = i;
+                    }
+                }
+            }
+
+            // Numeric sparse triangular solve in topological order
+            for (int p = top; p < n; ++p) x[reach[p]] = T(0);
+            for (int p = A.colPtr[col]; p < A.colPtr[col + 1]; ++p) x[A.rowIdx[p]] = x[A.rowIdx[p]] + A.vals[p];
+            for (int p = top; p < n; ++p) {
+                int i = reach[p];
+                int j = pinv[i];
+                if (j < 0) continue;
+                T xi = x[i];
+                for (int q = Lp[j]; q < Lp[j + 1]; ++q) x[Li[q]] = x[Li[q]] - Lx[q] * xi;
+            }
+
+            // Split into U (already pivoted rows) and pivot candidates
+            int ipiv = -1;
+            double best = -1.0;
+            for (int p = top; p < n; ++p) {
+                int i = reach[p];
+                if (pinv[i] < 0) {
+                    double m = magSq(x[i]);
+                    if (m > best) { best = m; ipiv = i; }
+                } else {
+                    Ui.push_back(pinv[i]);
+                    Ux.push_back(x[i]);
+                }
+            }
+            if (ipiv >= 0 && pinv[col] < 0 && mark[col] == k && magSq(x[col]) >= pivotTol * pivotTol * best) {
+                ipiv = col;
+            }
+
+            if (ipiv < 0 || best < tolSq) {
+                singularCount++;
+            } else {
+                T pivot = x[ipiv];
+                Udiag[k] = pivot;
+                pivotRow[k] = ipiv;
+                pinv[ipiv] = k;
+                for (int p = top; p < n; ++p) {
+                    int i = reach[p];
+                    if (pinv[i] < 0) {
+                        Li.push_back(i);
+                        Lx.push_back(x[i] / pivot);
+                    }
+                }
+            }
+            Lp.push_back((int)Li.size());
+            Up.push_back((int)Ui.size());
+        }
+        return singularCount == 0;
+    }
+
+    std::vector<T> solve(const std::vector<T>& b) const {
+        // Forward: L y = P b, carried out on original row indices
+        std::vector<T> x(b);
+        std::vector<T> y(n, T(0));
+        for (int k = 0; k < n; ++k) {
+            int r = pivotRow[k];
+            if (r < 0) continue;
+            T yk = x[r];
+            y[k] = yk;
+            for (int q = Lp[k]; q < Lp[k + 1]; ++q) x[Li[q]] = x[Li[q]] - Lx[q] * yk;
+        }
+        // Backward: U z = y, then undo the column order
+        std::vector<T> result(n, T(0));
+        for (int k = n - 1; k >= 0; --k) {
+            if (pivotRow[k] < 0) continue; // Singular column -> unknown stays 0
+            T zk = y[k] / Udiag[k];
+            result[colOrder[k]] = zk;
+            for (int q = Up[k]; q < Up[k + 1]; ++q) y[Ui[q]] = y[Ui[q]] - Ux[q] * zk;
+        }
+        return result;
+    }
+
+    size_t factorNonZeros() const { return Li.size() + Ui.size() + n; }
+};
+
+// Assemble, order and factor: the sparse backend behind solveMNA()/solveAC(). Given the
+// positions of the unknowns, nested dissection replaces minimum degree as the ordering.
+template <class T>
+std::vector<T> solveSparseSystem(const MNASystem<T>& sys, const std::vector<Point>* coords = nullptr) {
+    SparseMatrix<T> A = SparseMatrix<T>::fromSystem(sys);
+    SparseLU<T> lu;
+    lu.factor(A, coords ? nestedDissectionOrdering(A.symmetricAdjacency(), coords)
+                        : minimumDegreeOrdering(A.symmetricAdjacency()));
+    return lu.solve(sys.rhs);
+}
+
+// --- Mixed precision: single-precision factor, double-precision refinement ---
+
+template <class T> struct SinglePrecision;
+template <> struct SinglePrecision<double> { typedef float type; };
+template <> struct SinglePrecision<Complex> { typedef ComplexFloat type; };
+
+inline double widen(float v) { return v; }
+inline Complex widen(const ComplexFloat& z) { return Complex(z.real, z.imag); }
+
+struct RefinementStats {
+    int iterations = 0;         // Single-precision solves, the first one included
+    double backwardError = 0.0; // Final ||b - Ax|| / (||A|| ||x||), infinity norms
+    bool converged = false;
+};
+
+// Correction steps before giving up, as in LAPACK's dsgesv
+const int REFINE_MAX_ITERATIONS = 30;
+
+// Refine x (initially 0) to double-precision accuracy with a single-precision factor of A:
+// x += LU^-1 (b - A x), with the residual computed from the double matrix. Stops when
+// ||b - Ax|| <= ||A|| ||x|| eps sqrt(n), the test of LAPACK's dsgesv, i.e. as accurate as a
+// double LU. Returns false when that is not reached: the error only shrinks by about
+// cond(A) * 6e-8 per step, so badly conditioned systems (cond(A) >~ 1e7) stall, and so do
+// singular ones, whose double solution sets free unknowns to 0.
+// ||A|| is bounded by the row sums of the stamp magnitudes.
+template <class T, class Factor>
+bool refineSolution(const MNASystem<T>& sys, const Factor& lu, std::vector<T>& x, RefinementStats& st) {
+    typedef typename SinglePrecision<T>::type Low;
+    int n = sys.n;
+    std::vector<double> rowSum(n, 0.0);
+    for (size_t k = 0; k < sys.vals.size(); ++k) rowSum[sys.rows[k]] += std::sqrt(magSq(sys.vals[k]));
+    double normA = n > 0 ? *std::max_element(rowSum.begin(), rowSum.end()) : 0.0;
+    double tol = normA * std::numeric_limits<double>::epsilon() * 0.5 * std::sqrt((double)n);
+
+    st = RefinementStats();
+    x.assign(n, T(0));
+    std::vector<T> r(sys.rhs);
+    std::vector<Low> rLow(n);
+    double prevNorm = std::numeric_limits<double>::infinity();
+    while (st.iterations < REFINE_MAX_ITERATIONS) {
+        for (int i = 0; i < n; ++i) rLow[i] = Low(r[i]);
+        std::vector<Low> d = lu.solve(rLow);
+        for (int i = 0; i < n; ++i) x[i] = x[i] + widen(d[i]);
+        st.iterations++;
+
+        r = sys.residual(x);
+        double rNorm = 0.0, xNorm = 0.0;
+        for (int i = 0; i < n; ++i) {
+            rNorm = std::max(rNorm, magSq(r[i]));
+            xNorm = std::max(xNorm, magSq(x[i]));
+        }
+        rNorm = std::sqrt(rNorm);
+        xNorm = std::sqrt(xNorm);
+        if (!std::isfinite(rNorm)) break;
+        st.backwardError = normA * xNorm > 0.0 ? rNorm / (normA * xNorm) : rNorm;
+        if (rNorm <= tol * xNorm) {
+            st.converged = true;
+            break;
+        }
+        if (rNorm > 0.5 * prevNorm) break; // Stalled
+        prevNorm = rNorm;
+    }
+    return st.converged;
+}
+
+// Mixed-precision solve: factor in single precision (float or ComplexFloat), then refine
+// in double (see refineSolution). The dense factor is BlockedLU, whose tile kernels do
+// twice the lanes per instruction in float; the sparse one is SparseLU with minimum degree
+// ordering, whose factor takes half the memory. Returns false when refinement fails and
+// the caller should fall back to the double factorization.
+template <class T>
+bool solveMixedPrecision(const MNASystem<T>& sys, std::vector<T>& x, bool dense,
+                         RefinementStats* stats = nullptr) {
+    typedef typename SinglePrecision<T>::type Low;
+    RefinementStats local;
+    RefinementStats& st = stats ? *stats : local;
+    if (dense) return refineSolution(sys, BlockedLU<Low>(denseMatrix(sys)), x, st);
+    SparseMatrix<T> A = SparseMatrix<T>::fromSystem(sys);
+    SparseLU<Low> lu;
+    lu.factor(A.template converted<Low>(), minimumDegreeOrdering(A.symmetricAdjacency()));
+    return refineSolution(sys, lu, x, st);
+}
+
+// Banded LU with partial pivoting (LAPACK gbtrf layout) of the symmetrically reordered
+// matrix B = A(order, order). With lower/upper bandwidths kl/ku, row swaps widen U to
+// ku + kl, so the factor takes (2 kl + ku + 1) n values and O(n kl (ku + kl)) work.
+// As in the other solvers, a column without a usable pivot is singular and its unknown is 0.
+template <class T>
+class BandedLU {
+public:
+    int n = 0, kl = 0, ku = 0;
+    int singularCount = 0;
+
+    bool factor(const SparseMatrix<T>& A, const std::vector<int>& ordering) {
+        n = A.n;
+        order = ordering;
+        std::vector<int> pos(n);
+        for (int k = 0; k < n; ++k) pos[order[k]] = k;
+        kl = ku = 0;
+        for (int j = 0; j < n; ++j) {
+            for (int p = A.colPtr[j]; p < A.colPtr[j + 1]; ++p) {
+                int d = pos[A.rowIdx[p]] - pos[j];
+                kl = std::max(kl, d);
+                ku = std::max(ku, -d);
+            }
+        }
+        ldab = 2 * kl + ku + 1;
+        band.assign((size_t)ldab * n, T(0));
+        for (int j = 0; j < n; ++j) {
+            for (int p = A.colPtr[j]; p < A.colPtr[j + 1]; ++p) at(pos[A.rowIdx[p]], pos[j]) = A.vals[p];
+        }
+
+        ipiv.assign(n, 0);
+        singularCount = 0;
+        double tolSq = singularTolSq(T(0));
+        int ju = 0; // Last column reached by U so far
+        for (int j = 0; j < n; ++j) {
+            int km = std::min(kl, n - 1 - j);
+            T* col = &at(j, j);
+            int p = 0;
+            double best = magSq(col[0]);
+            for (int t = 1; t <= km; ++t) {
+                double m = magSq(col[t]);
+                if (m > best) { best = m; p = t; }
+            }
+            if (best < tolSq) {
+                // Singular or nearly singular: no elimination with this column
+                for (int t = 1; t <= km; ++t) col[t] = T(0);
+                ipiv[j] = j;
+                singularCount++;
+                continue;
+            }
+            ipiv[j] = j + p;
+
+            ju = std::max(ju, std::min(j + ku + p, n - 1));
+            if (p != 0) {
+                for (int c = j; c <= ju; ++c) std::swap(at(j, c), at(j + p, c));
+            }
+            T pivot = col[0];
+            for (int t = 1; t <= km; ++t) col[t] = col[t] / pivot;
+            for (int c = j + 1; c <= ju; ++c) {
+                T ujc = at(j, c);
+                if (magSq(ujc) == 0.0) continue;
+                T* dst = &at(j + 1, c);
+                for (int t = 1; t <= km; ++t) dst[t - 1] = dst[t - 1] - col[t] * ujc;
+            }
+        }
+        return singularCount == 0;
+    }
+
+    std::vector<T> solve(const std::vector<T>& b) const {
+        std::vector<T> y(n);
+        for (int k = 0; k < n; ++k) y[k] = b[order[k]];
+        for (int j = 0; j < n; ++j) { // L, with the row swaps in factorization order
+            if (ipiv[j] != j) std::swap(y[j], y[ipiv[j]]);
+            int km = std::min(kl, n - 1 - j);
+            const T* col = &at(j, j);
+            for (int t = 1; t <= km; ++t) y[j + t] = y[j + t] - col[t] * y[j];
+        }
+        double tolSq = singularTolSq(T(0));
+        int kv = ku + kl;
+        for (int j = n - 1; j >= 0; --j) { // U
+            T ujj = at(j, j);
+            if (magSq(ujj) < tolSq) { y[j] = T(0); continue; } // Singular column -> unknown stays 0
+            y[j] = y[j] / ujj;
+            for (int i = std::max(0, j - kv); i < j; ++i) y[i] = y[i] - at(i, j) * y[j];
+        }
+        std::vector<T> x(n);
+        for (int k = 0; k < n; ++k) x[order[k]] = y[k];
+        return x;
+    }
+
+    size_t storage() const { return band.size(); }
+
+private:
+    std::vector<int> order; // order[k]: original unknown at position k
+    std::vector<int> ipiv;  // Row swapped with row j at step j
+    std::vector<T> band;    // Column j holds rows j - ku - kl .. j + kl
+    int ldab = 0;
+
+    T& at(int i, int j) { return band[(size_t)j * ldab + kl + ku + i - j]; }
+    const T& at(int i, int j) const { return band[(size_t)j * ldab + kl + ku + i - j]; }
+};
+
+// Banded backend: reverse Cuthill-McKee ordering, then BandedLU
+template <class T>
+std::vector<T> solveBandedSystem(const MNASystem<T>& sys) {
+    SparseMatrix<T> A = SparseMatrix<T>::fromSystem(sys);
+    BandedLU<T> lu;
+    lu.factor(A, reverseCuthillMcKee(A.symmetricAdjacency()));
+    return lu.solve(sys.rhs);
+}
+
+// --- Block Decomposition at Articulation Points ---
+
+// Parts of at least this many unknowns are split off at articulation points (solveByBlocks)
+const int BLOCK_MIN_PART = 1024;
+
+// Split the graph of A + A^T into parts joined only through a separator of articulation
+// points (cut vertices): part[v] is the part of v, or -1 for separator vertices, and the
+// number of parts is returned. Tarjan's DFS: a non-root vertex v cuts off the subtree of its
+// child c exactly when low[c] >= disc[v]. Bottom-up, each subtree carries the vertices still
+// attached to it; once the subtrees that v cuts off hold minPart vertices, v joins the
+// separator and they are detached. The components left are packed into parts of at least
+// minPart vertices (the last one may be smaller).
+inline int partitionAtArticulations(const std::vector<std::vector<int>>& adj, int minPart, std::vector<int>& part) {
+    int n = adj.size();
+    std::vector<int> disc(n, -1), low(n, 0), parent(n, -1), edge(n, 0);
+    std::vector<long long> attached(n, 0), detached(n, 0); // Child subtree weights kept / cut off at v
+    std::vector<char> separator(n, 0);
+    std::vector<int> stack;
+    int time = 0;
+    for (int root = 0; root < n; ++root) {
+        if (disc[root] >= 0) continue;
+        stack.push_back(root);
+        disc[root] = low[root] = time++;
+        while (!stack.empty()) {
+            int v = stack.back();
+            if (edge[v] < (int)adj[v].size()) {
+                int u = adj[v][edge[v]++];
+                if (disc[u] < 0) {
+                    parent[u] = v;
+                    disc[u] = low[u] = time++;
+                    stack.push_back(u);
+                } else if (u != parent[v]) {
+                    low[v] = std::min(low[v], disc[u]);
+                }
+                continue;
+            }
+            stack.pop_back();
+            long long weight = attached[v];
+            if (v != root && detached[v] >= minPart) {
+                separator[v] = 1;
+            } else {
+                weight += 1 + detached[v];
+            }
+            int p = parent[v];
+            if (p >= 0) {
+                low[p] = std::min(low[p], low[v]);
+                (low[v] >= disc[p] ? detached[p] : attached[p]) += weight;
+            }
+        }
+    }
+
+    part.assign(n, -1);
+    std::vector<int> queue;
+    int parts = 0;
+    long long filled = 0;
+    for (int s = 0; s < n; ++s) {
+        if (separator[s] || part[s] >= 0) continue;
+        if (parts == 0 || filled >= minPart) {
+            parts++;
+            filled = 0;
+        }
+        queue.assign(1, s);
+        part[s] = parts - 1;
+        for (size_t h = 0; h < queue.size(); ++h) {
+            for (int u : adj[queue[h]]) {
+                if (separator[u] || part[u] >= 0) continue;
+                part[u] = parts - 1;
+                queue.push_back(u);
+            }
+        }
+        filled += queue.size();
+    }
+    return parts;
+}
+
+struct BlockStats {
+    int parts = 0;
+    int separator = 0;   // Unknowns of the coupling (Schur complement) system
+    int largestPart = 0;
+};
+
+// Solve by parts (see partitionAtArticulations): with the separator unknowns S last,
+// A = [A_pp 0 A_pS; 0 A_qq A_qS; A_Sp A_Sq A_SS]. Every part is factored on its own, in
+// parallel, and yields y_p = A_pp^-1 b_p and Z_p = A_pp^-1 A_pS for the few separator
+// columns it touches. The coupling system (A_SS - sum A_Sp Z_p) x_S = b_S - sum A_Sp y_p
+// is then solved, and x_p = y_p - Z_p x_S. Returns false, for the caller to solve the whole
+// system instead, when there are fewer than two parts or a part or the coupling system is
+// singular (singular columns would not pick the same free unknowns as one LU).
+template <class T>
+bool solveByBlocks(const MNASystem<T>& sys, std::vector<T>& x, BlockStats* stats = nullptr,
+                   ThreadPool& pool = sharedThreadPool()) {
+    int n = sys.n;
+    std::vector<int> part;
+    int parts = partitionAtArticulations(SparseMatrix<T>::fromSystem(sys).symmetricAdjacency(), BLOCK_MIN_PART, part);
+    if (parts < 2) return false;
+
+    std::vector<int> local(n, -1), sepIndex(n, -1), sepUnknowns;
+    std::vector<std::vector<int>> members(parts);
+    for (int i = 0; i < n; ++i) {
+        if (part[i] < 0) {
+            sepIndex[i] = sepUnknowns.size();
+            sepUnknowns.push_back(i);
+        } else {
+            local[i] = members[part[i]].size();
+            members[part[i]].push_back(i);
+        }
+    }
+    int ns = sepUnknowns.size();
+
+    struct Coupling { int local, sep; T val; };
+    struct Block {
+        MNASystem<T> sys;
+        std::vector<Coupling> toSep, fromSep; // Entries of A_pS (row local) and A_Sp (column local)
+        std::vector<int> sepCols;             // Separator columns of A_pS, sorted
+        std::vector<std::vector<T>> z;        // z[t] = A_pp^-1 A_pS(:, sepCols[t])
+        std::vector<T> y;
+        bool ok = false;
+        explicit Block(int size) : sys(size) {}
+    };
+    std::vector<Block> blocks;
+    blocks.reserve(parts);
+    for (int p = 0; p < parts; ++p) blocks.emplace_back((int)members[p].size());
+    MNASystem<T> coupling(ns);
+    for (size_t k = 0; k < sys.vals.size(); ++k) {
+        int r = sys.rows[k], c = sys.cols[k];
+        if (part[r] >= 0 && part[c] >= 0) blocks[part[r]].sys.add(local[r], local[c], sys.vals[k]);
+        else if (part[r] >= 0) blocks[part[r]].toSep.push_back({local[r], sepIndex[c], sys.vals[k]});
+        else if (part[c] >= 0) blocks[part[c]].fromSep.push_back({local[c], sepIndex[r], sys.vals[k]});
+        else coupling.add(sepIndex[r], sepIndex[c], sys.vals[k]);
+    }
+    for (int i = 0; i < n; ++i) {
+        if (part[i] >= 0) blocks[part[i]].sys.rhs[local[i]] = sys.rhs[i];
+        else coupling.rhs[sepIndex[i]] = sys.rhs[i];
+    }
+
+    pool.run(parts, [&](int p) {
+        Block& b = blocks[p];
+        SparseMatrix<T> A = SparseMatrix<T>::fromSystem(b.sys);
+        SparseLU<T> lu;
+        if (!lu.factor(A, minimumDegreeOrdering(A.symmetricAdjacency()))) return;
+        b.y = lu.solve(b.sys.rhs);
+        for (const Coupling& e : b.toSep) b.sepCols.push_back(e.sep);
+        std::sort(b.sepCols.begin(), b.sepCols.end());
+        b.sepCols.erase(std::unique(b.sepCols.begin(), b.sepCols.end()), b.sepCols.end());
+        b.z.assign(b.sepCols.size(), std::vector<T>(b.sys.n, T(0)));
+        for (const Coupling& e : b.toSep) {
+            size_t t = std::lower_bound(b.sepCols.begin(), b.sepCols.end(), e.sep) - b.sepCols.begin();
+            b.z[t][e.local] = b.z[t][e.local] + e.val;
+        }
+        for (auto& col : b.z) col = lu.solve(col);
+        b.ok = true;
+    });
+
+    for (const Block& b : blocks) {
+        if (!b.ok) return false;
+        for (const Coupling& e : b.fromSep) {
+            coupling.rhs[e.sep] = coupling.rhs[e.sep] - e.val * b.y[e.local];
+            for (size_t t = 0; t < b.sepCols.size(); ++t) {
+                coupling.add(e.sep, b.sepCols[t], T(0) - e.val * b.z[t][e.local]);
+            }
+        }
+    }
+    SparseMatrix<T> S = SparseMatrix<T>::fromSystem(coupling);
+    SparseLU<T> lu;
+    if (!lu.factor(S, minimumDegreeOrdering(S.symmetricAdjacency()))) return false;
+    std::vector<T> xs = lu.solve(coupling.rhs);
+
+    x.assign(n, T(0));
+    for (int s = 0; s < ns; ++s) x[sepUnknowns[s]] = xs[s];
+    pool.run(parts, [&](int p) {
+        const Block& b = blocks[p];
+        for (size_t i = 0; i < members[p].size(); ++i) {
+            T v = b.y[i];
+            for (size_t t = 0; t < b.sepCols.size(); ++t) v = v - b.z[t][i] * xs[b.sepCols[t]];
+            x[members[p][i]] = v;
+        }
+    });
+
+    if (stats) {
+        stats->parts = parts;
+        stats->separator = ns;
+        stats->largestPart = 0;
+        for (const auto& m : members) stats->largestPart = std::max(stats->largestPart, (int)m.size());
+    }
+    return true;
+}
+
+// --- Preconditioned Conjugate Gradients for Resistive DC Systems ---
+
+enum PCGPreconditioner {
+    PRECOND_JACOBI, // Diagonal scaling
+    PRECOND_IC0,    // Incomplete Cholesky restricted to the pattern of A
+    PRECOND_AMG     // Smoothed aggregation multigrid V-cycle (see AMGHierarchy)
+};
+
+struct PCGStats {
+    int iterations = 0;
+    double residual = 0.0; // Final ||b - Ax|| / ||b||
+    bool converged = false;
+};
+
+const double PCG_TOLERANCE = 1e-12; // Relative residual; answers are printed with 6 digits
+
+// Smoothed aggregation multigrid for symmetric M-matrices (conductance matrices), used as
+// the PCG preconditioner for large grids. Strongly coupled neighbours are grouped into
+// aggregates, the aggregates' piecewise-constant prolongator is smoothed by one damped
+// Jacobi step, and each coarse level is the Galerkin product P^T A P, down to a level small
+// enough for dense Cholesky. One application is a V-cycle with a forward Gauss-Seidel sweep
+// before the coarse correction and a backward sweep after it, so it stays symmetric.
+class AMGHierarchy {
+public:
+    AMGHierarchy() = default;
+
+    explicit AMGHierarchy(const SparseMatrix<double>& A) {
+        Level fine;
+        fine.A.rows = fine.A.cols = A.n;
+        fine.A.colPtr = A.colPtr;
+        fine.A.rowIdx = A.rowIdx;
+        fine.A.vals = A.vals;
+        levels.push_back(std::move(fine));
+
+        while (levels.back().A.rows > COARSE_SIZE && (int)levels.size() < MAX_LEVELS) {
+            Level& L = levels.back();
+            CSC P = smoothedProlongator(L.A);
+            if (P.cols > COARSE_RATIO * L.A.rows) break; // Aggregation stalled
+            Level coarse;
+            coarse.A = multiply(transpose(P), multiply(L.A, P));
+            L.P = std::move(P);
+            levels.push_back(std::move(coarse));
+        }
+        for (auto& L : levels) {
+            int n = L.A.rows;
+            L.x.assign(n, 0.0);
+            L.b.assign(n, 0.0);
+            L.r.assign(n, 0.0);
+        }
+        factorCoarsest();
+    }
+
+    bool empty() const { return levels.empty(); }
+    int depth() const { return (int)levels.size(); }
+
+    // Nonzeros of all levels relative to the fine matrix (memory and V-cycle cost)
+    double operatorComplexity() const {
+        double total = 0.0;
+        for (const auto& L : levels) total += L.A.vals.size();
+        return levels.empty() || levels[0].A.vals.empty() ? 1.0 : total / levels[0].A.vals.size();
+    }
+
+    // z ~ A^-1 r
+    void apply(const std::vector<double>& r, std::vector<double>& z) const {
+        std::copy(r.begin(), r.end(), levels[0].b.begin());
+        cycle(0);
+        std::copy(levels[0].x.begin(), levels[0].x.end(), z.begin());
+    }
+
+private:
+    static constexpr int COARSE_SIZE = 64;      // Solved directly at or below this size
+    static constexpr int MAX_LEVELS = 25;
+    static constexpr double COARSE_RATIO = 0.85;
+    static constexpr double STRENGTH = 0.08;    // |a_ij| >= STRENGTH * sqrt(a_ii a_jj) is a strong coupling
+    static constexpr double JACOBI_WEIGHT = 2.0 / 3.0; // 4/3 over the Gershgorin bound 2 on rho(D^-1 A)
+
+    // Rectangular CSC (SparseMatrix is square); row indices need not be sorted
+    struct CSC {
+        int rows = 0, cols = 0;
+        std::vector<int> colPtr, rowIdx;
+        std::vector<double> vals;
+    };
+
+    struct Level {
+        CSC A, P; // P: prolongator to this level from the next coarser one
+        mutable std::vector<double> x, b, r; // V-cycle scratch
+    };
+
+    std::vector<Level> levels;
+    std::vector<double> coarseL; // Dense Cholesky factor of the coarsest level (row-major, lower)
+
+    static CSC transpose(const CSC& X) {
+        CSC T;
+        T.rows = X.cols;
+        T.cols = X.rows;
+        T.colPtr.assign(X.rows + 1, 0);
+        for (int r : X.rowIdx) T.colPtr[r + 1]++;
+        for (int i = 0; i < X.rows; ++i) T.colPtr[i + 1] += T.colPtr[i];
+        T.rowIdx.resize(X.rowIdx.size());
+        T.vals.resize(X.vals.size());
+        std::vector<int> next(T.colPtr.begin(), T.colPtr.end() - 1);
+        for (int j = 0; j < X.cols; ++j) {
+            for (int p = X.colPtr[j]; p < X.colPtr[j + 1]; ++p) {
+                int q = next[X.rowIdx[p]]++;
+                T.rowIdx[q] = j;
+                T.vals[q] = X.vals[p];
+            }
+        }
+        return T;
+    }
+
+    // X * Y, one column at a time with a dense accumulator (Gustavson)
+    static CSC multiply(const CSC& X, const CSC& Y) {
+        CSC C;
+        C.rows = X.rows;
+        C.cols = Y.cols;
+        C.colPtr.assign(Y.cols + 1, 0);
+        std::vector<int> mark(X.rows, -1);
+        std::vector<double> acc(X.rows, 0.0);
+        for (int j = 0; j < Y.cols; ++j) {
+            size_t start = C.rowIdx.size();
+            for (int p = Y.colPtr[j]; p < Y.colPtr[j + 1]; ++p) {
+                int k = Y.rowIdx[p];
+                double ykj = Y.vals[p];
+                for (int q = X.colPtr[k]; q < X.colPtr[k + 1]; ++q) {
+                    int i = X.rowIdx[q];
+                    if (mark[i] != j) {
+                        mark[i] = j;
+                        acc[i] = 0.0;
+                        C.rowIdx.push_back(i);
+                    }
+                    acc[i] += X.vals[q] * ykj;
+                }
+            }
+            for (size_t p = start; p < C.rowIdx.size(); ++p) C.vals.push_back(acc[C.rowIdx[p]]);
+            C.colPtr[j + 1] = (int)C.rowIdx.size();
+        }
+        return C;
+    }
+
+    // Aggregates of strongly coupled nodes: roots whose strong neighbours are all free take
+    // them over, leftovers join their strongest aggregated neighbour, and anything still
+    // unassigned starts an aggregate with its free neighbours
+    static std::vector<int> aggregate(const CSC& A, int& count) {
+        int n = A.rows;
+        std::vector<double> diag(n, 0.0);
+        for (int j = 0; j < n; ++j) {
+            for (int p = A.colPtr[j]; p < A.colPtr[j + 1]; ++p) {
+                if (A.rowIdx[p] == j) diag[j] += A.vals[p];
+            }
+        }
+        auto strong = [&](int i, int j, double a) {
+            return i != j && std::abs(a) >= STRENGTH * std::sqrt(std::abs(diag[i] * diag[j]));
+        };
+
+        std::vector<int> agg(n, -1);
+        count = 0;
+        for (int i = 0; i < n; ++i) { // Pass 1: roots
+            bool free = true, any = false;
+            for (int p = A.colPtr[i]; p < A.colPtr[i + 1] && free; ++p) {
+                if (!strong(i, A.rowIdx[p], A.vals[p])) continue;
+                any = true;
+                free = agg[A.rowIdx[p]] < 0;
+            }
+            if (!free || !any || agg[i] >= 0) continue;
+            agg[i] = count;
+            for (int p = A.colPtr[i]; p < A.colPtr[i + 1]; ++p) {
+                if (strong(i, A.rowIdx[p], A.vals[p])) agg[A.rowIdx[p]] = count;
+            }
+            count++;
+        }
+        std::vector<int> first = agg;
+        for (int i = 0; i < n; ++i) { // Pass 2: join the strongest aggregated neighbour
+            if (first[i] >= 0) continue;
+            double best = 0.0;
+            for (int p = A.colPtr[i]; p < A.colPtr[i + 1]; ++p) {
+                int j = A.rowIdx[p];
+                if (first[j] >= 0 && strong(i, j, A.vals[p]) && std::abs(A.vals[p]) > best) {
+                    best = std::abs(A.vals[p]);
+                    agg[i] = first[j];
+                }
+            }
+        }
+        for (int i = 0; i < n; ++i) { // Pass 3: new aggregates from the rest
+            if (agg[i] >= 0) continue;
+            agg[i] = count;
+            for (int p = A.colPtr[i]; p < A.colPtr[i + 1]; ++p) {
+                int j = A.rowIdx[p];
+                if (agg[j] < 0 && strong(i, j, A.vals[p])) agg[j] = count;
+            }
+            count++;
+        }
+        return agg;
+    }
+
+    // (I - w D^-1 A) times the aggregates' piecewise-constant prolongator
+    static CSC smoothedProlongator(const CSC& A) {
+        int n = A.rows, count = 0;
+        std::vector<int> agg = aggregate(A, count);
+
+        CSC T; // Tentative prolongator: one 1 per row
+        T.rows = n;
+        T.cols = count;
+        T.colPtr.assign(count + 1, 0);
+        for (int i = 0; i < n; ++i) T.colPtr[agg[i] + 1]++;
+        for (int a = 0; a < count; ++a) T.colPtr[a + 1] += T.colPtr[a];
+        T.rowIdx.resize(n);
+        T.vals.assign(n, 1.0);
+        std::vector<int> next(T.colPtr.begin(), T.colPtr.end() - 1);
+        for (int i = 0; i < n; ++i) T.rowIdx[next[agg[i]]++] = i;
+
+        std::vector<double> diag(n, 0.0);
+        for (int j = 0; j < n; ++j) {
+            for (int p = A.colPtr[j]; p < A.colPtr[j + 1]; ++p) {
+                if (A.rowIdx[p] == j) diag[j] += A.vals[p];
+            }
+        }
+        CSC S = A;
+        for (int j = 0; j < n; ++j) {
+            for (int p = S.colPtr[j]; p < S.colPtr[j + 1]; ++p) {
+                int i = S.rowIdx[p];
+                S.vals[p] = (i == j ? 1.0 : 0.0) - (diag[i] != 0 ? JACOBI_WEIGHT * S.vals[p] / diag[i] : 0.0);
+            }
+        }
+        return multiply(S, T);
+    }
+
+    void factorCoarsest() {
+        const CSC& A = levels.back().A;
+        int n = A.rows;
+        coarseL.assign((size_t)n * n, 0.0);
+        for (int j = 0; j < n; ++j) {
+            for (int p = A.colPtr[j]; p < A.colPtr[j + 1]; ++p) coarseL[(size_t)A.rowIdx[p] * n + j] += A.vals[p];
+        }
+        for (int k = 0; k < n; ++k) {
+            double* Lk = &coarseL[(size_t)k * n];
+            double d = Lk[k];
+            for (int j = 0; j < k; ++j) d -= Lk[j] * Lk[j];
+            // A zero pivot is a direction the matrix does not see: its component is dropped
+            Lk[k] = d > 0 ? std::sqrt(d) : 0.0;
+            for (int i = k + 1; i < n; ++i) {
+                double* Li = &coarseL[(size_t)i * n];
+                double s = Li[k];
+                for (int j = 0; j < k; ++j) s -= Li[j] * Lk[j];
+                Li[k] = Lk[k] > 0 ? s / Lk[k] : 0.0;
+            }
+        }
+    }
+
+    void solveCoarsest(const Level& L) const {
+        int n = L.A.rows;
+        std::vector<double>& x = L.x;
+        for (int i = 0; i < n; ++i) {
+            const double* Li = &coarseL[(size_t)i * n];
+            double s = L.b[i];
+            for (int j = 0; j < i; ++j) s -= Li[j] * x[j];
+            x[i] = Li[i] > 0 ? s / Li[i] : 0.0;
+        }
+        for (int i = n - 1; i >= 0; --i) {
+            double s = x[i];
+            for (int j = i + 1; j < n; ++j) s -= coarseL[(size_t)j * n + i] * x[j];
+            x[i] = coarseL[(size_t)i * n + i] > 0 ? s / coarseL[(size_t)i * n + i] : 0.0;
+        }
+    }
+
+    // One Gauss-Seidel sweep on L.A x = L.b (column j of the symmetric A is row j)
+    static void gaussSeidel(const Level& L, bool forward) {
+        int n = L.A.rows;
+        for (int k = 0; k < n; ++k) {
+            int i = forward ? k : n - 1 - k;
+            double s = L.b[i], d = 0.0;
+            for (int p = L.A.colPtr[i]; p < L.A.colPtr[i + 1]; ++p) {
+                int j = L.A.rowIdx[p];
+                if (j == i) d += L.A.vals[p];
+                else s -= L.A.vals[p] * L.x[j];
+            }
+            if (d != 0) L.x[i] = s / d;
+        }
+    }
+
+    // Approximate solve of levels[l].A x = b, from x = 0
+    void cycle(size_t l) const {
+        const Level& L = levels[l];
+        if (l + 1 == levels.size()) {
+            solveCoarsest(L);
+            return;
+        }
+        std::fill(L.x.begin(), L.x.end(), 0.0);
+        gaussSeidel(L, true);
+
+        int n = L.A.rows;
+        std::copy(L.b.begin(), L.b.end(), L.r.begin());
+        for (int j = 0; j < n; ++j) {
+            double xj = L.x[j];
+            for (int p = L.A.colPtr[j]; p < L.A.colPtr[j + 1]; ++p) L.r[L.A.rowIdx[p]] -= L.A.vals[p] * xj;
+        }
+        const Level& C = levels[l + 1];
+        for (int a = 0; a < L.P.cols; ++a) { // b_c = P^T r
+            double s = 0.0;
+            for (int p = L.P.colPtr[a]; p < L.P.colPtr[a + 1]; ++p) s += L.P.vals[p] * L.r[L.P.rowIdx[p]];
+            C.b[a] = s;
+        }
+        cycle(l + 1);
+        for (int a = 0; a < L.P.cols; ++a) { // x += P x_c
+            double xa = C.x[a];
+            for (int p = L.P.colPtr[a]; p < L.P.colPtr[a + 1]; ++p) L.x[L.P.rowIdx[p]] += L.P.vals[p] * xa;
+        }
+        gaussSeidel(L, false);
+    }
+};
+
+// Conjugate gradients on a symmetric positive definite matrix (CSC, both triangles stored).
+// Only A, the preconditioner (at most the lower triangle of A, or a multigrid hierarchy of
+// a small multiple of A) and a handful of length-n vectors are kept, so memory grows
+// linearly with the circuit.
+class PCGSolver {
+public:
+    explicit PCGSolver(SparseMatrix<double> matrix, PCGPreconditioner pre = PRECOND_IC0)
+        : A(std::move(matrix)), kind(pre) {
+        // IC(0) exists for the M-matrices resistive networks give; if a pivot still breaks
+        // down (e.g. a pinned row with unusual values), fall back to Jacobi
+        if (kind == PRECOND_IC0 && !factorIC0()) kind = PRECOND_JACOBI;
+        if (kind == PRECOND_AMG) amg = AMGHierarchy(A);
+        if (kind == PRECOND_JACOBI) {
+            invDiag.assign(A.n, 1.0);
+            for (int j = 0; j < A.n; ++j) {
+                for (int p = A.colPtr[j]; p < A.colPtr[j + 1]; ++p) {
+                    if (A.rowIdx[p] == j && A.vals[p] > 0) invDiag[j] = 1.0 / A.vals[p];
+                }
+            }
+        }
+    }
+
+    PCGPreconditioner preconditioner() const { return kind; }
+    const AMGHierarchy& multigrid() const { return amg; }
+
+    // x holds the starting guess on entry (warm start; resized to zeros if empty) and the
+    // solution on exit. maxIter = 0 allows 2n + 100 iterations.
+    PCGStats solve(const std::vector<double>& b, std::vector<double>& x,
+                   double tol = PCG_TOLERANCE, int maxIter = 0) const {
+        int n = A.n;
+        PCGStats stats;
+        if (maxIter <= 0) maxIter = 2 * n + 100;
+        if ((int)x.size() != n) x.assign(n, 0.0);
+
+        double bNorm = std::sqrt(dot(b, b));
+        if (bNorm == 0.0) {
+            std::fill(x.begin(), x.end(), 0.0);
+            stats.converged = true;
+            return stats;
+        }
+
+        std::vector<double> r(n), z(n), p(n), q(n);
+        multiply(x, q);
+        for (int i = 0; i < n; ++i) r[i] = b[i] - q[i];
+        precondition(r, z);
+        p = z;
+        double rz = dot(r, z);
+        double rNorm = std::sqrt(dot(r, r));
+
+        while (rNorm > tol * bNorm && stats.iterations < maxIter) {
+            multiply(p, q);
+            double pq = dot(p, q);
+            if (!(pq > 0)) break; // Not positive definite along p
+            double alpha = rz / pq;
+            double rr = 0.0;
+            for (int i = 0; i < n; ++i) {
+                x[i] += alpha * p[i];
+                r[i] -= alpha * q[i];
+                rr += r[i] * r[i];
+            }
+            rNorm = std::sqrt(rr);
+            precondition(r, z);
+            double rzNew = dot(r, z);
+            double beta = rzNew / rz;
+            rz = rzNew;
+            for (int i = 0; i < n; ++i) p[i] = z[i] + beta * p[i];
+            stats.iterations++;
+        }
+
+        // Report the true residual, not the recurrence
+        multiply(x, q);
+        for (int i = 0; i < n; ++i) r[i] = b[i] - q[i];
+        stats.residual = std::sqrt(dot(r, r)) / bNorm;
+        stats.converged = stats.residual <= 10 * tol;
+        return stats;
+    }
+
+private:
+    SparseMatrix<double> A;
+    PCGPreconditioner kind;
+    std::vector<double> invDiag;              // Jacobi
+    std::vector<int> Lp, Li;                  // IC(0): L in CSC, diagonal first in each column
+    std::vector<double> Lx;                   // (stored as 1 / L(j, j): no division in the solves)
+    AMGHierarchy amg;
+
+    static double dot(const std::vector<double>& a, const std::vector<double>& b) {
+        double s = 0.0;
+        for (size_t i = 0; i < a.size(); ++i) s += a[i] * b[i];
+        return s;
+    }
+
+    void multiply(const std::vector<double>& x, std::vector<double>& y) const {
+        std::fill(y.begin(), y.end(), 0.0);
+        for (int j = 0; j < A.n; ++j) {
+            double xj = x[j];
+            for (int p = A.colPtr[j]; p < A.colPtr[j + 1]; ++p) y[A.rowIdx[p]] += A.vals[p] * xj;
+        }
+    }
+
+    // Right-looking incomplete Cholesky: updates that would create fill are dropped
+    bool factorIC0() {
+        int n = A.n;
+        Lp.assign(n + 1, 0);
+        Li.clear();
+        Lx.clear();
+        for (int j = 0; j < n; ++j) {
+            for (int p = A.colPtr[j]; p < A.colPtr[j + 1]; ++p) {
+                if (A.rowIdx[p] < j) continue;
+                Li.push_back(A.rowIdx[p]);
+                Lx.push_back(A.vals[p]);
+            }
+            Lp[j + 1] = (int)Li.size();
+            if (Lp[j] == Lp[j + 1] || Li[Lp[j]] != j) return false; // Missing diagonal
+        }
+
+        for (int k = 0; k < n; ++k) {
+            int p0 = Lp[k], end = Lp[k + 1];
+            if (!(Lx[p0] > 0)) return false;
+            double d = std::sqrt(Lx[p0]);
+            Lx[p0] = 1.0 / d;
+            for (int p = p0 + 1; p < end; ++p) Lx[p] /= d;
+
+            // L(j, i) -= L(i, k) * L(j, k) for rows i <= j below the diagonal of column k,
+            // wherever (j, i) is already in the pattern
+            for (int p = p0 + 1; p < end; ++p) {
+                int i = Li[p];
+                double lik = Lx[p];
+                for (int q = p; q < end; ++q) {
+                    auto first = Li.begin() + Lp[i], last = Li.begin() + Lp[i + 1];
+                    auto it = std::lower_bound(first, last, Li[q]);
+                    if (it != last && *it == Li[q]) Lx[it - Li.begin()] -= lik * Lx[q];
+                }
+            }
+        }
+        return true;
+    }
+
+    void precondition(const std::vector<double>& r, std::vector<double>& z) const {
+        int n = A.n;
+        if (kind == PRECOND_JACOBI) {
+            for (int i = 0; i < n; ++i) z[i] = r[i] * invDiag[i];
+            return;
+        }
+        if (kind == PRECOND_AMG) {
+            amg.apply(r, z);
+            return;
+        }
+        std::copy(r.begin(), r.end(), z.begin());
+        for (int j = 0; j < n; ++j) { // L y = r
+            double yj = z[j] * Lx[Lp[j]];
+            z[j] = yj;
+            for (int p = Lp[j] + 1; p < Lp[j + 1]; ++p) z[Li[p]] -= Lx[p] * yj;
+        }
+        for (int j = n - 1; j >= 0; --j) { // L^T z = y
+            double s = z[j];
+            for (int p = Lp[j] + 1; p < Lp[j + 1]; ++p) s -= Lx[p] * z[Li[p]];
+            z[j] = s * Lx[Lp[j]];
+        }
+    }
+};
+
+// Nodal form of a DC MNA system. Every voltage source is eliminated by writing the voltage
+// of one terminal as the other's plus the source value, so each tree of sources becomes a
+// supernode (fixed, if the tree reaches ground). What remains is the conductance matrix of
+// the free supernodes, which is symmetric positive definite once each floating island is
+// pinned at one node. Branch currents are recovered afterwards from KCL at the tree leaves.
+class NodalReduction {
+public:
+    MNASystem<double> reduced{0}; // Free supernodes only
+
+    // False if the system has no nodal form: sources forming a loop, or stamps that are not
+    // the DC builder's (see MNASystem::branches)
+    bool build(const MNASystem<double>& sys) {
+        m = sys.n - sys.branches;
+        int numB = sys.branches;
+        pos.assign(numB, m);
+        neg.assign(numB, m);
+        std::vector<int> entries(numB, 0);
+        for (size_t k = 0; k < sys.vals.size(); ++k) {
+            int r = sys.rows[k], c = sys.cols[k];
+            if (r < m) continue; // Node rows, including their branch columns (the mirror of the incidence)
+            if (c >= m) return false;
+            int b = r - m;
+            if (sys.vals[k] == 1.0) pos[b] = c;
+            else if (sys.vals[k] == -1.0) neg[b] = c;
+            else return false;
+            entries[b]++;
+        }
+        incident.assign(m + 1, std::vector<int>());
+        for (int b = 0; b < numB; ++b) {
+            if (entries[b] == 0 || entries[b] > 2 || pos[b] == neg[b]) return false;
+            incident[pos[b]].push_back(b);
+            incident[neg[b]].push_back(b);
+        }
+
+        // Walk the source forest, from ground (vertex m) first: v_pos = v_neg + E
+        root.assign(m + 1, -1);
+        offset.assign(m + 1, 0.0);
+        std::vector<char> used(numB, 0);
+        std::vector<int> stack;
+        auto walk = [&](int s) {
+            root[s] = s;
+            stack.push_back(s);
+            while (!stack.empty()) {
+                int u = stack.back();
+                stack.pop_back();
+                for (int b : incident[u]) {
+                    if (used[b]) continue;
+                    used[b] = 1;
+                    int w = (u == pos[b]) ? neg[b] : pos[b];
+                    if (root[w] >= 0) return false; // Loop of voltage sources
+                    root[w] = s;
+                    double E = sys.rhs[m + b];
+                    offset[w] = (w == pos[b]) ? offset[u] + E : offset[u] - E;
+                    stack.push_back(w);
+                }
+            }
+            return true;
+        };
+        if (!walk(m)) return false;
+        for (int i = 0; i < m; ++i) {
+            if (root[i] < 0 && !walk(i)) return false;
+        }
+
+        // One unknown per free tree; trees reaching ground are fixed
+        unknown.assign(m, -1);
+        int k = 0;
+        for (int i = 0; i < m; ++i) {
+            if (root[i] == i) unknown[i] = k++;
+        }
+        for (int i = 0; i < m; ++i) {
+            if (root[i] != m) unknown[i] = unknown[root[i]];
+        }
+
+        // Sum the node rows of each supernode (its source currents cancel) and move the
+        // known offsets to the right-hand side
+        reduced = MNASystem<double>(k);
+        reduced.reserve(sys.vals.size() + k);
+        for (int i = 0; i < m; ++i) {
+            if (unknown[i] >= 0) reduced.rhs[unknown[i]] += sys.rhs[i];
+        }
+        std::vector<double> diag(k, 0.0), rowSum(k, 0.0);
+        DisjointSet islands(k);
+        for (size_t s = 0; s < sys.vals.size(); ++s) {
+            int r = sys.rows[s], c = sys.cols[s];
+            if (r >= m || c >= m || unknown[r] < 0) continue;
+            int R = unknown[r], C = unknown[c];
+            double v = sys.vals[s];
+            reduced.rhs[R] -= v * offset[c];
+            if (C < 0) continue;
+            reduced.add(R, C, v);
+            rowSum[R] += v;
+            if (R == C) diag[R] += v;
+            else islands.unite(R, C);
+        }
+
+        // A row sum is the conductance from that supernode to ground or fixed nodes. An island
+        // where every row sum vanishes floats: its voltages are only defined up to a constant,
+        // so its first supernode is pinned at 0 V (the dense solvers zero such unknowns too).
+        std::vector<char> anchored(k, 0), pinned(k, 0);
+        for (int R = 0; R < k; ++R) {
+            if (rowSum[R] > 1e-10 * diag[R]) anchored[islands.find(R)] = 1;
+        }
+        bool anyPinned = false;
+        for (int R = 0; R < k; ++R) {
+            int island = islands.find(R);
+            if (!anchored[island]) {
+                anchored[island] = 1; // Pin one supernode per island
+                pinned[R] = 1;
+                anyPinned = true;
+            }
+        }
+        if (anyPinned) {
+            size_t out = 0;
+            for (size_t s = 0; s < reduced.vals.size(); ++s) {
+                if (pinned[reduced.rows[s]] || pinned[reduced.cols[s]]) continue;
+                reduced.rows[out] = reduced.rows[s];
+                reduced.cols[out] = reduced.cols[s];
+                reduced.vals[out] = reduced.vals[s];
+                out++;
+            }
+            reduced.rows.resize(out);
+            reduced.cols.resize(out);
+            reduced.vals.resize(out);
+            for (int R = 0; R < k; ++R) {
+                if (!pinned[R]) continue;
+                reduced.add(R, R, 1.0);
+                reduced.rhs[R] = 0.0;
+            }
+        }
+        return true;
+    }
+
+    // Starting guess for the reduced system from one in the MNA layout (empty for none)
+    std::vector<double> guess(const std::vector<double>& x) const {
+        if (x.empty()) return x;
+        std::vector<double> y(reduced.n, 0.0);
+        for (int i = 0; i < m; ++i) {
+            if (root[i] == i) y[unknown[i]] = x[i];
+        }
+        return y;
+    }
+
+    // MNA-layout solution (node voltages, then source currents) from the reduced solution
+    std::vector<double> recover(const MNASystem<double>& sys, const std::vector<double>& y) const {
+        std::vector<double> x(sys.n, 0.0);
+        for (int i = 0; i < m; ++i) x[i] = (unknown[i] >= 0 ? y[unknown[i]] : 0.0) + offset[i];
+
+        // KCL residual of every node row without the source currents; at a leaf of a source
+        // tree it is carried by the leaf's one source, which is then removed from the tree
+        std::vector<double> res(m + 1, 0.0);
+        for (int i = 0; i < m; ++i) res[i] = sys.rhs[i];
+        for (size_t s = 0; s < sys.vals.size(); ++s) {
+            if (sys.rows[s] < m && sys.cols[s] < m) res[sys.rows[s]] -= sys.vals[s] * x[sys.cols[s]];
+        }
+        std::vector<int> degree(m + 1), leaves;
+        for (int i = 0; i <= m; ++i) {
+            degree[i] = (int)incident[i].size();
+            if (i < m && degree[i] == 1) leaves.push_back(i);
+        }
+        std::vector<char> done(sys.branches, 0);
+        while (!leaves.empty()) {
+            int i = leaves.back();
+            leaves.pop_back();
+            if (degree[i] != 1) continue;
+            for (int b : incident[i]) {
+                if (done[b]) continue;
+                done[b] = 1;
+                double current = (i == pos[b]) ? res[i] : -res[i];
+                x[m + b] = current;
+                int w = (i == pos[b]) ? neg[b] : pos[b];
+                res[w] -= (w == pos[b]) ? current : -current;
+                degree[i]--;
+                if (--degree[w] == 1 && w < m) leaves.push_back(w);
+                break;
+            }
+        }
+        return x;
+    }
+
+private:
+    int m = 0;                               // Node unknowns of the MNA system
+    std::vector<int> pos, neg;               // Terminals of each source (m: ground)
+    std::vector<std::vector<int>> incident;  // Sources at each node (m: ground)
+    std::vector<int> root;                   // Root of each node's source tree (m: ground)
+    std::vector<double> offset;              // v_node = v_root + offset
+    std::vector<int> unknown;                // Reduced unknown of each node, -1 if fixed
+};
+
+// Iterative backend for DC systems: nodal reduction, then PCG. x holds an optional starting
+// guess in the system's layout (empty for none) and receives the solution. Returns false if
+// the system has no nodal form or PCG does not converge; callers fall back to a direct solver.
+inline bool solveNodalPCG(const MNASystem<double>& sys, std::vector<double>& x,
+                          PCGStats* stats = nullptr, PCGPreconditioner pre = PRECOND_AMG) {
+    NodalReduction red;
+    if (!red.build(sys)) return false;
+    std::vector<double> y = red.guess(x);
+    PCGStats st = PCGSolver(SparseMatrix<double>::fromSystem(red.reduced), pre).solve(red.reduced.rhs, y);
+    if (stats) *stats = st;
+    if (!st.converged) return false;
+    x = red.recover(sys, y);
+    return true;
+}
+
+// --- Series-Parallel and Y-Delta Reduction ---
+
+// Node potentials tied by ideal voltage sources and shorts: v[u] = v[find(u)] + offset[u]
+// after find(u). Ground (node 0) always stays the root of its group.
+struct PotentialTies {
+    std::vector<int> parent;
+    std::vector<double> offset;
+
+    explicit PotentialTies(int n = 0) { reset(n); }
+
+    void reset(int n) {
+        parent.resize(n);
+        for (int i = 0; i < n; ++i) parent[i] = i;
+        offset.assign(n, 0.0);
+    }
+
+    int find(int u) {
+        int r = u;
+        double off = 0.0;
+        while (parent[r] != r) {
+            off += offset[r];
+            r = parent[r];
+        }
+        while (parent[u] != r) { // Path compression, offsets made relative to r
+            int next = parent[u];
+            double o = offset[u];
+            parent[u] = r;
+            offset[u] = off;
+            off -= o;
+            u = next;
+        }
+        return r;
+    }
+
+    // Tie v[a] = v[b] + E. False if a and b are already tied to a different difference
+    // (a loop of voltage sources).
+    bool tie(int a, int b, double E) {
+        int ra = find(a), rb = find(b);
+        double oa = offset[a], ob = offset[b]; // Roots have offset 0
+        if (ra == rb) return std::abs(oa - ob - E) <= 1e-9 * (1.0 + std::abs(E));
+        if (rb == 0) {
+            parent[ra] = rb;
+            offset[ra] = ob + E - oa;
+        } else {
+            parent[rb] = ra;
+            offset[rb] = oa - ob - E;
+        }
+        return true;
+    }
+
+    double potential(int u) { find(u); return offset[u]; } // Relative to the root
+};
+
+// One rule applied by ReductionNetwork. Branches carry the caller's labels (>= 0) or are
+// equivalents created by the reduction, labelled -1, -2, ... (Req1, Req2, ...).
+struct ReductionStep {
+    enum Kind { DANGLING, SERIES, WYE_DELTA, PARALLEL } kind;
+    int node;        // Eliminated node (PARALLEL: -1)
+    int in[3];       // Branches replaced: the star of node, or the two parallel ones
+    int out[3];      // Equivalents created: one, or three for WYE_DELTA (DANGLING: none)
+    int ends[3][2];  // Nodes of each equivalent (DANGLING: ends[0][0] is where the branch hangs)
+    double g[3];     // Conductance of each equivalent
+    double moved;    // Source current at node shared among its neighbours
+};
+
+// Resistive network reduced by the rules of hand calculation: every node that is not kept
+// is eliminated once it has at most three neighbours (one: dangling branch, two: series,
+// three: Y-Delta), fewest first, and parallel branches are merged as they appear. Each rule
+// is one star-mesh step of nodal elimination, so the kept nodes see exactly the original
+// network, in O(n) work when it reduces. A source current injected at an eliminated node is
+// shared among its neighbours in proportion to their conductances (source transformation).
+class ReductionNetwork {
+public:
+    std::vector<ReductionStep> steps; // The rules applied, in order, when recording
+
+    ReductionNetwork(int nodes = 0, bool record = false) { reset(nodes, record); }
+
+    // Empty network of the given size; the storage is kept for reuse
+    void reset(int nodes, bool recordSteps) {
+        adj.resize(nodes);
+        for (auto& a : adj) a.clear();
+        inject.assign(nodes, 0.0);
+        kept.assign(nodes, 0);
+        record = recordSteps;
+        equivalents = 0;
+        steps.clear();
+    }
+
+    void keep(int u) { kept[u] = 1; }
+    void injectCurrent(int u, double i) { inject[u] += i; } // Into u
+
+    // Branch of conductance g between u and v, merged in parallel with an existing one
+    void addBranch(int u, int v, double g, int label) {
+        Branch* e = branch(u, v);
+        if (!e) {
+            adj[u].push_back({v, g, label});
+            adj[v].push_back({u, g, label});
+            return;
+        }
+        int merged = --equivalents;
+        if (record) {
+            ReductionStep st{ReductionStep::PARALLEL, -1, {e->label, label, 0}, {merged, 0, 0},
+                             {{std::min(u, v), std::max(u, v)}, {0, 0}, {0, 0}}, {e->g + g, 0, 0}, 0.0};
+            steps.push_back(st);
+        }
+        for (Branch* b : {e, branch(v, u)}) {
+            b->g += g;
+            b->label = merged;
+        }
+    }
+
+    // Eliminate every node that is not kept. False if the rest of the network never gets
+    // down to three neighbours per node, or a node left without branches still carries a
+    // source current.
+    bool reduce() {
+        int n = adj.size();
+        for (auto& w : work) w.clear();
+        done.assign(n, 0);
+        for (int u = 0; u < n; ++u) {
+            if (!kept[u] && adj[u].size() <= 3) work[adj[u].size()].push_back(u);
+        }
+        for (;;) {
+            int k = -1;
+            for (int d = 0; d <= 3 && k < 0; ++d) {
+                while (!work[d].empty()) {
+                    int u = work[d].back();
+                    work[d].pop_back();
+                    if (!done[u] && (int)adj[u].size() == d) {
+                        k = u;
+                        break;
+                    }
+                }
+            }
+            if (k < 0) break;
+            done[k] = 1;
+            Branch star[3];
+            int degree = adj[k].size();
+            std::copy(adj[k].begin(), adj[k].end(), star);
+            if (!eliminate(k, star, degree)) return false;
+            for (int i = 0; i < degree; ++i) {
+                int u = star[i].to;
+                if (!kept[u] && adj[u].size() <= 3) work[adj[u].size()].push_back(u);
+            }
+        }
+        for (int u = 0; u < n; ++u) {
+            if (!kept[u] && !done[u]) return false;
+        }
+        return true;
+    }
+
+    double conductance(int u, int v) const {
+        for (const Branch& b : adj[u]) {
+            if (b.to == v) return b.g;
+        }
+        return 0.0;
+    }
+
+    double current(int u) const { return inject[u]; }
+
+    // Write the text of a recorded step; name(label) names the caller's branches
+    template <class Name>
+    static void describe(std::ostream& ss, const ReductionStep& st, const Name& name) {
+        auto label = [&](int l) { return l >= 0 ? name(l) : "Req" + std::to_string(-l); };
+        auto ends = [&](int m) { return "N" + std::to_string(st.ends[m][0]) + "-N" + std::to_string(st.ends[m][1]); };
+        switch (st.kind) {
+            case ReductionStep::DANGLING:
+                ss << label(st.in[0]) << " dangles from N" << st.ends[0][0] << ": removed";
+                break;
+            case ReductionStep::SERIES:
+                ss << label(st.in[0]) << " + " << label(st.in[1]) << " = " << label(st.out[0]) << " = "
+                   << 1.0 / st.g[0] << " Ohm (" << ends(0) << ", series through N" << st.node << ")";
+                break;
+            case ReductionStep::WYE_DELTA:
+                ss << label(st.in[0]) << ", " << label(st.in[1]) << ", " << label(st.in[2]) << " (Y at N" << st.node << ") -> Delta";
+                for (int m = 0; m < 3; ++m) {
+                    ss << (m ? ", " : " ") << label(st.out[m]) << " = " << 1.0 / st.g[m] << " Ohm (" << ends(m) << ")";
+                }
+                break;
+            case ReductionStep::PARALLEL:
+                ss << label(st.in[0]) << " || " << label(st.in[1]) << " = " << label(st.out[0]) << " = "
+                   << 1.0 / st.g[0] << " Ohm (" << ends(0) << ")";
+                break;
+        }
+        if (std::abs(st.moved) > 1e-12) ss << "; its " << st.moved << " A source current moves to the neighbours";
+    }
+
+private:
+    struct Branch {
+        int to;
+        double g;
+        int label;
+    };
+    std::vector<std::vector<Branch>> adj;
+    std::vector<double> inject;
+    std::vector<char> kept;
+    bool record = false;
+    int equivalents = 0;        // Labels handed out so far, counting down
+    std::vector<int> work[4];   // Candidates for reduce() by number of neighbours, checked when taken
+    std::vector<char> done;
+
+    Branch* branch(int u, int v) {
+        for (Branch& b : adj[u]) {
+            if (b.to == v) return &b;
+        }
+        return nullptr;
+    }
+
+    bool eliminate(int k, const Branch* star, int degree) {
+        adj[k].clear();
+        for (int i = 0; i < degree; ++i) {
+            auto& nb = adj[star[i].to];
+            for (size_t j = 0; j < nb.size(); ++j) {
+                if (nb[j].to != k) continue;
+                nb[j] = nb.back();
+                nb.pop_back();
+                break;
+            }
+        }
+        double I = inject[k];
+        inject[k] = 0.0;
+        if (degree == 0) return std::abs(I) <= 1e-9;
+
+        double G = 0.0;
+        for (int i = 0; i < degree; ++i) G += star[i].g;
+        for (int i = 0; i < degree; ++i) inject[star[i].to] += star[i].g / G * I;
+
+        // Star-mesh: g_ij = g_i g_j / G between every pair of neighbours
+        ReductionStep st{degree == 1 ? ReductionStep::DANGLING : degree == 2 ? ReductionStep::SERIES : ReductionStep::WYE_DELTA,
+                         k, {0, 0, 0}, {0, 0, 0}, {{star[0].to, 0}, {0, 0}, {0, 0}}, {0, 0, 0}, I};
+        int m = 0;
+        for (int a = 0; a < degree; ++a) {
+            st.in[a] = star[a].label;
+            for (int b = a + 1; b < degree; ++b, ++m) {
+                st.out[m] = --equivalents;
+                st.ends[m][0] = star[a].to;
+                st.ends[m][1] = star[b].to;
+                st.g[m] = star[a].g * star[b].g / G;
+            }
+        }
+        if (record) steps.push_back(st);
+        for (int i = 0; i < m; ++i) addBranch(st.ends[i][0], st.ends[i][1], st.g[i], st.out[i]);
+        return true;
+    }
+};
+
+// --- Exact Rational Arithmetic ---
+
+// Arbitrary-precision integer: sign and magnitude in base 2^32, least significant limb first.
+// Only as much as exact DC solves need; small values go through int64_t / __int128 first.
+class BigInt {
+public:
+    BigInt(long long v = 0) : negative(v < 0) {
+        unsigned long long m = negative ? 0ULL - (unsigned long long)v : (unsigned long long)v;
+        for (; m; m >>= 32) mag.push_back((uint32_t)m);
+    }
+
+    static BigInt fromInt128(__int128 v) {
+        BigInt r;
+        r.negative = v < 0;
+        unsigned __int128 m = r.negative ? (unsigned __int128)0 - (unsigned __int128)v : (unsigned __int128)v;
+        for (; m; m >>= 32) r.mag.push_back((uint32_t)m);
+        return r;
+    }
+
+    bool isZero() const { return mag.empty(); }
+    bool isNegative() const { return negative; }
+
+    BigInt operator-() const {
+        BigInt r(*this);
+        if (!r.isZero()) r.negative = !r.negative;
+        return r;
+    }
+
+    BigInt abs() const {
+        BigInt r(*this);
+        r.negative = false;
+        return r;
+    }
+
+    friend BigInt operator+(const BigInt& a, const BigInt& b) {
+        BigInt r;
+        if (a.negative == b.negative) {
+            r.mag = addMag(a.mag, b.mag);
+            r.negative = a.negative;
+        } else if (compareMag(a.mag, b.mag) >= 0) {
+            r.mag = subMag(a.mag, b.mag);
+            r.negative = a.negative;
+        } else {
+            r.mag = subMag(b.mag, a.mag);
+            r.negative = b.negative;
+        }
+        r.trim();
+        return r;
+    }
+
+    friend BigInt operator-(const BigInt& a, const BigInt& b) { return a + (-b); }
+
+    friend BigInt operator*(const BigInt& a, const BigInt& b) {
+        BigInt r;
+        if (a.isZero() || b.isZero()) return r;
+        r.mag.assign(a.mag.size() + b.mag.size(), 0);
+        for (size_t i = 0; i < a.mag.size(); ++i) {
+            uint64_t carry = 0;
+            for (size_t j = 0; j < b.mag.size(); ++j) {
+                uint64_t t = (uint64_t)a.mag[i] * b.mag[j] + r.mag[i + j] + carry;
+                r.mag[i + j] = (uint32_t)t;
+                carry = t >> 32;
+            }
+            r.mag[i + b.mag.size()] = (uint32_t)carry;
+        }
+        r.negative = a.negative != b.negative;
+        r.trim();
+        return r;
+    }
+
+    // Truncating division, as for built-in integers (the remainder takes the dividend's sign)
+    friend BigInt operator/(const BigInt& a, const BigInt& b) {
+        BigInt q, r;
+        divMod(a, b, q, r);
+        return q;
+    }
+
+    friend BigInt operator%(const BigInt& a, const BigInt& b) {
+        BigInt q, r;
+        divMod(a, b, q, r);
+        return r;
+    }
+
+    friend bool operator==(const BigInt& a, const BigInt& b) { return a.negative == b.negative && a.mag == b.mag; }
+    friend bool operator!=(const BigInt& a, const BigInt& b) { return !(a == b); }
+
+    static BigInt gcd(BigInt a, BigInt b) {
+        a = a.abs();
+        b = b.abs();
+        while (!b.isZero()) {
+            int64_t x, y;
+            if (a.toInt(x) && b.toInt(y)) return BigInt(std::gcd(x, y));
+            BigInt t = a % b;
+            a = std::move(b);
+            b = std::move(t);
+        }
+        return a;
+    }
+
+    // Exact conversions to the built-in widths; false if the value does not fit
+    bool toInt(int64_t& v) const {
+        if (mag.size() > 2) return false;
+        uint64_t m = 0;
+        for (size_t i = mag.size(); i-- > 0;) m = (m << 32) | mag[i];
+        if (m > (uint64_t)std::numeric_limits<int64_t>::max()) return false;
+        v = negative ? -(int64_t)m : (int64_t)m;
+        return true;
+    }
+
+    bool toInt(__int128& v) const {
+        if (mag.size() > 4) return false;
+        unsigned __int128 m = 0;
+        for (size_t i = mag.size(); i-- > 0;) m = (m << 32) | mag[i];
+        if (m >> 127) return false;
+        v = negative ? -(__int128)m : (__int128)m;
+        return true;
+    }
+
+    bool toInt(BigInt& v) const {
+        v = *this;
+        return true;
+    }
+
+    double toDouble() const {
+        double v = 0.0;
+        for (size_t i = mag.size(); i-- > 0;) v = v * 4294967296.0 + mag[i];
+        return negative ? -v : v;
+    }
+
+    std::string toString() const {
+        if (isZero()) return "0";
+        std::vector<uint32_t> m = mag;
+        std::string digits;
+        while (!m.empty()) {
+            uint64_t rem = 0;
+            for (size_t i = m.size(); i-- > 0;) {
+                uint64_t cur = (rem << 32) | m[i];
+                m[i] = (uint32_t)(cur / 1000000000);
+                rem = cur % 1000000000;
+            }
+            while (!m.empty() && m.back() == 0) m.pop_back();
+            for (int d = 0; d < 9 && (rem || !m.empty()); ++d, rem /= 10) digits += char('0' + rem % 10);
+        }
+        if (negative) digits += '-';
+        return std::string(digits.rbegin(), digits.rend());
+    }
+
+private:
+    bool negative = false;
+    std::vector<uint32_t> mag;
+
+    void trim() {
+        while (!mag.empty() && mag.back() == 0) mag.pop_back();
+        if (mag.empty()) negative = false;
+    }
+
+    static int compareMag(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b) {
+        if (a.size() != b.size()) return a.size() < b.size() ? -1 : 1;
+        for (size_t i = a.size(); i-- > 0;) {
+            if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+        }
+        return 0;
+    }
+
+    static std::vector<uint32_t> addMag(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b) {
+        const std::vector<uint32_t>& lo = a.size() < b.size() ? a : b;
+        std::vector<uint32_t> r = a.size() < b.size() ? b : a;
+        uint64_t carry = 0;
+        for (size_t i = 0; i < r.size(); ++i) {
+            uint64_t t = (uint64_t)r[i] + (i < lo.size() ? lo[i] : 0) + carry;
+            r[i] = (uint32_t)t;
+            carry = t >> 32;
+            if (!carry && i >= lo.size()) break;
+        }
+        if (carry) r.push_back((uint32_t)carry);
+        return r;
+    }
+
+    static std::vector<uint32_t> subMag(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b) { // |a| >= |b|
+        std::vector<uint32_t> r = a;
+        int64_t borrow = 0;
+        for (size_t i = 0; i < r.size(); ++i) {
+            int64_t t = (int64_t)r[i] - (i < b.size() ? b[i] : 0) - borrow;
+            borrow = t < 0;
+            r[i] = (uint32_t)(t + (borrow << 32));
+            if (!borrow && i >= b.size()) break;
+        }
+        return r;
+    }
+
+    // Schoolbook division (Knuth's algorithm D): by one limb directly, otherwise one
+    // quotient limb at a time from a two-limb estimate, corrected at most twice
+    static void divMod(const BigInt& a, const BigInt& b, BigInt& q, BigInt& r) {
+        q = BigInt();
+        r = BigInt();
+        if (b.isZero()) return;
+        if (compareMag(a.mag, b.mag) < 0) {
+            r = a;
+            return;
+        }
+        size_t n = b.mag.size(), m = a.mag.size() - n;
+        q.mag.assign(m + 1, 0);
+        if (n == 1) {
+            uint64_t rem = 0;
+            for (size_t i = a.mag.size(); i-- > 0;) {
+                uint64_t cur = (rem << 32) | a.mag[i];
+                q.mag[i] = (uint32_t)(cur / b.mag[0]);
+                rem = cur % b.mag[0];
+            }
+            if (rem) r.mag.push_back((uint32_t)rem);
+        } else {
+            // Normalize so that the divisor's top limb has its high bit set
+            int shift = __builtin_clz(b.mag.back());
+            std::vector<uint32_t> v(n), u(a.mag.size() + 1);
+            for (size_t i = n; i-- > 0;) v[i] = (b.mag[i] << shift) | (shift && i ? b.mag[i - 1] >> (32 - shift) : 0);
+            u[a.mag.size()] = shift ? a.mag.back() >> (32 - shift) : 0;
+            for (size_t i = a.mag.size(); i-- > 0;) u[i] = (a.mag[i] << shift) | (shift && i ? a.mag[i - 1] >> (32 - shift) : 0);
+
+            const uint64_t base = 1ULL << 32;
+            for (size_t j = m + 1; j-- > 0;) {
+                uint64_t top = ((uint64_t)u[j + n] << 32) | u[j + n - 1];
+                uint64_t qhat = top / v[n - 1], rhat = top % v[n - 1];
+                while (qhat >= base || qhat * v[n - 2] > ((rhat << 32) | u[j + n - 2])) {
+                    qhat--;
+                    rhat += v[n - 1];
+                    if (rhat >= base) break;
+                }
+                // u[j..j+n] -= qhat v
+                int64_t borrow = 0;
+                uint64_t carry = 0;
+                for (size_t i = 0; i < n; ++i) {
+                    uint64_t p = qhat * v[i] + carry;
+                    carry = p >> 32;
+                    int64_t t = (int64_t)u[i + j] - borrow - (int64_t)(p & 0xffffffffULL);
+                    u[i + j] = (uint32_t)t;
+                    borrow = t < 0;
+                }
+                int64_t t = (int64_t)u[j + n] - borrow - (int64_t)carry;
+                u[j + n] = (uint32_t)t;
+                if (t < 0) { // Estimate one too large: add v back
+                    qhat--;
+                    carry = 0;
+                    for (size_t i = 0; i < n; ++i) {
+                        uint64_t sum = (uint64_t)u[i + j] + v[i] + carry;
+                        u[i + j] = (uint32_t)sum;
+                        carry = sum >> 32;
+                    }
+                    u[j + n] += (uint32_t)carry;
+                }
+                q.mag[j] = (uint32_t)qhat;
+            }
+            r.mag.resize(n);
+            for (size_t i = 0; i < n; ++i) r.mag[i] = (u[i] >> shift) | (shift ? u[i + 1] << (32 - shift) : 0);
+        }
+        q.negative = a.negative != b.negative;
+        r.negative = a.negative;
+        q.trim();
+        r.trim();
+    }
+};
+
+// Exact fraction in lowest terms with den > 0. Held in int64_t while numerator and
+// denominator fit (arithmetic then runs in __int128), in BigInt beyond.
+class Rational {
+public:
+    // A component value or other decimal: taken with up to six decimal places
+    Rational(double v = 0.0) {
+        long long scale = 1;
+        for (int k = 0; k < 6; ++k, scale *= 10) {
+            double t = v * scale;
+            if (std::abs(t - std::round(t)) <= 1e-9 * std::max(1.0, std::abs(t))) break;
+        }
+        if (std::abs(v * scale) < 9e18) {
+            *this = make((__int128)std::llround(v * scale), scale);
+        } else { // Beyond int64_t: integral, and exact as a double
+            int e;
+            double m = std::frexp(v, &e);
+            BigInt n((long long)std::ldexp(m, 53));
+            for (e -= 53; e >= 30; e -= 30) n = n * BigInt(1LL << 30);
+            *this = make(n * BigInt(1LL << e), BigInt(1));
+        }
+    }
+
+    Rational(const BigInt& n, const BigInt& d) { *this = make(n, d); }
+
+    BigInt numerator() const { return big ? bigNum : BigInt(num); }
+    BigInt denominator() const { return big ? bigDen : BigInt(den); }
+
+    // Numerator and denominator as int64_t, if they fit
+    bool small(int64_t& n, int64_t& d) const {
+        n = num;
+        d = den;
+        return !big;
+    }
+
+    bool isZero() const { return !big && num == 0; }
+    bool isNegative() const { return big ? bigNum.isNegative() : num < 0; }
+    double toDouble() const { return big ? bigNum.toDouble() / bigDen.toDouble() : (double)num / (double)den; }
+    std::string toString() const {
+        BigInt n = numerator(), d = denominator();
+        return d == BigInt(1) ? n.toString() : n.toString() + "/" + d.toString();
+    }
+
+    Rational operator-() const {
+        return big ? make(-bigNum, bigDen) : make(-(__int128)num, den);
+    }
+
+    friend Rational operator+(const Rational& a, const Rational& b) {
+        if (!a.big && !b.big) return make((__int128)a.num * b.den + (__int128)b.num * a.den, (__int128)a.den * b.den);
+        return make(a.numerator() * b.denominator() + b.numerator() * a.denominator(), a.denominator() * b.denominator());
+    }
+    friend Rational operator-(const Rational& a, const Rational& b) { return a + (-b); }
+    friend Rational operator*(const Rational& a, const Rational& b) {
+        if (!a.big && !b.big) return make((__int128)a.num * b.num, (__int128)a.den * b.den);
+        return make(a.numerator() * b.numerator(), a.denominator() * b.denominator());
+    }
+    friend Rational operator/(const Rational& a, const Rational& b) {
+        if (!a.big && !b.big) return make((__int128)a.num * b.den, (__int128)a.den * b.num);
+        return make(a.numerator() * b.denominator(), a.denominator() * b.numerator());
+    }
+    Rational& operator+=(const Rational& o) { return *this = *this + o; }
+    Rational& operator-=(const Rational& o) { return *this = *this - o; }
+    friend bool operator==(const Rational& a, const Rational& b) { // Both in lowest terms
+        if (!a.big && !b.big) return a.num == b.num && a.den == b.den;
+        return a.big == b.big && a.bigNum == b.bigNum && a.bigDen == b.bigDen;
+    }
+
+private:
+    struct Raw {};
+    explicit Rational(Raw) {}
+
+    int64_t num = 0, den = 1;
+    bool big = false;
+    BigInt bigNum, bigDen; // Used when big
+
+    static Rational make(__int128 n, __int128 d) {
+        if (d < 0) {
+            n = -n;
+            d = -d;
+        }
+        unsigned __int128 x = n < 0 ? -(unsigned __int128)n : (unsigned __int128)n, y = (unsigned __int128)d;
+        while (y) {
+            unsigned __int128 t = x % y;
+            x = y;
+            y = t;
+        }
+        if (x > 1) {
+            n /= (__int128)x;
+            d /= (__int128)x;
+        }
+        Rational r{Raw()};
+        if (n >= INT64_MIN && n <= INT64_MAX && d <= INT64_MAX) {
+            r.num = (int64_t)n;
+            r.den = (int64_t)d;
+        } else {
+            r.big = true;
+            r.bigNum = BigInt::fromInt128(n);
+            r.bigDen = BigInt::fromInt128(d);
+        }
+        return r;
+    }
+
+    static Rational make(BigInt n, BigInt d) {
+        if (d.isNegative()) {
+            n = -n;
+            d = -d;
+        }
+        BigInt g = BigInt::gcd(n, d);
+        if (!g.isZero() && g != BigInt(1)) {
+            n = n / g;
+            d = d / g;
+        }
+        Rational r{Raw()};
+        if (!n.toInt(r.num) || !d.toInt(r.den)) {
+            r.num = 0;
+            r.den = 1;
+            r.big = true;
+            r.bigNum = std::move(n);
+            r.bigDen = std::move(d);
+        }
+        return r;
+    }
+};
+
+// Integer widths tried by solveExact, narrowest first
+enum ExactWidth { EXACT_INT64, EXACT_INT128, EXACT_BIGINT };
+
+// Checked steps of bareissSolve: false on overflow (never for BigInt)
+inline bool mulSubChecked(int64_t a, int64_t b, int64_t c, int64_t d, int64_t& r) { // a b - c d
+    int64_t ab, cd;
+    return !__builtin_mul_overflow(a, b, &ab) && !__builtin_mul_overflow(c, d, &cd) && !__builtin_sub_overflow(ab, cd, &r);
+}
+
+inline bool mulSubChecked(__int128 a, __int128 b, __int128 c, __int128 d, __int128& r) {
+    __int128 ab, cd;
+    return !__builtin_mul_overflow(a, b, &ab) && !__builtin_mul_overflow(c, d, &cd) && !__builtin_sub_overflow(ab, cd, &r);
+}
+
+inline bool mulSubChecked(const BigInt& a, const BigInt& b, const BigInt& c, const BigInt& d, BigInt& r) {
+    r = a * b - c * d;
+    return true;
+}
+
+// Entry conversions for bareissSolve: false if the value does not fit in Int
+inline bool narrow(int64_t v, int64_t& out) { out = v; return true; }
+inline bool narrow(int64_t v, __int128& out) { out = v; return true; }
+inline bool narrow(int64_t v, BigInt& out) { out = BigInt(v); return true; }
+template <class Int>
+bool narrow(const BigInt& v, Int& out) { return v.toInt(out); }
+
+inline BigInt toBigInt(int64_t v) { return BigInt(v); }
+inline BigInt toBigInt(__int128 v) { return BigInt::fromInt128(v); }
+inline BigInt toBigInt(const BigInt& v) { return v; }
+
+// Fraction-free (Bareiss) elimination of the integer system [A | b] (n rows of n + 1
+// entries) in Int: every intermediate is a minor of [A | b], so divisions are exact and
+// entries grow only linearly in bits. Gives D = det(PA) and X = D x, both integers
+// (Cramer). Returns 1, 0 if A is singular, or -1 on overflow of Int.
+template <class Int, class Entry>
+int bareissSolve(const std::vector<Entry>& Ab, int n, std::vector<BigInt>& X, BigInt& D) {
+    int w = n + 1;
+    std::vector<Int> M(Ab.size());
+    for (size_t k = 0; k < Ab.size(); ++k) {
+        if (!narrow(Ab[k], M[k])) return -1;
+    }
+    Int prev = Int(1);
+    for (int k = 0; k < n; ++k) {
+        int p = k;
+        while (p < n && M[(size_t)p * w + k] == Int(0)) p++;
+        if (p == n) return 0;
+        if (p != k) {
+            for (int j = k; j < w; ++j) std::swap(M[(size_t)p * w + j], M[(size_t)k * w + j]);
+        }
+        const Int* rk = &M[(size_t)k * w];
+        for (int i = k + 1; i < n; ++i) {
+            Int* ri = &M[(size_t)i * w];
+            for (int j = k + 1; j < w; ++j) {
+                Int t;
+                if (!mulSubChecked(rk[k], ri[j], ri[k], rk[j], t)) return -1;
+                ri[j] = t / prev;
+            }
+            ri[k] = Int(0);
+        }
+        prev = rk[k];
+    }
+
+    // Back substitution on D x: X_i = (D b'_i - sum_j>i U_ij X_j) / U_ii, exact again
+    Int det = M[(size_t)(n - 1) * w + n - 1];
+    std::vector<Int> Xi(n);
+    for (int i = n - 1; i >= 0; --i) {
+        const Int* ri = &M[(size_t)i * w];
+        Int s;
+        if (!mulSubChecked(det, ri[n], Int(0), Int(0), s)) return -1;
+        for (int j = i + 1; j < n; ++j) {
+            if (!mulSubChecked(Int(1), s, ri[j], Xi[j], s)) return -1;
+        }
+        Xi[i] = s / ri[i];
+    }
+    X.resize(n);
+    for (int i = 0; i < n; ++i) X[i] = toBigInt(Xi[i]);
+    D = toBigInt(det);
+    return 1;
+}
+
+// Exact solution of an MNA system with rational stamps. Stamps are summed per entry, each
+// row is scaled to integers by the least common multiple of its denominators, and the integer
+// system goes through bareissSolve in int64_t, then __int128 if that overflows, then
+// BigInt, up to maxWidth. False if the system is singular or needs more than maxWidth;
+// used, if given, receives the width that was enough.
+inline bool solveExact(const MNASystem<Rational>& sys, std::vector<Rational>& x,
+                       ExactWidth maxWidth = EXACT_BIGINT, ExactWidth* used = nullptr) {
+    int n = sys.n;
+    if (n == 0) {
+        x.clear();
+        return true;
+    }
+    // Sum the stamps of each entry, in (row, col) order
+    std::vector<size_t> order(sys.vals.size());
+    for (size_t k = 0; k < order.size(); ++k) order[k] = k;
+    std::sort(order.begin(), order.end(), [&](size_t p, size_t q) {
+        return sys.rows[p] != sys.rows[q] ? sys.rows[p] < sys.rows[q] : sys.cols[p] < sys.cols[q];
+    });
+    std::vector<int> entryRow, entryCol;
+    std::vector<Rational> entry;
+    for (size_t k = 0; k < order.size(); ++k) {
+        size_t s = order[k];
+        if (k > 0 && sys.rows[s] == entryRow.back() && sys.cols[s] == entryCol.back()) {
+            entry.back() += sys.vals[s];
+        } else {
+            entryRow.push_back(sys.rows[s]);
+            entryCol.push_back(sys.cols[s]);
+            entry.push_back(sys.vals[s]);
+        }
+    }
+
+    // Scale each row to integers, in int64_t while everything fits
+    std::vector<int64_t> Ab64((size_t)n * (n + 1), 0);
+    std::vector<BigInt> Ab;
+    bool fits = true;
+    size_t first = 0;
+    for (int i = 0; i < n; ++i) {
+        size_t last = first;
+        while (last < entry.size() && entryRow[last] == i) last++;
+        auto rowEntry = [&](size_t k) -> const Rational& { return k < last ? entry[k] : sys.rhs[i]; };
+        auto rowCol = [&](size_t k) { return k < last ? entryCol[k] : n; };
+        int64_t scale = 1, num, den;
+        for (size_t k = first; k <= last && fits; ++k) {
+            if (!rowEntry(k).small(num, den)) fits = false;
+            else if (__builtin_mul_overflow(scale / std::gcd(scale, den), den, &scale)) fits = false;
+        }
+        for (size_t k = first; k <= last && fits; ++k) {
+            rowEntry(k).small(num, den);
+            if (__builtin_mul_overflow(num, scale / den, &Ab64[(size_t)i * (n + 1) + rowCol(k)])) fits = false;
+        }
+        if (!fits && Ab.empty()) { // Redo all rows in BigInt
+            Ab.resize(Ab64.size());
+            for (int r = 0; r < i; ++r) {
+                for (int j = 0; j <= n; ++j) {
+                    if (Ab64[(size_t)r * (n + 1) + j]) Ab[(size_t)r * (n + 1) + j] = BigInt(Ab64[(size_t)r * (n + 1) + j]);
+                }
+            }
+        }
+        if (!fits) {
+            BigInt bigScale(1);
+            for (size_t k = first; k <= last; ++k) {
+                BigInt d = rowEntry(k).denominator();
+                bigScale = bigScale * d / BigInt::gcd(bigScale, d);
+            }
+            for (size_t k = first; k <= last; ++k) {
+                if (!rowEntry(k).isZero()) {
+                    Ab[(size_t)i * (n + 1) + rowCol(k)] = rowEntry(k).numerator() * (bigScale / rowEntry(k).denominator());
+                }
+            }
+        }
+        first = last;
+    }
+
+    std::vector<BigInt> X;
+    BigInt D;
+    int status = fits ? bareissSolve<int64_t>(Ab64, n, X, D) : -1;
+    ExactWidth width = EXACT_INT64;
+    if (status < 0 && maxWidth >= EXACT_INT128) {
+        status = fits ? bareissSolve<__int128>(Ab64, n, X, D) : bareissSolve<__int128>(Ab, n, X, D);
+        width = EXACT_INT128;
+    }
+    if (status < 0 && maxWidth >= EXACT_BIGINT) {
+        status = fits ? bareissSolve<BigInt>(Ab64, n, X, D) : bareissSolve<BigInt>(Ab, n, X, D);
+        width = EXACT_BIGINT;
+    }
+    if (status <= 0) return false;
+    if (used) *used = width;
+    x.resize(n);
+    for (int i = 0; i < n; ++i) x[i] = Rational(X[i], D);
+    return true;
+}
+
+// --- Fixed-Size Dense Solver for Small Systems ---
+
+// Largest system solved by FixedLU. A default 3x3-grid exercise has about 10 unknowns.
+const int FIXED_MAX_SIZE = 16;
+
+// LU with partial pivoting on an N x N system whose size is a template parameter: the
+// matrix lives in std::array on the stack, so there is no allocation, and every loop bound
+// is a constant the compiler can unroll and vectorize against. Each system goes through
+// exactly the operations of LUFactorization / ComplexLUFactorization (same pivots, same
+// singular columns, no FMA); the right-hand side is eliminated along with the matrix,
+// which is the same sequence of operations as their forward substitution. The answers
+// are therefore bit-identical.
+template <int N>
+struct FixedLU {
+    static void solve(const MNASystem<double>& sys, std::vector<double>& x) {
+        std::array<double, N * N> a{};
+        std::array<double, N> b;
+        for (size_t k = 0; k < sys.vals.size(); ++k) a[sys.rows[k] * N + sys.cols[k]] += sys.vals[k];
+        for (int i = 0; i < N; ++i) b[i] = sys.rhs[i];
+
+        for (int i = 0; i < N; ++i) {
+            int pivot = i;
+            double best = std::abs(a[i * N + i]);
+            for (int j = i + 1; j < N; ++j) {
+                double v = std::abs(a[j * N + i]);
+                if (v > best) { best = v; pivot = j; }
+            }
+            if (pivot != i) {
+                for (int k = 0; k < N; ++k) std::swap(a[i * N + k], a[pivot * N + k]);
+                std::swap(b[i], b[pivot]);
+            }
+            if (best < 1e-9) {
+                for (int j = i + 1; j < N; ++j) a[j * N + i] = 0.0;
+                continue;
+            }
+            for (int j = i + 1; j < N; ++j) {
+                double factor = a[j * N + i] / a[i * N + i];
+                if (factor == 0.0) continue;
+                for (int k = i + 1; k < N; ++k) a[j * N + k] -= factor * a[i * N + k];
+                b[j] -= factor * b[i];
+            }
+        }
+
+        x.resize(N);
+        for (int i = N - 1; i >= 0; --i) {
+            double sum = b[i];
+            for (int j = i + 1; j < N; ++j) sum -= a[i * N + j] * x[j];
+            x[i] = (std::abs(a[i * N + i]) > 1e-9) ? sum / a[i * N + i] : 0.0;
+        }
+    }
+
+    // Complex systems on split real and imaginary planes, as ComplexMatrix
+    static void solve(const MNASystem<Complex>& sys, std::vector<Complex>& x) {
+        std::array<double, N * N> re{}, im{};
+        std::array<double, N> bRe, bIm;
+        for (size_t k = 0; k < sys.vals.size(); ++k) {
+            re[sys.rows[k] * N + sys.cols[k]] += sys.vals[k].real;
+            im[sys.rows[k] * N + sys.cols[k]] += sys.vals[k].imag;
+        }
+        for (int i = 0; i < N; ++i) {
+            bRe[i] = sys.rhs[i].real;
+            bIm[i] = sys.rhs[i].imag;
+        }
+
+        auto sq = [](double r, double i) { return r * r + i * i; };
+        for (int i = 0; i < N; ++i) {
+            int pivot = i;
+            double best = sq(re[i * N + i], im[i * N + i]);
+            for (int j = i + 1; j < N; ++j) {
+                double v = sq(re[j * N + i], im[j * N + i]);
+                if (v > best) { best = v; pivot = j; }
+            }
+            if (pivot != i) {
+                for (int k = 0; k < N; ++k) {
+                    std::swap(re[i * N + k], re[pivot * N + k]);
+                    std::swap(im[i * N + k], im[pivot * N + k]);
+                }
+                std::swap(bRe[i], bRe[pivot]);
+                std::swap(bIm[i], bIm[pivot]);
+            }
+            if (best < 1e-24) {
+                for (int j = i + 1; j < N; ++j) re[j * N + i] = im[j * N + i] = 0.0;
+                continue;
+            }
+            // factor = a_ji / a_ii = a_ji * conj(a_ii) / |a_ii|^2
+            double invRe = re[i * N + i] / best, invIm = -im[i * N + i] / best;
+            for (int j = i + 1; j < N; ++j) {
+                double aRe = re[j * N + i], aIm = im[j * N + i];
+                if (aRe == 0.0 && aIm == 0.0) continue;
+                double fRe = aRe * invRe - aIm * invIm;
+                double fIm = aRe * invIm + aIm * invRe;
+                for (int k = i + 1; k < N; ++k) {
+                    double xr = re[i * N + k], xi = im[i * N + k];
+                    re[j * N + k] -= fRe * xr - fIm * xi;
+                    im[j * N + k] -= fRe * xi + fIm * xr;
+                }
+                bRe[j] -= fRe * bRe[i] - fIm * bIm[i];
+                bIm[j] -= fRe * bIm[i] + fIm * bRe[i];
+            }
+        }
+
+        x.resize(N);
+        for (int i = N - 1; i >= 0; --i) {
+            double sRe = bRe[i], sIm = bIm[i];
+            for (int j = i + 1; j < N; ++j) {
+                sRe -= re[i * N + j] * x[j].real - im[i * N + j] * x[j].imag;
+                sIm -= re[i * N + j] * x[j].imag + im[i * N + j] * x[j].real;
+            }
+            double d = sq(re[i * N + i], im[i * N + i]);
+            if (d >= 1e-24) x[i] = Complex((sRe * re[i * N + i] + sIm * im[i * N + i]) / d, (sIm * re[i * N + i] - sRe * im[i * N + i]) / d);
+            else x[i] = Complex(0.0, 0.0);
+        }
+    }
+};
+
+template <class T, int... Ns>
+std::array<void (*)(const MNASystem<T>&, std::vector<T>&), sizeof...(Ns)> fixedSolverTable(std::integer_sequence<int, Ns...>) {
+    return {{&FixedLU<Ns + 1>::solve...}};
+}
+
+// Solve a system of 1..FIXED_MAX_SIZE unknowns with the FixedLU of its size (picked from a
+// table at run time); false for other sizes
+template <class T>
+bool solveFixedSize(const MNASystem<T>& sys, std::vector<T>& x) {
+    static const auto table = fixedSolverTable<T>(std::make_integer_sequence<int, FIXED_MAX_SIZE>());
+    if (sys.n < 1 || sys.n > FIXED_MAX_SIZE) return false;
+    table[sys.n - 1](sys, x);
+    return true;
+}
+
+// --- Batched Dense Solver for Many Small Systems ---
+
+// Systems per block of the batched solver: a block of 3x3-grid DC systems (n ~ 15) is
+// 15 * 15 * 64 doubles = 115 KB, which stays in L2 during the elimination.
+const int BATCH_LANES = 64;
+
+// Structure-of-arrays block of same-size systems: entry (r, c) of every system is one
+// aligned run of `lanes` doubles (lanes = count rounded up to 8), so the elimination is
+// the one-system algorithm with each scalar operation applied across all systems, one
+// SIMD lane per system. Pivoting stays per lane: each system swaps its own rows, and
+// its right-hand side is permuted along with them.
+class BatchedLanes {
+public:
+    int n, lanes;
+
+    BatchedLanes(int size, int count) : n(size), lanes((count + 7) & ~7) {}
+
+    double* entry(AlignedVector& plane, int r, int c) const { return plane.data() + ((size_t)r * n + c) * lanes; }
+    double* rhs(AlignedVector& plane, int r) const { return plane.data() + (size_t)r * lanes; }
+
+    AlignedVector matrixPlane() const { return AlignedVector((size_t)n * n * lanes, 0.0); }
+    AlignedVector vectorPlane() const { return AlignedVector((size_t)n * lanes, 0.0); }
+};
+
+// Factor and solve count <= BATCH_LANES real systems of one size. Each lane goes through
+// exactly the operations LUFactorization performs on that system alone (same pivots,
+// same 1e-9 singular columns, no FMA), so the answers are bit-identical.
+inline void solveDenseBatchBlock(const MNASystem<double>* const* sys, int count, std::vector<double>* out,
+                                 const SimdKernels& kernels) {
+    const BatchedLanes L(sys[0]->n, count);
+    const int n = L.n, lanes = L.lanes;
+    AlignedVector a = L.matrixPlane(), b = L.vectorPlane(), f(lanes), best(lanes);
+    std::vector<int> pivot(lanes);
+
+    for (int s = 0; s < count; ++s) {
+        const MNASystem<double>& m = *sys[s];
+        for (size_t k = 0; k < m.vals.size(); ++k) L.entry(a, m.rows[k], m.cols[k])[s] += m.vals[k];
+        for (int r = 0; r < n; ++r) L.rhs(b, r)[s] = m.rhs[r];
+    }
+
+    for (int i = 0; i < n; ++i) {
+        // Pivoting: search all lanes at once (row by row), then swap in the lanes that need it
+        const double* aii = L.entry(a, i, i);
+        for (int s = 0; s < lanes; ++s) { best[s] = std::abs(aii[s]); pivot[s] = i; }
+        for (int j = i + 1; j < n; ++j) {
+            const double* aji = L.entry(a, j, i);
+            for (int s = 0; s < lanes; ++s) {
+                double v = std::abs(aji[s]);
+                if (v > best[s]) { best[s] = v; pivot[s] = j; }
+            }
+        }
+        for (int s = 0; s < lanes; ++s) {
+            if (pivot[s] == i) continue;
+            for (int c = 0; c < n; ++c) std::swap(L.entry(a, i, c)[s], L.entry(a, pivot[s], c)[s]);
+            std::swap(L.rhs(b, i)[s], L.rhs(b, pivot[s])[s]);
+        }
+
+        for (int j = i + 1; j < n; ++j) {
+            double* aji = L.entry(a, j, i);
+            bool any = false;
+            for (int s = 0; s < lanes; ++s) {
+                f[s] = (best[s] >= 1e-9) ? aji[s] / aii[s] : 0.0;
+                aji[s] = f[s]; // Multipliers (L); zero below a singular pivot
+                any = any || (f[s] != 0.0);
+            }
+            if (!any) continue; // MNA rows are sparse: often no lane has work here
+            for (int k = i + 1; k < n; ++k) kernels.laneAxpy(L.entry(a, j, k), L.entry(a, i, k), f.data(), lanes);
+        }
+    }
+
+    // Forward substitution with the unit lower factor (b is already in pivot order)
+    for (int i = 0; i < n; ++i) {
+        double* bi = L.rhs(b, i);
+        for (int j = 0; j < i; ++j) {
+            const double* aij = L.entry(a, i, j);
+            const double* bj = L.rhs(b, j);
+            for (int s = 0; s < lanes; ++s) bi[s] -= aij[s] * bj[s];
+        }
+    }
+    // Back Substitution
+    for (int i = n - 1; i >= 0; --i) {
+        double* bi = L.rhs(b, i);
+        for (int j = i + 1; j < n; ++j) {
+            const double* aij = L.entry(a, i, j);
+            const double* bj = L.rhs(b, j);
+            for (int s = 0; s < lanes; ++s) bi[s] -= aij[s] * bj[s];
+        }
+        const double* aii = L.entry(a, i, i);
+        for (int s = 0; s < lanes; ++s) bi[s] = (std::abs(aii[s]) > 1e-9) ? bi[s] / aii[s] : 0.0;
+    }
+
+    for (int s = 0; s < count; ++s) {
+        out[s].resize(n);
+        for (int r = 0; r < n; ++r) out[s][r] = L.rhs(b, r)[s];
+    }
+}
+
+// Complex counterpart on split real/imaginary planes, matching ComplexLUFactorization
+// (squared-magnitude pivots, |z| < 1e-12 singular).
+inline void solveDenseBatchBlock(const MNASystem<Complex>* const* sys, int count, std::vector<Complex>* out,
+                                 const SimdKernels& kernels) {
+    const BatchedLanes L(sys[0]->n, count);
+    const int n = L.n, lanes = L.lanes;
+    AlignedVector ar = L.matrixPlane(), ai = L.matrixPlane(), br = L.vectorPlane(), bi = L.vectorPlane();
+    AlignedVector fr(lanes), fi(lanes), invRe(lanes), invIm(lanes), best(lanes);
+    std::vector<int> pivot(lanes);
+
+    for (int s = 0; s < count; ++s) {
+        const MNASystem<Complex>& m = *sys[s];
+        for (size_t k = 0; k < m.vals.size(); ++k) {
+            L.entry(ar, m.rows[k], m.cols[k])[s] += m.vals[k].real;
+            L.entry(ai, m.rows[k], m.cols[k])[s] += m.vals[k].imag;
+        }
+        for (int r = 0; r < n; ++r) {
+            L.rhs(br, r)[s] = m.rhs[r].real;
+            L.rhs(bi, r)[s] = m.rhs[r].imag;
+        }
+    }
+
+    for (int i = 0; i < n; ++i) {
+        // Pivoting: search all lanes at once (row by row), then swap in the lanes that need it
+        {
+            const double* pr = L.entry(ar, i, i);
+            const double* pi = L.entry(ai, i, i);
+            for (int s = 0; s < lanes; ++s) { best[s] = pr[s] * pr[s] + pi[s] * pi[s]; pivot[s] = i; }
+        }
+        for (int j = i + 1; j < n; ++j) {
+            const double* cr = L.entry(ar, j, i);
+            const double* ci = L.entry(ai, j, i);
+            for (int s = 0; s < lanes; ++s) {
+                double v = cr[s] * cr[s] + ci[s] * ci[s];
+                if (v > best[s]) { best[s] = v; pivot[s] = j; }
+            }
+        }
+        for (int s = 0; s < lanes; ++s) {
+            if (pivot[s] == i) continue;
+            for (int c = 0; c < n; ++c) {
+                std::swap(L.entry(ar, i, c)[s], L.entry(ar, pivot[s], c)[s]);
+                std::swap(L.entry(ai, i, c)[s], L.entry(ai, pivot[s], c)[s]);
+            }
+            std::swap(L.rhs(br, i)[s], L.rhs(br, pivot[s])[s]);
+            std::swap(L.rhs(bi, i)[s], L.rhs(bi, pivot[s])[s]);
+        }
+        // invRe/invIm = conj(pivot) / |pivot|^2, or 0 if the column is singular
+        const double* pr = L.entry(ar, i, i);
+        const double* pi = L.entry(ai, i, i);
+        for (int s = 0; s < lanes; ++s) {
+            bool usable = (best[s] >= 1e-24);
+            invRe[s] = usable ? pr[s] / best[s] : 0.0;
+            invIm[s] = usable ? -pi[s] / best[s] : 0.0;
+        }
+
+        for (int j = i + 1; j < n; ++j) {
+            double* ajr = L.entry(ar, j, i);
+            double* aji = L.entry(ai, j, i);
+            bool any = false;
+            for (int s = 0; s < lanes; ++s) {
+                double aRe = ajr[s], aIm = aji[s];
+                if (invRe[s] == 0.0 && invIm[s] == 0.0) {
+                    fr[s] = fi[s] = ajr[s] = aji[s] = 0.0; // Singular column: no elimination
+                } else if (aRe == 0.0 && aIm == 0.0) {
+                    fr[s] = fi[s] = 0.0;
+                } else {
+                    fr[s] = ajr[s] = aRe * invRe[s] - aIm * invIm[s];
+                    fi[s] = aji[s] = aRe * invIm[s] + aIm * invRe[s];
+                    any = true;
+                }
+            }
+            if (!any) continue;
+            for (int k = i + 1; k < n; ++k) {
+                kernels.laneComplexAxpy(L.entry(ar, j, k), L.entry(ai, j, k), L.entry(ar, i, k), L.entry(ai, i, k),
+                                        fr.data(), fi.data(), lanes);
+            }
+        }
+    }
+
+    // Forward substitution with the unit lower factor (b is already in pivot order)
+    for (int i = 0; i < n; ++i) {
+        double* yr = L.rhs(br, i);
+        double* yi = L.rhs(bi, i);
+        for (int j = 0; j < i; ++j) {
+            const double* lr = L.entry(ar, i, j);
+            const double* li = L.entry(ai, i, j);
+            const double* xr = L.rhs(br, j);
+            const double* xi = L.rhs(bi, j);
+            for (int s = 0; s < lanes; ++s) {
+                yr[s] -= lr[s] * xr[s] - li[s] * xi[s];
+                yi[s] -= lr[s] * xi[s] + li[s] * xr[s];
+            }
+        }
+    }
+    // Back Substitution
+    for (int i = n - 1; i >= 0; --i) {
+        double* yr = L.rhs(br, i);
+        double* yi = L.rhs(bi, i);
+        for (int j = i + 1; j < n; ++j) {
+            const double* ur = L.entry(ar, i, j);
+            const double* ui = L.entry(ai, i, j);
+            const double* xr = L.rhs(br, j);
+            const double* xi = L.rhs(bi, j);
+            for (int s = 0; s < lanes; ++s) {
+                yr[s] -= ur[s] * xr[s] - ui[s] * xi[s];
+                yi[s] -= ur[s] * xi[s] + ui[s] * xr[s];
+            }
+        }
+        const double* pr = L.entry(ar, i, i);
+        const double* pi = L.entry(ai, i, i);
+        for (int s = 0; s < lanes; ++s) {
+            double d = pr[s] * pr[s] + pi[s] * pi[s];
+            double sRe = yr[s], sIm = yi[s];
+            yr[s] = (d >= 1e-24) ? (sRe * pr[s] + sIm * pi[s]) / d : 0.0;
+            yi[s] = (d >= 1e-24) ? (sIm * pr[s] - sRe * pi[s]) / d : 0.0;
+        }
+    }
+
+    for (int s = 0; s < count; ++s) {
+        out[s].resize(n);
+        for (int r = 0; r < n; ++r) out[s][r] = Complex(L.rhs(br, r)[s], L.rhs(bi, r)[s]);
+    }
+}
+
+// Solve many small dense systems at once: systems are grouped by size into blocks of up to
+// BATCH_LANES and each block is eliminated together. solutions[k] solves *systems[k].
+template <class T>
+void solveDenseBatch(const std::vector<const MNASystem<T>*>& systems, std::vector<std::vector<T>>& solutions,
+                     const SimdKernels& kernels = bestSimdKernels()) {
+    solutions.assign(systems.size(), std::vector<T>());
+    std::vector<int> order(systems.size());
+    for (size_t k = 0; k < order.size(); ++k) order[k] = (int)k;
+    std::stable_sort(order.begin(), order.end(), [&](int p, int q) { return systems[p]->n < systems[q]->n; });
+
+    std::vector<const MNASystem<T>*> block;
+    std::vector<std::vector<T>> blockOut;
+    for (size_t start = 0; start < order.size();) {
+        int n = systems[order[start]]->n;
+        size_t end = start;
+        while (end < order.size() && end - start < (size_t)BATCH_LANES && systems[order[end]]->n == n) ++end;
+
+        block.clear();
+        for (size_t k = start; k < end; ++k) block.push_back(systems[order[k]]);
+        blockOut.assign(block.size(), std::vector<T>());
+        solveDenseBatchBlock(block.data(), (int)block.size(), blockOut.data(), kernels);
+        for (size_t k = start; k < end; ++k) solutions[order[k]] = std::move(blockOut[k - start]);
+        start = end;
+    }
+}
+
+class Circuit {
+public:
+    std::vector<Point> nodes;
+    std::vector<Component> components;
+    int width, height; // Grid dimensions
+    
+    // Exercise State
+    ExerciseType exerciseType;
+    double omega;              // Angular frequency (rad/s) for AC
+    double frequency;          // Frequency (Hz) for AC
+    std::string sourceWaveform; // "sin" or "cos" for AC exercises
+    int sourceAmplitude;       // Amplitude in Amps (integer value like 1, 2, 5, 10)
+    std::string questionText;
+    
+    std::vector<Component*> targetResistors; // Resistors for power calculation (AC)
+    Component* targetComp;     // Target component for transient analysis (DC)
+    int questionType = -1; // 0=V, 1=I, 2=P, 3=E(Energy), 4=Q(Charge)
+
+    // Every random decision for this exercise is drawn from rng, so (seed, type, size)
+    // identifies the exercise and independent circuits can be generated concurrently.
+    uint64_t seed;
+    Rng rng;
+
+    LinearSolverKind solverKind; // Backend for the MNA systems (see useSparseSolver)
+    bool mixedPrecision;         // Try a single-precision factor with refinement first
+
+    Circuit(int w, int h, uint64_t seed_val = 0) : width(w), height(h), exerciseType(DC_TRANSIENT), 
+                            omega(0), frequency(0), sourceWaveform("sin"), sourceAmplitude(1), targetComp(nullptr),
+                            seed(seed_val), rng(seed_val), solverKind(defaultSolverKind),
+                            mixedPrecision(defaultMixedPrecision) {
+        // Initialize grid nodes
+        nodes.reserve((size_t)w * h);
+        for (int y = 0; y < h; ++y) {
+            for (int x = 0; x < w; ++x) {
+                nodes.push_back({x, y});
+            }
+        }
+    }
+
+    void addComponent(Component c) {
+        components.push_back(std::move(c));
+    }
+    
+    void generateQuestion() {
+        // Find suitable components for questions (R, L, C)
+        std::vector<Component*> targets;
+        for (auto& c : components) {
+            if (c.type == RESISTOR || c.type == CAPACITOR || c.type == INDUCTOR) {
+                targets.push_back(&c);
+            }
+        }
+        
+        if (targets.empty()) {
+            questionText = "Calculate the total power supplied by the sources.";
+            return;
+        }
+        
+        targetComp = targets[rng.below(targets.size())]; // Point to element in vector (WARNING: reallocation invalidates ptr)
+        // Better store index, but vector resizing shouldn't happen after generation.
+        // Actually, let's fix the pointer issue by using index or just ensuring no push_backs happen after.
+        // Let's store pointer, but be careful.
+        
+        // Pick type
+        int type = targetComp->type;
+        std::stringstream ss;
+        
+        if (type == RESISTOR) {
+            questionType = rng.below(3); // 0=V, 1=I, 2=P
+            if (questionType == 0) ss << "Calculate the Voltage (V) across " << targetComp->name << ".";
+            else if (questionType == 1) ss << "Calculate the Current (I) flowing through " << targetComp->name << ".";
+            else ss << "Calculate the Power (P) dissipated by " << targetComp->name << ".";
+        } else if (type == CAPACITOR) {
+            questionType = rng.below(3); // 0=V, 1=Q, 2=E
+            if (questionType == 0) ss << "Calculate the DC Steady State Voltage across " << targetComp->name << ".";
+            else if (questionType == 1) { ss << "Calculate the Charge (Q) stored in " << targetComp->name << " at DC Steady State."; questionType = 4; } // Map to 4 for Q
+            else { ss << "Calculate the Energy (E) stored in " << targetComp->name << " at DC Steady State."; questionType = 3; } // Map to 3 for E
+        } else if (type == INDUCTOR) {
+            questionType = rng.below(3); // 0=I, 1=V(0), 2=E
+            if (questionType == 0) { ss << "Calculate the DC Steady State Current through " << targetComp->name << "."; questionType = 1; } // I
+            else if (questionType == 1) { ss << "Calculate the Voltage across " << targetComp->name << " at DC Steady State."; questionType = 0; } // V (should be 0)
+            else { ss << "Calculate the Energy (E) stored in " << targetComp->name << " at DC Steady State."; questionType = 3; } // E
+        }
+        
+        questionText = ss.str();
+    }
+    
+    // MNA Solver for DC Steady State
+    // switchState: true = initial state (t<0), false = final state (t>0)
+    // killSources: if true, turn off all V/I sources (for Thevenin)
+    // injectCurrent: if > 0, injects this current into targetComp nodes (for Thevenin)
+    std::vector<double> solveMNA(bool switchStateInitial, bool killSources, double injectCurrent = 0.0) {
+        return nodeVoltages(solveSystem(buildMNA(switchStateInitial, killSources, injectCurrent)));
+    }
+
+    // Node voltages (ground included) from the solution of a DC MNA system
+    template <class T>
+    std::vector<T> nodeVoltages(const std::vector<T>& x) const {
+        int numNodes = nodes.size();
+        std::vector<T> V_nodes(numNodes, T(0.0));
+        for(int i=1; i<numNodes; ++i) V_nodes[i] = x[i - 1];
+        return V_nodes;
+    }
+
+    // How a component enters the system being built
+    enum StampRole {
+        ROLE_OPEN,  // Contributes nothing (capacitor in DC, open switch, killed current source)
+        ROLE_SHORT, // Ideal short: its terminals are merged into one node
+        ROLE_STAMP  // Stamped normally
+    };
+
+    // dc = false is the phasor (AC) system, where only wires are shorts and switches are ignored.
+    // probe is a DC inductor kept as a 0 V source so that its current is an unknown.
+    StampRole stampRole(const Component& c, bool dc, bool switchStateInitial, bool killSources,
+                        const Component* probe) const {
+        switch (c.type) {
+            case WIRE: return ROLE_SHORT;
+            case RESISTOR: return ROLE_STAMP;
+            case VOLTAGE_SOURCE: return killSources ? ROLE_SHORT : ROLE_STAMP; // Killed: 0 V
+            case CURRENT_SOURCE: return killSources ? ROLE_OPEN : ROLE_STAMP;  // Killed: 0 A
+            case CAPACITOR: return dc ? ROLE_OPEN : ROLE_STAMP;
+            case INDUCTOR: return (!dc || &c == probe) ? ROLE_STAMP : ROLE_SHORT;
+            case SWITCH: {
+                if (!dc) return ROLE_OPEN;
+                bool isOpen = c.startsOpen;
+                if (!switchStateInitial) isOpen = !isOpen; // Flip state for t>0
+                return isOpen ? ROLE_OPEN : ROLE_SHORT;
+            }
+        }
+        return ROLE_OPEN;
+    }
+
+    // Union-find pre-pass before stamping: nodes joined by ideal shorts are merged, groups that
+    // no stamped component touches are dropped, and the rest are numbered densely with
+    // ground's group as 0. Shorts used to be 1e6 conductances, which inflated the system and
+    // its condition number; untouched grid points used to be empty rows.
+    struct NodeCompaction {
+        std::vector<int> node; // Compact node of each circuit node, -1 if dropped
+        int count;             // Compact nodes, ground included
+    };
+
+    NodeCompaction compactNodes(const std::vector<StampRole>& roles) const {
+        int numNodes = nodes.size();
+        DisjointSet groups(numNodes);
+        std::vector<char> touched(numNodes, 0);
+        for (size_t i = 0; i < components.size(); ++i) {
+            const Component& c = components[i];
+            if (roles[i] == ROLE_SHORT) groups.unite(c.nodeA_idx, c.nodeB_idx);
+            if (roles[i] == ROLE_STAMP) touched[c.nodeA_idx] = touched[c.nodeB_idx] = 1;
+        }
+
+        std::vector<int> groupId(numNodes, -1);
+        int ground = groups.find(0);
+        groupId[ground] = 0;
+        for (int i = 0; i < numNodes; ++i) {
+            if (touched[i]) touched[groups.find(i)] = 1;
+        }
+        NodeCompaction nc;
+        nc.node.assign(numNodes, -1);
+        nc.count = 1;
+        for (int i = 0; i < numNodes; ++i) {
+            int root = groups.find(i);
+            if (groupId[root] < 0 && touched[root]) groupId[root] = nc.count++;
+            nc.node[i] = groupId[root];
+        }
+        return nc;
+    }
+
+    // Unknowns of a compacted system: compact node voltages 1..count-1 (0 is ground), then
+    // one branch current per entry of branchComps. expand maps a solution back to the
+    // circuit's full layout: node voltages 1..N-1, the current of every voltage source, then
+    // the probed inductor's current if there is one (see MNASystem::expand).
+    struct MNALayout {
+        std::vector<StampRole> roles;
+        NodeCompaction nc;
+        std::vector<int> branchComps;
+        std::vector<int> expand;
+
+        int size() const { return nc.count - 1 + (int)branchComps.size(); }
+        int node(int n) const { return nc.node[n] - 1; } // Unknown of circuit node n, -1: ground or dropped
+        int branchRow(size_t b) const { return nc.count - 1 + (int)b; }
+    };
+
+    // opened, if given, is left out of the network (open) whatever its type
+    MNALayout mnaLayout(bool dc, bool switchStateInitial, bool killSources, const Component* probe,
+                        const Component* opened = nullptr) const {
+        int numNodes = nodes.size();
+        MNALayout L;
+        L.roles.resize(components.size());
+        for (size_t i = 0; i < components.size(); ++i) {
+            const Component& c = components[i];
+            L.roles[i] = (&c == opened) ? ROLE_OPEN : stampRole(c, dc, switchStateInitial, killSources, probe);
+        }
+        L.nc = compactNodes(L.roles);
+
+        // Branch unknowns: voltage sources (in component order), then the probed inductor.
+        // A branch whose terminals were merged by a short has no well-defined current; it is left out.
+        std::vector<int> fullBranch; // Position of each branch in the full layout
+        int numAllV = 0;
+        for (size_t i = 0; i < components.size(); ++i) {
+            if (components[i].type != VOLTAGE_SOURCE) continue;
+            const Component& c = components[i];
+            if (L.roles[i] == ROLE_STAMP && L.nc.node[c.nodeA_idx] != L.nc.node[c.nodeB_idx]) {
+                L.branchComps.push_back(i);
+                fullBranch.push_back(numAllV);
+            }
+            numAllV++;
+        }
+        if (probe && L.nc.node[probe->nodeA_idx] != L.nc.node[probe->nodeB_idx]) {
+            L.branchComps.push_back(probe - components.data());
+            fullBranch.push_back(numAllV);
+        }
+
+        L.expand.assign(numNodes - 1 + numAllV + (probe ? 1 : 0), -1);
+        for (int i = 1; i < numNodes; ++i) L.expand[i - 1] = L.node(i);
+        for (size_t b = 0; b < L.branchComps.size(); ++b) L.expand[numNodes - 1 + fullBranch[b]] = L.branchRow(b);
+        return L;
+    }
+
+    // Grid position of every unknown of a compacted system, in half-grid units: a node at its
+    // point (a merged node at the first point of its group), a branch current at the midpoint
+    // of its component. Feeds the geometric nested dissection ordering.
+    template <class T>
+    std::vector<Point> unknownPoints(const MNASystem<T>& sys) const {
+        int numNodes = nodes.size();
+        std::vector<const Component*> branchComps; // Full layout: every V source, then the probe
+        for (const auto& c : components) {
+            if (c.type == VOLTAGE_SOURCE) branchComps.push_back(&c);
+        }
+        if (targetComp) branchComps.push_back(targetComp);
+
+        std::vector<Point> pts(sys.n, Point{0, 0});
+        std::vector<char> placed(sys.n, 0);
+        size_t full = sys.expand.empty() ? (size_t)sys.n : sys.expand.size();
+        for (size_t k = 0; k < full; ++k) {
+            int u = sys.expand.empty() ? (int)k : sys.expand[k];
+            if (u < 0 || placed[u]) continue;
+            if ((int)k < numNodes - 1) {
+                pts[u] = Point{2 * nodes[k + 1].x, 2 * nodes[k + 1].y};
+            } else if (k - (numNodes - 1) < branchComps.size()) {
+                const Component& c = *branchComps[k - (numNodes - 1)];
+                pts[u] = Point{c.pA.x + c.pB.x, c.pA.y + c.pB.y};
+            }
+            placed[u] = 1;
+        }
+        return pts;
+    }
+
+    // Flat recipe for assembling one MNA system, compiled once per layout (DC or AC, switch
+    // state, killed sources, probe, test injection; see stampPlan). Stamp k is matrix entry
+    // (rows[k], cols[k]) with value table[slots[k]], and right-hand-side entry k adds
+    // table[rhsSlots[k]] to rhs[rhsRows[k]], in the order the old component walk stamped
+    // them. The table holds this assembly's values (see dcStampTable, acStampTable), so
+    // re-assembly with new values is a gather with no look at component types.
+    struct StampPlan {
+        int n = 0, branches = 0;
+        std::vector<int> expand;
+        std::vector<int> rows, cols, slots;
+        std::vector<int> rhsRows, rhsSlots;
+
+        template <class T>
+        MNASystem<T> assemble(const std::vector<T>& table) const {
+            MNASystem<T> sys(n);
+            sys.expand = expand;
+            sys.branches = branches;
+            sys.rows = rows;
+            sys.cols = cols;
+            sys.vals.resize(slots.size());
+            for (size_t k = 0; k < slots.size(); ++k) sys.vals[k] = table[slots[k]];
+            for (size_t k = 0; k < rhsSlots.size(); ++k) sys.rhs[rhsRows[k]] = sys.rhs[rhsRows[k]] + table[rhsSlots[k]];
+            return sys;
+        }
+    };
+
+    // Table layout: +1, -1, the injected current and its negation, then the value of
+    // component i at 2 i + SLOT_COMPONENTS and its negation right after
+    enum { SLOT_ONE, SLOT_MINUS_ONE, SLOT_INJECT, SLOT_MINUS_INJECT, SLOT_COMPONENTS };
+
+    static int valueSlot(size_t comp) { return SLOT_COMPONENTS + 2 * (int)comp; }
+    static int negatedSlot(size_t comp) { return SLOT_COMPONENTS + 2 * (int)comp + 1; }
+
+    // Negation as the component walk wrote it (0 - Y for phasors), so assembled systems stay
+    // bit-identical down to the sign of zeros
+    static double negated(double v) { return -v; }
+    static Complex negated(const Complex& v) { return Complex(0, 0) - v; }
+    static Rational negated(const Rational& v) { return -v; }
+
+    StampPlan compileStampPlan(bool dc, bool switchStateInitial, bool killSources, bool inject, bool openTarget = false) const {
+        const Component* probe = (dc && targetComp && targetComp->type == INDUCTOR && !openTarget) ? targetComp : nullptr;
+        MNALayout L = mnaLayout(dc, switchStateInitial, killSources, probe, openTarget ? targetComp : nullptr);
+        StampPlan plan;
+        plan.n = L.size();
+        plan.branches = dc ? (int)L.branchComps.size() : 0;
+        plan.expand = L.expand;
+        auto stamp = [&](int r, int c, int slot) {
+            plan.rows.push_back(r);
+            plan.cols.push_back(c);
+            plan.slots.push_back(slot);
+        };
+        auto source = [&](int r, int slot) {
+            plan.rhsRows.push_back(r);
+            plan.rhsSlots.push_back(slot);
+        };
+
+        // Admittances (DC: resistors; AC: R, L and C) and current sources
+        for (size_t i = 0; i < components.size(); ++i) {
+            const Component& c = components[i];
+            if (L.roles[i] != ROLE_STAMP || c.type == VOLTAGE_SOURCE || (dc && c.type != RESISTOR && c.type != CURRENT_SOURCE)) continue;
+            int nA = L.node(c.nodeA_idx);
+            int nB = L.node(c.nodeB_idx);
+            if (nA == nB) continue; // Both terminals on one node: no current, no stamp
+
+            if (c.type == CURRENT_SOURCE) {
+                if (nA >= 0) source(nA, negatedSlot(i));
+                if (nB >= 0) source(nB, valueSlot(i));
+                continue;
+            }
+            if (nA >= 0) stamp(nA, nA, valueSlot(i));
+            if (nB >= 0) stamp(nB, nB, valueSlot(i));
+            if (nA >= 0 && nB >= 0) {
+                stamp(nA, nB, negatedSlot(i));
+                stamp(nB, nA, negatedSlot(i));
+            }
+        }
+
+        // Test current injection (Thevenin): INTO nA (+I), OUT of nB (-I). The MNA RHS is the
+        // sum of currents entering, so R = (Va - Vb) / I
+        if (dc && inject && targetComp) {
+            int nA = L.node(targetComp->nodeA_idx);
+            int nB = L.node(targetComp->nodeB_idx);
+            if (nA != nB) {
+                if (nA >= 0) source(nA, SLOT_INJECT);
+                if (nB >= 0) source(nB, SLOT_MINUS_INJECT);
+            }
+        }
+
+        // Voltage sources (and the probed inductor as a 0 V source)
+        for (size_t b = 0; b < L.branchComps.size(); ++b) {
+            const Component& c = components[L.branchComps[b]];
+            int row = L.branchRow(b);
+            int nA = L.node(c.nodeA_idx);
+            int nB = L.node(c.nodeB_idx);
+            if (nA >= 0) {
+                stamp(row, nA, SLOT_ONE);
+                stamp(nA, row, SLOT_ONE);
+            }
+            if (nB >= 0) {
+                stamp(row, nB, SLOT_MINUS_ONE);
+                stamp(nB, row, SLOT_MINUS_ONE);
+            }
+            if (c.type == VOLTAGE_SOURCE) source(row, valueSlot(L.branchComps[b]));
+        }
+        return plan;
+    }
+
+    // The plan of a layout, compiled on first use. Values may change between assemblies, the
+    // topology (types, nodes, switches, target) may not. openTarget leaves the target out, as
+    // for its Req (see buildTransientSystems). Like the rest of Circuit, not for concurrent use.
+    const StampPlan& stampPlan(bool dc, bool switchStateInitial, bool killSources, bool inject, bool openTarget = false) const {
+        bool probe = dc && targetComp && targetComp->type == INDUCTOR && !openTarget;
+        int key = (dc ? 1 : 0) | (switchStateInitial ? 2 : 0) | (killSources ? 4 : 0) | (inject ? 8 : 0) | (probe ? 16 : 0) |
+                  (openTarget ? 32 : 0);
+        auto it = stampPlans.find(key);
+        if (it == stampPlans.end()) {
+            it = stampPlans.emplace(key, compileStampPlan(dc, switchStateInitial, killSources, inject, openTarget)).first;
+        }
+        return it->second;
+    }
+    mutable std::map<int, StampPlan> stampPlans; // By layout key (see stampPlan)
+
+    // Values of the DC stamps: conductances and source values
+    template <class T>
+    std::vector<T> dcStampTable(double injectCurrent) const {
+        std::vector<T> table(SLOT_COMPONENTS + 2 * components.size(), T(0.0));
+        table[SLOT_ONE] = T(1.0);
+        table[SLOT_MINUS_ONE] = T(-1.0);
+        table[SLOT_INJECT] = T(injectCurrent);
+        table[SLOT_MINUS_INJECT] = negated(table[SLOT_INJECT]);
+        for (size_t i = 0; i < components.size(); ++i) {
+            table[valueSlot(i)] = dcStampValue<T>(components[i]);
+            table[negatedSlot(i)] = negated(table[valueSlot(i)]);
+        }
+        return table;
+    }
+
+    // Table value of one component in the DC stamps (0 if it has none)
+    template <class T>
+    T dcStampValue(const Component& c) const {
+        if (c.type == RESISTOR) return T(1.0) / T(c.value);
+        if (c.type == VOLTAGE_SOURCE || c.type == CURRENT_SOURCE) return T(c.value);
+        return T(0.0);
+    }
+
+    // Values of the AC stamps at omegaVal: admittances and source phasors (phase 0)
+    std::vector<Complex> acStampTable(double omegaVal) const {
+        std::vector<Complex> table(SLOT_COMPONENTS + 2 * components.size(), Complex(0, 0));
+        table[SLOT_ONE] = Complex(1, 0);
+        table[SLOT_MINUS_ONE] = Complex(-1, 0);
+        for (size_t i = 0; i < components.size(); ++i) {
+            table[valueSlot(i)] = acStampValue(components[i], omegaVal);
+            table[negatedSlot(i)] = negated(table[valueSlot(i)]);
+        }
+        return table;
+    }
+
+    // Table value of one component in the AC stamps at omegaVal (0 if it has none)
+    Complex acStampValue(const Component& c, double omegaVal) const {
+        if (c.type == RESISTOR || c.type == INDUCTOR || c.type == CAPACITOR) return admittance(c, omegaVal);
+        if (c.type == VOLTAGE_SOURCE || c.type == CURRENT_SOURCE) return Complex(c.value, 0);
+        return Complex(0, 0);
+    }
+
+    // Assemble the DC MNA system on the compacted nodes (see mnaLayout). An inductor target
+    // is a 0 V source so that its current is an unknown (see probeCurrent), unless openTarget
+    // removes it. T = Rational gives the exact stamps (see solveTransientExact).
+    template <class T = double>
+    MNASystem<T> buildMNA(bool switchStateInitial, bool killSources, double injectCurrent = 0.0, bool openTarget = false) const {
+        return stampPlan(true, switchStateInitial, killSources, injectCurrent != 0.0, openTarget)
+            .assemble(dcStampTable<T>(injectCurrent));
+    }
+
+    // Position of the inductor target's current in the full DC layout (see buildMNA)
+    int probeCurrent() const {
+        int numV = 0;
+        for (const auto& c : components) {
+            if (c.type == VOLTAGE_SOURCE) numV++;
+        }
+        return (int)nodes.size() - 1 + numV;
+    }
+
+    // Helper to get voltage/current of target from a DC solution in the full layout
+    template <class T>
+    T getComponentValue(const std::vector<T>& x, const Component* target, bool isInductor) const {
+         if (isInductor) {
+             // The inductor is a DC short stamped as a 0 V source: its branch current is an unknown
+             return x[probeCurrent()];
+         }
+         // Capacitor -> V
+         std::vector<T> V_nodes = nodeVoltages(x);
+         return V_nodes[target->nodeA_idx] - V_nodes[target->nodeB_idx];
+    }
+
+    struct TransientResult {
+        double initialVal;
+        double finalVal;
+        double tau;
+        std::vector<std::string> steps; // Worked reduction steps (see reduceTransient), empty after MNA
+    };
+
+    // The three DC systems behind solveTransient(), in order: initial state (t < 0),
+    // final state (t = inf), and the network seen by the target for Req.
+    template <class T = double>
+    std::vector<MNASystem<T>> buildTransientSystems() const {
+        std::vector<MNASystem<T>> systems;
+
+        // 1. Initial State (t < 0)
+        // Switch is in 'startsOpen' state.
+        systems.push_back(buildMNA<T>(true, false));
+        
+        // 2. Final State (t = inf)
+        // Switch is in '!startsOpen' state.
+        systems.push_back(buildMNA<T>(false, false));
+        
+        // 3. Time Constant (Tau)
+        // State: t > 0 (Final State switch)
+        // Sources: Killed.
+        // Component: Removed (Open).
+        // Injection: 1A at component terminals.
+        // Req = V_terminals / 1A.
+        
+        // When calculating Req seen by L/C, the L/C itself must be removed from the circuit:
+        // buildMNA() treats a capacitor as open but an inductor as a short, so the target is
+        // opened explicitly.
+        systems.push_back(buildMNA<T>(false, true, 1.0, true)); // t>0 switch, kill sources, inject 1A
+        return systems;
+    }
+
+    // Initial value, final value and tau from the solutions of buildTransientSystems()
+    TransientResult transientFromSolutions(const std::vector<std::vector<double>>& x) {
+        bool isInductor = (targetComp->type == INDUCTOR);
+
+        double valInit = getComponentValue(x[0], targetComp, isInductor);
+        double valFinal = getComponentValue(x[1], targetComp, isInductor);
+        
+        std::vector<double> vNodesReq = nodeVoltages(x[2]);
+        double vTh = vNodesReq[targetComp->nodeA_idx] - vNodesReq[targetComp->nodeB_idx];
+        double Req = std::abs(vTh / 1.0);
+        
+        return {valInit, valFinal, timeConstant(Req), {}};
+    }
+
+    double timeConstant(double Req) const {
+        if (targetComp->type == INDUCTOR) {
+            // L / R
+            // targetComp->value is mH -> 1e-3 H
+            return (targetComp->value * 1e-3) / Req;
+        }
+        // R * C
+        // targetComp->value is uF -> 1e-6 F
+        return Req * (targetComp->value * 1e-6);
+    }
+
+    // Network seen at a set of ports, each the terminals of a component removed from the
+    // circuit (an energy-storage element, a load), with every independent source killed.
+    // Z[p * size + q] is the voltage across port p (nodeA - nodeB) per ampere driven into
+    // nodeA of port q and out of its nodeB: Z[p * size + p] is the Thevenin impedance of port
+    // p and the diagonal holds Req for each dynamic element. Y = Z^-1 holds the short-circuit
+    // (Norton) admittances, when Z is invertible.
+    template <class T>
+    struct MultiPort {
+        int size = 0;
+        std::vector<T> Z, Y;
+        bool hasY = false;
+    };
+
+    // DC ports with the switches in the given state (inductors not among the ports are shorts)
+    bool dcMultiPort(const std::vector<const Component*>& ports, bool switchStateInitial, MultiPort<double>& out) const {
+        return multiPort(ports, true, switchStateInitial, dcStampTable<double>(0.0), out);
+    }
+
+    // AC ports at the circuit's omega
+    bool acMultiPort(const std::vector<const Component*>& ports, MultiPort<Complex>& out) const {
+        return multiPort(ports, false, false, acStampTable(omega), out);
+    }
+
+    // Nodal admittances with the port terminals ordered last, reduced onto them by a Schur
+    // complement S = A_TT - A_TI A_II^-1 A_IT: one sparse factorization of the interior, one
+    // substitution per terminal, then dense k x k work on S. False if a port terminal floats
+    // (no component left on it, or on an island with no path to ground).
+    template <class T>
+    bool multiPort(const std::vector<const Component*>& ports, bool dc, bool switchStateInitial,
+                   const std::vector<T>& table, MultiPort<T>& out) const {
+        int k = (int)ports.size();
+        std::vector<StampRole> roles(components.size());
+        for (size_t i = 0; i < components.size(); ++i) {
+            roles[i] = stampRole(components[i], dc, switchStateInitial, true, nullptr);
+        }
+        for (const Component* p : ports) roles[p - components.data()] = ROLE_OPEN;
+        NodeCompaction nc = compactNodes(roles);
+
+        // Unknowns are compact nodes 1..count-1; the port terminals among them come first in
+        // their own numbering, the rest are interior
+        int n = nc.count - 1;
+        std::vector<int> terminal(n, -1), interior(n, -1);
+        std::vector<std::pair<int, int>> portUnknowns; // -1: ground
+        int m = 0;
+        for (const Component* p : ports) {
+            int a = nc.node[p->nodeA_idx], b = nc.node[p->nodeB_idx];
+            if (a < 0 || b < 0) return false;
+            for (int u : {a - 1, b - 1}) {
+                if (u >= 0 && terminal[u] < 0) terminal[u] = m++;
+            }
+            portUnknowns.push_back(std::make_pair(a - 1, b - 1));
+        }
+        int ni = 0;
+        for (int u = 0; u < n; ++u) {
+            if (terminal[u] < 0) interior[u] = ni++;
+        }
+
+        // Admittance stamps split into the four blocks
+        MNASystem<T> inner(ni);
+        std::vector<std::vector<T>> innerByTerminal(m, std::vector<T>(ni, T(0.0))); // Columns of A_IT
+        std::vector<std::pair<std::pair<int, int>, T>> terminalByInner;             // Entries of A_TI
+        std::vector<T> S(m * m, T(0.0));                                            // A_TT, then the Schur complement
+        auto stamp = [&](int r, int c, const T& v) {
+            if (r < 0 || c < 0) return;
+            if (terminal[r] >= 0 && terminal[c] >= 0) S[terminal[r] * m + terminal[c]] = S[terminal[r] * m + terminal[c]] + v;
+            else if (terminal[r] >= 0) terminalByInner.push_back(std::make_pair(std::make_pair(terminal[r], interior[c]), v));
+            else if (terminal[c] >= 0) innerByTerminal[terminal[c]][interior[r]] = innerByTerminal[terminal[c]][interior[r]] + v;
+            else inner.add(interior[r], interior[c], v);
+        };
+        for (size_t i = 0; i < components.size(); ++i) {
+            const Component& c = components[i];
+            if (roles[i] != ROLE_STAMP || c.type == VOLTAGE_SOURCE || c.type == CURRENT_SOURCE) continue;
+            if (dc && c.type != RESISTOR) continue;
+            int nA = nc.node[c.nodeA_idx] - 1;
+            int nB = nc.node[c.nodeB_idx] - 1;
+            if (nA == nB) continue;
+            const T& y = table[valueSlot(i)];
+            stamp(nA, nA, y);
+            stamp(nB, nB, y);
+            stamp(nA, nB, negated(y));
+            stamp(nB, nA, negated(y));
+        }
+
+        if (ni > 0 && m > 0) {
+            SparseMatrix<T> A = SparseMatrix<T>::fromSystem(inner);
+            SparseLU<T> lu;
+            lu.factor(A, minimumDegreeOrdering(A.symmetricAdjacency()));
+            for (int j = 0; j < m; ++j) {
+                std::vector<T> w = lu.solve(innerByTerminal[j]);
+                for (const auto& e : terminalByInner) {
+                    S[e.first.first * m + j] = S[e.first.first * m + j] - e.second * w[e.first.second];
+                }
+            }
+        }
+
+        // Z column q: terminal voltages for 1 A through port q, checked against S since a
+        // singular S (a floating terminal) still yields some solution
+        out.size = k;
+        out.Z.assign(k * k, T(0.0));
+        out.Y.clear();
+        out.hasY = false;
+        auto lu = denseFactor(S, m);
+        double scale = 0.0;
+        for (const T& v : S) scale = std::max(scale, magSq(v));
+        for (int q = 0; q < k; ++q) {
+            std::vector<T> b(m, T(0.0));
+            int a = portUnknowns[q].first, bb = portUnknowns[q].second;
+            if (a == bb) continue; // Terminals shorted together: no voltage across the port
+            if (a >= 0) b[terminal[a]] = T(1.0);
+            if (bb >= 0) b[terminal[bb]] = T(-1.0);
+            std::vector<T> v = lu.solve(b);
+            double vMax = 0.0;
+            for (const T& x : v) vMax = std::max(vMax, magSq(x));
+            for (int r = 0; r < m; ++r) {
+                T res = b[r];
+                for (int c = 0; c < m; ++c) res = res - S[r * m + c] * v[c];
+                if (magSq(res) > 1e-18 * (1.0 + scale * vMax)) return false;
+            }
+            for (int p = 0; p < k; ++p) {
+                int pa = portUnknowns[p].first, pb = portUnknowns[p].second;
+                T va = pa >= 0 ? v[terminal[pa]] : T(0.0);
+                T vb = pb >= 0 ? v[terminal[pb]] : T(0.0);
+                out.Z[p * k + q] = va - vb;
+            }
+        }
+
+        // Y = Z^-1, kept only if Z Y = I holds
+        auto zlu = denseFactor(out.Z, k);
+        std::vector<T> Y(k * k);
+        for (int q = 0; q < k; ++q) {
+            std::vector<T> e(k, T(0.0));
+            e[q] = T(1.0);
+            std::vector<T> y = zlu.solve(e);
+            for (int p = 0; p < k; ++p) Y[p * k + q] = y[p];
+        }
+        for (int p = 0; p < k; ++p) {
+            for (int q = 0; q < k; ++q) {
+                T r = (p == q) ? T(1.0) : T(0.0);
+                for (int j = 0; j < k; ++j) r = r - out.Z[p * k + j] * Y[j * k + q];
+                if (magSq(r) > 1e-18) return true;
+            }
+        }
+        out.Y = std::move(Y);
+        out.hasY = true;
+        return true;
+    }
+
+    // Dense factorization of a row-major m x m block (see multiPort)
+    static LUFactorization denseFactor(const std::vector<double>& M, int m) {
+        Matrix A(m, m);
+        for (int r = 0; r < m; ++r) {
+            for (int c = 0; c < m; ++c) A.at(r, c) = M[r * m + c];
+        }
+        return LUFactorization(std::move(A));
+    }
+
+    static ComplexLUFactorization denseFactor(const std::vector<Complex>& M, int m) {
+        ComplexMatrix A(m, m);
+        for (int r = 0; r < m; ++r) {
+            for (int c = 0; c < m; ++c) A.add(r, c, M[r * m + c]);
+        }
+        return ComplexLUFactorization(std::move(A));
+    }
+
+    // One DC network seen by the target, reduced by series-parallel and Y-Delta steps (see
+    // ReductionNetwork) with the target removed. With sources, value is the target's v_C
+    // (open) or i_L (short); with killSources, it is the resistance between its terminals.
+    // The worked steps are appended to steps if given. False if the network does not reduce
+    // or the answer is not well defined: shorted or floating terminals, loops of voltage sources.
+    // ties and net are workspace.
+    bool reduceSeenByTarget(bool switchStateInitial, bool killSources, const char* phase, double& value,
+                            std::vector<std::string>* steps, PotentialTies& ties, ReductionNetwork& net) const {
+        int numNodes = nodes.size();
+        bool isInductor = (targetComp->type == INDUCTOR);
+        std::vector<StampRole> roles(components.size());
+        for (size_t i = 0; i < components.size(); ++i) {
+            roles[i] = stampRole(components[i], true, switchStateInitial, killSources, nullptr);
+        }
+
+        static thread_local std::ostringstream text; // One stream for every step
+        text.str("");
+        auto addStep = [&]() {
+            steps->push_back(text.str());
+            text.str("");
+        };
+
+        // Shorts and ideal voltage sources tie node potentials first: v_A = v_B + E
+        ties.reset(numNodes);
+        for (size_t i = 0; i < components.size(); ++i) {
+            const Component& c = components[i];
+            if (&c == targetComp) continue;
+            bool source = (roles[i] == ROLE_STAMP && c.type == VOLTAGE_SOURCE);
+            if (roles[i] != ROLE_SHORT && !source) continue;
+            if (!ties.tie(c.nodeA_idx, c.nodeB_idx, source ? c.value : 0.0)) return false;
+            if (source && steps) {
+                text << phase << ": " << c.name << " fixes N" << c.nodeA_idx << " = N" << c.nodeB_idx << " + " << c.value << " V";
+                addStep();
+            }
+        }
+
+        // A resistor between tied groups carries a fixed current g (offset_A - offset_B) on
+        // top of g (v_rootA - v_rootB); current sources inject at their roots
+        net.reset(numNodes, steps != nullptr);
+        for (size_t i = 0; i < components.size(); ++i) {
+            const Component& c = components[i];
+            if (&c == targetComp || roles[i] != ROLE_STAMP) continue;
+            int rA = ties.find(c.nodeA_idx), rB = ties.find(c.nodeB_idx);
+            if (c.type == CURRENT_SOURCE) {
+                net.injectCurrent(rA, -c.value);
+                net.injectCurrent(rB, c.value);
+            } else if (c.type == RESISTOR && rA != rB) {
+                double g = 1.0 / c.value;
+                double fixed = g * (ties.potential(c.nodeA_idx) - ties.potential(c.nodeB_idx));
+                net.injectCurrent(rA, -fixed);
+                net.injectCurrent(rB, fixed);
+                net.addBranch(rA, rB, g, (int)i);
+            }
+        }
+
+        int a = ties.find(targetComp->nodeA_idx), b = ties.find(targetComp->nodeB_idx);
+        if (a == b) return false;
+        double oa = ties.potential(targetComp->nodeA_idx), ob = ties.potential(targetComp->nodeB_idx);
+        net.keep(a);
+        net.keep(b);
+        if (!killSources) net.keep(0);
+        bool reduced = net.reduce();
+        if (steps) {
+            auto name = [&](int i) { return components[i].name; };
+            for (const auto& st : net.steps) {
+                text << phase << ": ";
+                ReductionNetwork::describe(text, st, name);
+                addStep();
+            }
+        }
+        if (!reduced) return false;
+
+        if (killSources) {
+            // Only the branch between the terminals is left
+            double g = net.conductance(a, b);
+            if (!(g > 0.0)) return false;
+            value = 1.0 / g;
+            if (steps) {
+                text << phase << ": Rth = " << value << " Ohm, tau = " << (isInductor ? "L / Rth" : "Rth C")
+                     << " = " << timeConstant(value) << " s";
+                addStep();
+            }
+            return true;
+        }
+
+        // Nodal equations of what is left: a, b and ground, v_0 = 0
+        double gab = net.conductance(a, b), ga0 = net.conductance(a, 0), gb0 = net.conductance(b, 0);
+        double Ia = net.current(a), Ib = net.current(b);
+        double scale = gab + ga0 + gb0;
+        if (!(scale > 0.0)) return false;
+        if (!isInductor) {
+            double va = 0.0, vb = 0.0;
+            if (b == 0) {
+                if (!(gab > 0.0)) return false;
+                va = Ia / gab;
+            } else if (a == 0) {
+                if (!(gab > 0.0)) return false;
+                vb = Ib / gab;
+            } else {
+                double det = (ga0 + gab) * (gb0 + gab) - gab * gab;
+                if (!(det > 1e-12 * scale * scale)) return false;
+                va = (Ia * (gb0 + gab) + gab * Ib) / det;
+                vb = (Ib * (ga0 + gab) + gab * Ia) / det;
+            }
+            value = (va + oa) - (vb + ob);
+            if (steps) text << phase << ": v_C = " << value << " V";
+        } else {
+            // The inductor shorts the terminals, v_a + oa = v_b + ob, and carries i_L from A to B.
+            // With a terminal on ground, gab is the one branch left (the same as ga0 or gb0).
+            if (b == 0) {
+                value = Ia - gab * (ob - oa);
+            } else if (a == 0) {
+                value = gab * (oa - ob) - Ib;
+            } else {
+                if (!(ga0 + gb0 > 1e-12 * scale)) return false;
+                double va = (Ia + Ib - gb0 * (oa - ob)) / (ga0 + gb0);
+                double vb = va + oa - ob;
+                value = Ia - ga0 * va - gab * (va - vb);
+            }
+            if (steps) text << phase << ": i_L = " << value << " A";
+        }
+        if (steps) addStep();
+        return true;
+    }
+
+    // The transient answer by network reduction instead of MNA: initial and final values and
+    // the Thevenin resistance seen by the target, with the worked steps unless withSteps is
+    // false. False, for the caller to solve the MNA systems, if any of the three networks
+    // does not reduce.
+    bool reduceTransient(TransientResult& result, bool withSteps = true) const {
+        if (!targetComp || (targetComp->type != CAPACITOR && targetComp->type != INDUCTOR)) return false;
+        double Req = 0.0;
+        std::vector<std::string>* steps = withSteps ? &result.steps : nullptr;
+        result.steps.clear();
+        static thread_local PotentialTies ties; // Workspace, kept between exercises
+        static thread_local ReductionNetwork net;
+        if (!reduceSeenByTarget(true, false, "t<0", result.initialVal, steps, ties, net) ||
+            !reduceSeenByTarget(false, false, "t>0", result.finalVal, steps, ties, net) ||
+            !reduceSeenByTarget(false, true, "t>0, sources off", Req, steps, ties, net)) {
+            result.steps.clear();
+            return false;
+        }
+        result.tau = timeConstant(Req);
+        return true;
+    }
+
+    // The DC answer: by reduction when the network allows it (automatic backend only),
+    // otherwise from the MNA systems
+    TransientResult solveTransient() {
+        if (!targetComp) return {0, 0, 0, {}};
+        TransientResult reduced;
+        if (solverKind == SOLVER_AUTO && reduceTransient(reduced)) return reduced;
+        
+        // A repeated solve of a known state only substitutes (see cachedFactorization)
+        std::vector<std::vector<uint64_t>> keys = transientStateKeys();
+        std::vector<std::vector<double>> x;
+        for (const auto& sys : buildTransientSystems()) {
+            // The final state differs from the initial one by a switch: warm start from it
+            x.push_back(solveCached(sys, keys[x.size()], x.size() == 1 ? &x[0] : nullptr));
+        }
+        return transientFromSolutions(x);
+    }
+
+    // Exact answers of a DC exercise, as fractions of the component values
+    struct ExactTransient {
+        Rational initialVal;
+        Rational finalVal;
+        Rational tau;      // In seconds
+        bool hasTau = false;            // False when Req is 0 (inductor across a short)
+        ExactWidth width = EXACT_INT64; // Widest integer type the solves needed
+    };
+
+    // The DC answer in exact arithmetic: the systems of buildTransientSystems() with rational
+    // stamps, solved by fraction-free elimination (see solveExact) in integers no wider than
+    // maxWidth. False if a system is singular or needs more than maxWidth.
+    bool solveTransientExact(ExactTransient& result, ExactWidth maxWidth = EXACT_BIGINT) {
+        if (!targetComp) return false;
+        bool isInductor = (targetComp->type == INDUCTOR);
+        std::vector<std::vector<Rational>> x;
+        result.width = EXACT_INT64;
+        for (const auto& sys : buildTransientSystems<Rational>()) {
+            std::vector<Rational> xs;
+            ExactWidth used;
+            if (!solveExact(sys, xs, maxWidth, &used)) return false;
+            result.width = std::max(result.width, used);
+            x.push_back(sys.expanded(xs));
+        }
+        result.initialVal = getComponentValue(x[0], targetComp, isInductor);
+        result.finalVal = getComponentValue(x[1], targetComp, isInductor);
+
+        std::vector<Rational> vNodesReq = nodeVoltages(x[2]);
+        Rational Req = vNodesReq[targetComp->nodeA_idx] - vNodesReq[targetComp->nodeB_idx];
+        if (Req.isNegative()) Req = -Req;
+        result.hasTau = !(isInductor && Req.isZero());
+        if (isInductor) result.tau = result.hasTau ? Rational(targetComp->value) / Rational(1000.0) / Req : Rational(0.0);
+        else result.tau = Req * Rational(targetComp->value) / Rational(1000000.0);
+        return true;
+    }
+
+    // ============ AC Analysis Methods ============
+    
+    struct ACResult {
+        std::map<std::string, double> avgPower;  // resistor name -> power (W)
+        double powerFactor;
+        bool hasPowerFactor;  // true if single source exists
+    };
+    
+    // Calculate impedance in phasor domain
+    Complex calculateImpedance(const Component& c, double omega_val) const {
+        if (c.type == RESISTOR) {
+            return Complex(c.value, 0);  // Z = R
+        } else if (c.type == INDUCTOR) {
+            // Z = jωL, L in mH -> H
+            double L_henry = c.value * 1e-3;
+            return Complex(0, omega_val * L_henry);  // jωL
+        } else if (c.type == CAPACITOR) {
+            // Z = 1/(jωC) = -j/(ωC), C in µF -> F
+            double C_farad = c.value * 1e-6;
+            return Complex(0, -1.0 / (omega_val * C_farad));  // -j/(ωC)
+        }
+        return Complex(0, 0);
+    }
+    
+    // Solve an assembled MNA system: dense elimination for small systems, banded LU for
+    // medium ones, sparse LU with minimum degree ordering for large ones, and PCG for large
+    // DC systems. useSparseSolver() is true for every backend but dense elimination.
+    bool useSparseSolver(int n) const {
+        if (solverKind == SOLVER_SPARSE || solverKind == SOLVER_ITERATIVE || solverKind == SOLVER_BANDED ||
+            solverKind == SOLVER_NESTED || solverKind == SOLVER_BLOCKS) return true;
+        if (solverKind == SOLVER_DENSE) return false;
+        return n >= SPARSE_MIN_SIZE;
+    }
+
+    bool useBandedSolver(int n) const {
+        if (solverKind == SOLVER_BANDED) return true;
+        return solverKind == SOLVER_AUTO && n >= SPARSE_MIN_SIZE && n < BANDED_MAX_SIZE;
+    }
+
+    // Mixed precision covers the sparse backends and dense systems large enough for BlockedLU
+    bool useMixedPrecision(int n) const {
+        return mixedPrecision && (useSparseSolver(n) || n >= BLOCKED_LU_MIN_SIZE);
+    }
+
+    bool useIterativeSolver(int n) const {
+        if (solverKind == SOLVER_ITERATIVE) return true;
+        return solverKind == SOLVER_AUTO && n >= ITERATIVE_MIN_SIZE;
+    }
+
+    // Sparse LU with the ordering of the selected backend
+    template <class T>
+    std::vector<T> solveSparse(const MNASystem<T>& sys) const {
+        if (solverKind != SOLVER_NESTED) return solveSparseSystem(sys);
+        std::vector<Point> pts = unknownPoints(sys);
+        return solveSparseSystem(sys, &pts);
+    }
+
+    // The solution is returned in the circuit's full layout (sys.expanded). guess is an
+    // optional starting point for the iterative solver, in the same layout.
+    std::vector<double> solveSystem(const MNASystem<double>& sys, const std::vector<double>* guess = nullptr) const {
+        if (useIterativeSolver(sys.n)) {
+            std::vector<double> x;
+            if (guess) x = sys.compacted(*guess);
+            if (solveNodalPCG(sys, x)) return sys.expanded(x);
+        }
+        if (useMixedPrecision(sys.n)) {
+            std::vector<double> x;
+            if (solveMixedPrecision(sys, x, !useSparseSolver(sys.n))) return sys.expanded(x);
+        }
+        if (solverKind == SOLVER_BLOCKS) {
+            std::vector<double> x;
+            if (solveByBlocks(sys, x)) return sys.expanded(x);
+        }
+        if (useBandedSolver(sys.n)) return sys.expanded(solveBandedSystem(sys));
+        if (useSparseSolver(sys.n)) return sys.expanded(solveSparse(sys));
+        std::vector<double> x;
+        if (solveFixedSize(sys, x)) return sys.expanded(x);
+        return sys.expanded(Matrix::solve(denseMatrix(sys), sys.rhs));
+    }
+
+    std::vector<Complex> solveSystem(const MNASystem<Complex>& sys) const {
+        if (useMixedPrecision(sys.n)) {
+            std::vector<Complex> x;
+            if (solveMixedPrecision(sys, x, !useSparseSolver(sys.n))) return sys.expanded(x);
+        }
+        if (solverKind == SOLVER_BLOCKS) {
+            std::vector<Complex> x;
+            if (solveByBlocks(sys, x)) return sys.expanded(x);
+        }
+        if (useBandedSolver(sys.n)) return sys.expanded(solveBandedSystem(sys));
+        if (useSparseSolver(sys.n)) return sys.expanded(solveSparse(sys));
+        std::vector<Complex> x;
+        if (solveFixedSize(sys, x)) return sys.expanded(x);
+        return sys.expanded(ComplexMatrix::solve(denseMatrix(sys), sys.rhs));
+    }
+    
+    // A DC matrix factored by the direct backend solveSystem() would pick, as a solve of any
+    // right-hand side (compacted layout). Empty for backends with no factorization to keep
+    // (PCG, mixed precision, blocks) and for systems small enough for FixedLU, which solves
+    // them faster than a cache lookup.
+    typedef std::function<std::vector<double>(const std::vector<double>&)> FactoredSolve;
+
+    FactoredSolve factorSystem(const MNASystem<double>& sys) const {
+        if (useIterativeSolver(sys.n) || useMixedPrecision(sys.n) || solverKind == SOLVER_BLOCKS) return FactoredSolve();
+        if (useBandedSolver(sys.n) || useSparseSolver(sys.n)) {
+            SparseMatrix<double> A = SparseMatrix<double>::fromSystem(sys);
+            if (useBandedSolver(sys.n)) {
+                auto lu = std::make_shared<BandedLU<double>>();
+                lu->factor(A, reverseCuthillMcKee(A.symmetricAdjacency()));
+                return [lu](const std::vector<double>& b) { return lu->solve(b); };
+            }
+            auto lu = std::make_shared<SparseLU<double>>();
+            if (solverKind == SOLVER_NESTED) {
+                std::vector<Point> pts = unknownPoints(sys);
+                lu->factor(A, nestedDissectionOrdering(A.symmetricAdjacency(), &pts));
+            } else {
+                lu->factor(A, minimumDegreeOrdering(A.symmetricAdjacency()));
+            }
+            return [lu](const std::vector<double>& b) { return lu->solve(b); };
+        }
+        if (sys.n <= FIXED_MAX_SIZE) return FactoredSolve();
+        if (sys.n >= BLOCKED_LU_MIN_SIZE) {
+            auto lu = std::make_shared<BlockedLU<double>>(denseMatrix(sys));
+            return [lu](const std::vector<double>& b) { return lu->solve(b); };
+        }
+        auto lu = std::make_shared<LUFactorization>(denseMatrix(sys));
+        return [lu](const std::vector<double>& b) { return lu->solve(b); };
+    }
+
+    // Topology state of a DC layout: two bits per component for its role (see stampRole), so
+    // switch positions, killed sources and an opened or probed target all show. Current
+    // sources count too: they never reach the matrix, but a node only they touch is dropped
+    // once they are killed (see compactNodes).
+    std::vector<uint64_t> topologyKey(bool switchStateInitial, bool killSources, const Component* opened) const {
+        const Component* probe = (targetComp && targetComp->type == INDUCTOR && targetComp != opened) ? targetComp : nullptr;
+        std::vector<uint64_t> key((components.size() + 31) / 32, 0);
+        for (size_t i = 0; i < components.size(); ++i) {
+            const Component& c = components[i];
+            uint64_t role = (&c == opened) ? ROLE_OPEN : stampRole(c, true, switchStateInitial, killSources, probe);
+            key[i / 32] |= role << (2 * (i % 32));
+        }
+        return key;
+    }
+
+    // Factorizations of the DC matrices solved so far, most recently used first. A hit needs
+    // the same topology state, stamped values and backend, so edited values refactor.
+    struct CachedFactorization {
+        std::vector<uint64_t> key; // See topologyKey
+        int n;
+        std::vector<double> vals;  // The stamps it factors
+        LinearSolverKind kind;
+        bool mixed;
+        FactoredSolve solve;
+    };
+    mutable std::list<CachedFactorization> factorizations;
+
+    // Factorization of sys (in topology state key) from the cache, factored on a miss.
+    // Empty if the backend keeps none (see factorSystem).
+    FactoredSolve cachedFactorization(const MNASystem<double>& sys, const std::vector<uint64_t>& key) const {
+        for (auto it = factorizations.begin(); it != factorizations.end(); ++it) {
+            if (it->key != key || it->n != sys.n || it->vals != sys.vals || it->kind != solverKind || it->mixed != mixedPrecision) continue;
+            factorizations.splice(factorizations.begin(), factorizations, it);
+            return it->solve;
+        }
+        FactoredSolve solve = factorSystem(sys);
+        if (!solve) return solve;
+        factorizations.push_front({key, sys.n, sys.vals, solverKind, mixedPrecision, solve});
+        if ((int)factorizations.size() > FACTORIZATION_CACHE_SIZE) factorizations.pop_back();
+        return solve;
+    }
+
+    // solveSystem() through the factorization cache: a known state costs a pair of
+    // triangular solves
+    std::vector<double> solveCached(const MNASystem<double>& sys, const std::vector<uint64_t>& key,
+                                    const std::vector<double>* guess = nullptr) const {
+        FactoredSolve solve = cachedFactorization(sys, key);
+        if (!solve) return solveSystem(sys, guess);
+        return sys.expanded(solve(sys.rhs));
+    }
+
+    // Y = 1/Z of an R, L or C at omega_val (0 if the impedance vanishes)
+    Complex admittance(const Component& c, double omega_val) const {
+        Complex Z = calculateImpedance(c, omega_val);
+        if (Z.magnitude() > 1e-12) return Complex(1, 0) / Z;
+        return Complex(0, 0);
+    }
+
+    // Phasor MNA system at the circuit's omega: node voltages, then V-source branch currents
+    MNASystem<Complex> buildACMNA() const {
+        return buildACMNA(omega);
+    }
+
+    MNASystem<Complex> buildACMNA(double omegaVal) const {
+        return stampPlan(false, false, false, false).assemble(acStampTable(omegaVal));
+    }
+    
+    // Solve AC circuit using complex MNA
+    ACResult solveAC() {
+        return acFromSolution(solveSystem(buildACMNA()));
+    }
+
+    // Average powers and power factor from the solution of buildACMNA()
+    ACResult acFromSolution(const std::vector<Complex>& x) const {
+        ACResult result;
+        result.hasPowerFactor = false;
+        result.powerFactor = 0.0;
+        
+        int numNodes = nodes.size();
+        
+        // Count independent sources
+        int numSources = 0;
+        for(size_t i=0; i<components.size(); ++i) {
+            if(components[i].type == VOLTAGE_SOURCE || components[i].type == CURRENT_SOURCE) {
+                numSources++;
+            }
+        }
+        
+        // Check if we have exactly one source for power factor
+        result.hasPowerFactor = (numSources == 1);
+        
+        auto getIdx = [](int n) { return n - 1; };
+        
+        // Extract node voltages
+        std::vector<Complex> V_nodes(numNodes, Complex(0, 0));
+        for(int i=1; i<numNodes; ++i) {
+            if (getIdx(i) < (int)x.size()) {
+                V_nodes[i] = x[getIdx(i)];
+            }
+        }
+        
+        // Calculate powers for target resistors
+        for (Component* targetR : targetResistors) {
+            if (targetR && targetR->type == RESISTOR) {
+                Complex V_comp = V_nodes[targetR->nodeA_idx] - V_nodes[targetR->nodeB_idx];
+                double V_mag = V_comp.magnitude();
+                // P_avg = |V|^2 / (2*R)
+                double P_avg = (V_mag * V_mag) / (2.0 * targetR->value);
+                result.avgPower[targetR->name] = P_avg;
+            }
+        }
+        
+        // Calculate power factor if single source
+        if (result.hasPowerFactor) {
+            // Find the source
+            const Component* source = nullptr;
+            int sourceType = -1; // 0=V, 1=I
+            for (const auto& c : components) {
+                if (c.type == VOLTAGE_SOURCE) {
+                    source = &c;
+                    sourceType = 0;
+                    break;
+                } else if (c.type == CURRENT_SOURCE) {
+                    source = &c;
+                    sourceType = 1;
+                    break;
+                }
+            }
+            
+            if (source) {
+                Complex V_source, I_source;
+                
+                if (sourceType == 0) {
+                    // Voltage source: V is known, I is in MNA solution
+                    V_source = Complex(source->value, 0);
+                    // Current through V source is the corresponding MNA variable
+                    // It's at position numNodes-1 (first voltage source)
+                    if ((int)x.size() > numNodes - 1) {
+                        I_source = x[numNodes - 1];
+                    }
+                } else {
+                    // Current source: I is known, V across it is node difference
+                    I_source = Complex(source->value, 0);
+                    V_source = V_nodes[source->nodeA_idx] - V_nodes[source->nodeB_idx];
+                }
+                
+                // Power factor = cos(angle(V) - angle(I))
+                double phi = V_source.phase() - I_source.phase();
+                result.powerFactor = std::cos(phi);
+            }
+        }
+        
+        return result;
+    }
+
+    // --- Adjoint sensitivities ---
+
+    // d(answer)/d(value) for every component, in the component's own units (ohm, V, A, mH,
+    // uF); 0 for wires and switches
+    struct Sensitivity {
+        std::string answer; // "initial", "final", "tau", "P_<resistor>" or "power_factor"
+        std::vector<double> d;
+    };
+
+    // Solution of A^T y = c for an assembled system, c and y in its compacted layout
+    template <class T>
+    std::vector<T> adjointSolve(const MNASystem<T>& sys, const std::vector<T>& c) const {
+        MNASystem<T> t(sys.n);
+        t.rows = sys.cols;
+        t.cols = sys.rows;
+        t.vals = sys.vals;
+        t.rhs = c;
+        t.expand = sys.expand;
+        t.branches = sys.branches;
+        return t.compacted(solveSystem(t));
+    }
+
+    // Derivative of a component's table value (see dcStampTable, acStampTable) with respect
+    // to its value
+    double dcStampDerivative(const Component& c) const {
+        if (c.type == RESISTOR) return -1.0 / (c.value * c.value);
+        if (c.type == VOLTAGE_SOURCE || c.type == CURRENT_SOURCE) return 1.0;
+        return 0.0;
+    }
+
+    Complex acStampDerivative(const Component& c, double omegaVal) const {
+        if (c.type == RESISTOR || c.type == INDUCTOR) return Complex(0, 0) - admittance(c, omegaVal) / Complex(c.value, 0);
+        if (c.type == CAPACITOR) return admittance(c, omegaVal) / Complex(c.value, 0);
+        if (c.type == VOLTAGE_SOURCE || c.type == CURRENT_SOURCE) return Complex(1, 0);
+        return Complex(0, 0);
+    }
+
+    // dJ/dp for J = c^T x with A x = b and lambda = A^-T c: lambda^T (db/dp - dA/dp x), read
+    // off the stamp plan, where every stamp of component i is its table value or the negation
+    // of it. x and lambda in the compacted layout; dTable[i] as from dcStampDerivative.
+    template <class T>
+    std::vector<T> adjointGradient(const StampPlan& plan, const std::vector<T>& dTable, const std::vector<T>& lambda,
+                                   const std::vector<T>& x) const {
+        std::vector<T> grad(components.size(), T(0.0));
+        auto component = [](int slot, int& i) {
+            if (slot < SLOT_COMPONENTS) return false;
+            i = (slot - SLOT_COMPONENTS) / 2;
+            return true;
+        };
+        int i;
+        for (size_t k = 0; k < plan.slots.size(); ++k) {
+            if (!component(plan.slots[k], i)) continue;
+            T term = lambda[plan.rows[k]] * x[plan.cols[k]] * dTable[i];
+            grad[i] = (plan.slots[k] == valueSlot(i)) ? grad[i] - term : grad[i] + term;
+        }
+        for (size_t k = 0; k < plan.rhsSlots.size(); ++k) {
+            if (!component(plan.rhsSlots[k], i)) continue;
+            T term = lambda[plan.rhsRows[k]] * dTable[i];
+            grad[i] = (plan.rhsSlots[k] == valueSlot(i)) ? grad[i] + term : grad[i] - term;
+        }
+        return grad;
+    }
+
+    // c with c^T x = v_a - v_b for circuit nodes a and b, in the compacted layout of sys
+    template <class T>
+    std::vector<T> voltageFunctional(const MNASystem<T>& sys, int a, int b) const {
+        std::vector<T> c(sys.n, T(0.0));
+        if (a > 0 && sys.expand[a - 1] >= 0) c[sys.expand[a - 1]] = c[sys.expand[a - 1]] + T(1.0);
+        if (b > 0 && sys.expand[b - 1] >= 0) c[sys.expand[b - 1]] = c[sys.expand[b - 1]] - T(1.0);
+        return c;
+    }
+
+    // Topology states of buildTransientSystems(), for the factorization cache
+    std::vector<std::vector<uint64_t>> transientStateKeys() const {
+        return {topologyKey(true, false, nullptr), topologyKey(false, false, nullptr), topologyKey(false, true, targetComp)};
+    }
+
+    // Sensitivities of the DC answers (from the MNA solutions, whatever solveTransient()
+    // used): one adjoint solve per answer instead of one perturbed solve per component.
+    // tau adds the target's own value, which only enters through L / R or R C.
+    std::vector<Sensitivity> transientSensitivities() const {
+        if (!targetComp) return {};
+        std::vector<MNASystem<double>> systems = buildTransientSystems();
+        std::vector<std::vector<uint64_t>> keys = transientStateKeys();
+        const StampPlan* plans[3] = {&stampPlan(true, true, false, false), &stampPlan(true, false, false, false),
+                                     &stampPlan(true, false, true, true, true)};
+        std::vector<double> dTable(components.size());
+        for (size_t i = 0; i < components.size(); ++i) dTable[i] = dcStampDerivative(components[i]);
+
+        bool isInductor = (targetComp->type == INDUCTOR);
+        int a = targetComp->nodeA_idx, b = targetComp->nodeB_idx;
+        std::vector<Sensitivity> result;
+        double vTh = 0.0;
+        for (int k = 0; k < 3; ++k) {
+            const MNASystem<double>& sys = systems[k];
+            std::vector<double> x = sys.compacted(solveCached(sys, keys[k]));
+            std::vector<double> c = voltageFunctional(sys, a, b);
+            if (k < 2 && isInductor) {
+                c.assign(sys.n, 0.0);
+                if (sys.expand[probeCurrent()] >= 0) c[sys.expand[probeCurrent()]] = 1.0;
+            }
+            if (k == 2) vTh = c.empty() ? 0.0 : std::inner_product(c.begin(), c.end(), x.begin(), 0.0);
+            result.push_back({k == 0 ? "initial" : k == 1 ? "final" : "tau", adjointGradient(*plans[k], dTable, adjointSolve(sys, c), x)});
+        }
+
+        // Req = |v_a - v_b| per injected ampere, then tau = Req C or L / Req
+        double Req = std::abs(vTh);
+        double sign = vTh < 0 ? -1.0 : 1.0;
+        size_t target = targetComp - components.data();
+        std::vector<double>& dTau = result[2].d;
+        for (size_t i = 0; i < components.size(); ++i) {
+            double dReq = sign * dTau[i];
+            dTau[i] = isInductor ? -(targetComp->value * 1e-3) / (Req * Req) * dReq : dReq * targetComp->value * 1e-6;
+        }
+        dTau[target] = isInductor ? 1e-3 / Req : Req * 1e-6;
+        return result;
+    }
+
+    // Sensitivities of the AC answers. P = |V|^2 / (2 R) gives dP = Re(conj(V) dV) / R, plus
+    // -P / R for the resistor's own value; the power factor cos(phi) moves with the phase of
+    // the source current (V source) or voltage (I source): d cos(phi) = -sin(phi) dphi.
+    std::vector<Sensitivity> acSensitivities() const {
+        MNASystem<Complex> sys = buildACMNA();
+        const StampPlan& plan = stampPlan(false, false, false, false);
+        std::vector<Complex> full = solveSystem(sys);
+        std::vector<Complex> x = sys.compacted(full);
+        std::vector<Complex> dTable(components.size());
+        for (size_t i = 0; i < components.size(); ++i) dTable[i] = acStampDerivative(components[i], omega);
+        auto nodeVoltage = [&](int n) { return n > 0 ? full[n - 1] : Complex(0, 0); };
+
+        std::vector<Sensitivity> result;
+        for (const Component* r : targetResistors) {
+            if (!r || r->type != RESISTOR) continue;
+            Complex V = nodeVoltage(r->nodeA_idx) - nodeVoltage(r->nodeB_idx);
+            std::vector<Complex> dV = adjointGradient(plan, dTable, adjointSolve(sys, voltageFunctional(sys, r->nodeA_idx, r->nodeB_idx)), x);
+            Sensitivity s{"P_" + r->name, std::vector<double>(components.size())};
+            for (size_t i = 0; i < components.size(); ++i) s.d[i] = (V.conjugate() * dV[i]).real / r->value;
+            s.d[r - components.data()] -= V.magnitude() * V.magnitude() / (2.0 * r->value * r->value);
+            result.push_back(s);
+        }
+
+        // The single source, as in acFromSolution()
+        const Component* source = nullptr;
+        int numSources = 0;
+        for (const auto& c : components) {
+            if (c.type != VOLTAGE_SOURCE && c.type != CURRENT_SOURCE) continue;
+            if (!source) source = &c;
+            numSources++;
+        }
+        if (numSources != 1) return result;
+        int numNodes = nodes.size();
+        Complex W;                 // The solved quantity: source current or voltage
+        std::vector<Complex> c(sys.n, Complex(0, 0));
+        double phaseSign;          // phi = arg V - arg I
+        if (source->type == VOLTAGE_SOURCE) {
+            if (sys.expand[numNodes - 1] >= 0) c[sys.expand[numNodes - 1]] = Complex(1, 0);
+            W = full[numNodes - 1];
+            phaseSign = -1.0;
+        } else {
+            c = voltageFunctional(sys, source->nodeA_idx, source->nodeB_idx);
+            W = nodeVoltage(source->nodeA_idx) - nodeVoltage(source->nodeB_idx);
+            phaseSign = 1.0;
+        }
+        Complex sourceValue(source->value, 0);
+        double phi = source->type == VOLTAGE_SOURCE ? sourceValue.phase() - W.phase() : W.phase() - sourceValue.phase();
+        std::vector<Complex> dW = adjointGradient(plan, dTable, adjointSolve(sys, c), x);
+        Sensitivity s{"power_factor", std::vector<double>(components.size())};
+        for (size_t i = 0; i < components.size(); ++i) s.d[i] = -std::sin(phi) * phaseSign * (dW[i] / W).imag;
+        result.push_back(s);
+        return result;
+    }
+
+    std::vector<Sensitivity> sensitivities() const {
+        return exerciseType == AC_STEADY_STATE ? acSensitivities() : transientSensitivities();
+    }
+
+    void exportSVG(const std::string& filename) {
+        std::ofstream svg(filename);
+        writeSVG(svg);
+        svg.close();
+        std::cout << "Exported circuit to " << filename << std::endl;
+    }
+
+    // Render the circuit as an SVG document into any stream (file or inline string)
+    void writeSVG(std::ostream& svg) {
+        int gridWidth = (width - 1) * GRID_SIZE + 2 * MARGIN;
+        int gridHeight = (height - 1) * GRID_SIZE + 2 * MARGIN;
+        
+        // Ensure minimum width for text
+        int imgWidth = std::max(gridWidth, 500);
+        int imgHeight = gridHeight + 40; // Extra space for text
+
+        svg << "<svg width=\"" << imgWidth << "\" height=\"" << imgHeight << "\" xmlns=\"http://www.w3.org/2000/svg\">" << std::endl;
+        
+        // Definitions
+        svg << "<defs>" << std::endl;
+        svg << "<marker id=\"arrow\" markerWidth=\"10\" markerHeight=\"10\" refX=\"9\" refY=\"3\" orient=\"auto\" markerUnits=\"strokeWidth\">" << std::endl;
+        svg << "<path d=\"M0,0 L0,6 L9,3 z\" fill=\"black\" />" << std::endl;
+        svg << "</marker>" << std::endl;
+        svg << "</defs>" << std::endl;
+        
+        svg << "<style>" << std::endl;
+        svg << ".wire { stroke: black; stroke-width: 2; fill: none; }" << std::endl;
+        svg << ".node { fill: black; }" << std::endl;
+        svg << ".text { font-family: sans-serif; font-size: 12px; }" << std::endl;
+        svg << ".qtext { font-family: sans-serif; font-size: 14px; font-weight: bold; fill: #0000AA; }" << std::endl;
+        svg << "</style>" << std::endl;
+        
+        // Background
+        svg << "<rect width=\"100%\" height=\"100%\" fill=\"white\" />" << std::endl;
+
+        // Draw Components
+        for (const auto& c : components) {
+            drawComponent(svg, c);
+        }
+
+        // Draw Nodes (Dots)
+        std::vector<char> used(nodes.size(), 0);
+        for (const auto& c : components) {
+            used[c.nodeA_idx] = 1;
+            used[c.nodeB_idx] = 1;
+        }
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            const Point& p = nodes[i];
+            if (used[i]) {
+                int px = MARGIN + p.x * GRID_SIZE;
+                int py = MARGIN + p.y * GRID_SIZE;
+                svg << "<circle cx=\"" << px << "\" cy=\"" << py << "\" r=\"4\" class=\"node\" />" << std::endl;
+            }
+        }
+        
+        // Question text removed - shown in GUI instead
+        
+        svg << "</svg>" << std::endl;
+    }
+
+private:
+    void drawComponent(std::ostream& svg, const Component& c) {
+        int x1 = MARGIN + c.pA.x * GRID_SIZE;
+        int y1 = MARGIN + c.pA.y * GRID_SIZE;
+        int x2 = MARGIN + c.pB.x * GRID_SIZE;
+        int y2 = MARGIN + c.pB.y * GRID_SIZE;
+
+        int mx = (x1 + x2) / 2;
+        int my = (y1 + y2) / 2;
+
+        // Check orientation
+        bool isHorizontal = (y1 == y2);
+        
+        if (c.type == WIRE) {
+            svg << "<line x1=\"" << x1 << "\" y1=\"" << y1 << "\" x2=\"" << x2 << "\" y2=\"" << y2 << "\" class=\"wire\" />" << std::endl;
+            return;
+        }
+
+        // Clip the line in the middle specifically for symbol
+        // We want to draw a line from p1 to start of symbol, and end of symbol to p2
+        // Symbol size approx 30px
+        int gap = 15;
+        
+        int sx1, sy1, sx2, sy2; // Symbol Drawing Coordinates
+        if (isHorizontal) {
+            int dx = (x2 > x1) ? 1 : -1;
+            sx1 = mx - gap * dx; sy1 = my;
+            sx2 = mx + gap * dx; sy2 = my;
+            // Wires to symbol
+            svg << "<line x1=\"" << x1 << "\" y1=\"" << y1 << "\" x2=\"" << sx1 << "\" y2=\"" << sy1 << "\" class=\"wire\" />" << std::endl;
+            svg << "<line x1=\"" << sx2 << "\" y1=\"" << sy2 << "\" x2=\"" << x2 << "\" y2=\"" << y2 << "\" class=\"wire\" />" << std::endl;
+        } else {
+            int dy = (y2 > y1) ? 1 : -1;
+            sx1 = mx; sy1 = my - gap * dy;
+            sx2 = mx; sy2 = my + gap * dy;
+            // Wires to symbol
+            svg << "<line x1=\"" << x1 << "\" y1=\"" << y1 << "\" x2=\"" << sx1 << "\" y2=\"" << sy1 << "\" class=\"wire\" />" << std::endl;
+            svg << "<line x1=\"" << sx2 << "\" y1=\"" << sy2 << "\" x2=\"" << x2 << "\" y2=\"" << y2 << "\" class=\"wire\" />" << std::endl;
+        }
+
+        // Draw Symbol
+        if (c.type == RESISTOR) {
+            // Choose color based on highlightRed flag
+            std::string color = c.highlightRed ? "red" : "black";
+            
+            // Zigzag
+            svg << "<path d=\"";
+            if (isHorizontal) {
+                 // 6 segments
+                 double step = (double)(sx2 - sx1) / 6.0;
+                 svg << "M " << sx1 << " " << sy1 << " ";
+                 for(int i=1; i<=6; i++) {
+                     double tx = sx1 + i * step;
+                     double ty = sy1 + ((i%2==0) ? -5 : 5) * ((i==6) ? 0 : 1); // Zigzag offset
+                     if (i==6) ty = sy2; // Snap to end
+                     svg << "L " << tx << " " << ty << " ";
+                 }
+            } else {
+                 double step = (double)(sy2 - sy1) / 6.0;
+                 svg << "M " << sx1 << " " << sy1 << " ";
+                 for(int i=1; i<=6; i++) {
+                     double ty = sy1 + i * step;
+                     double tx = sx1 + ((i%2==0) ? -5 : 5) * ((i==6) ? 0 : 1);
+                     if (i==6) tx = sx2;
+                     svg << "L " << tx << " " << ty << " ";
+                 }
+            }
+            svg << "\" stroke=\"" << color << "\" stroke-width=\"2\" fill=\"none\" />" << std::endl;
+            
+            // Text Label
+            svg << "<text x=\"" << (mx + (isHorizontal ? 0 : 10)) << "\" y=\"" << (my + (isHorizontal ? -10 : 0)) << "\" class=\"text\">" << c.getValueLabel() << "</text>" << std::endl;
+
+        } else if (c.type == VOLTAGE_SOURCE) {
+            // Circle
+            svg << "<circle cx=\"" << mx << "\" cy=\"" << my << "\" r=\"" << gap << "\" class=\"wire\" />" << std::endl;
+            // Name label - use Value
+             svg << "<text x=\"" << (mx + (isHorizontal ? 0 : 15)) << "\" y=\"" << (my + (isHorizontal ? -15 : 0)) << "\" class=\"text\">" << c.getValueLabel() << "</text>" << std::endl;
+             
+             // + and - signs inside the circle, oriented towards nodes
+             if (isHorizontal) {
+                 int dir = (x1 < x2) ? -1 : 1;
+                 svg << "<text x=\"" << mx + (dir * 7) - 3 << "\" y=\"" << my + 4 << "\" font-size=\"12\" font-weight=\"bold\">+</text>";
+                 svg << "<text x=\"" << mx - (dir * 7) - 3 << "\" y=\"" << my + 4 << "\" font-size=\"12\" font-weight=\"bold\">-</text>";
+             } else {
+                 int dir = (y1 < y2) ? -1 : 1;
+                 svg << "<text x=\"" << mx - 3 << "\" y=\"" << my + (dir * 7) + 3 << "\" font-size=\"12\" font-weight=\"bold\">+</text>";
+                 svg << "<text x=\"" << mx - 3 << "\" y=\"" << my - (dir * 7) + 3 << "\" font-size=\"12\" font-weight=\"bold\">-</text>";
+             }
+
+        } else if (c.type == CURRENT_SOURCE) {
+            svg << "<circle cx=\"" << mx << "\" cy=\"" << my << "\" r=\"" << gap << "\" class=\"wire\" />" << std::endl;
+             svg << "<text x=\"" << (mx + (isHorizontal ? 0 : 15)) << "\" y=\"" << (my + (isHorizontal ? -15 : 0)) << "\" class=\"text\">" << c.getValueLabel() << "</text>" << std::endl;
+            // Arrow (simple line)
+             if (isHorizontal) {
+                  svg << "<line x1=\"" << mx - 8 << "\" y1=\"" << my << "\" x2=\"" << mx + 8 << "\" y2=\"" << my << "\" class=\"wire\" />";
+                  svg << "<path d=\"M " << mx+4 << " " << my-4 << " L " << mx+8 << " " << my << " L " << mx+4 << " " << my+4 << "\" class=\"wire\" />";
+             } else {
+                  svg << "<line x1=\"" << mx << "\" y1=\"" << my - 8 << "\" x2=\"" << mx << "\" y2=\"" << my + 8 << "\" class=\"wire\" />";
+                  svg << "<path d=\"M " << mx-4 << " " << my+4 << " L " << mx << " " << my+8 << " L " << mx+4 << " " << my+4 << "\" class=\"wire\" />";
+             }
+        } else if (c.type == CAPACITOR) {
+            // Two parallel plates
+            // Gap is 15px. We need two lines separated by maybe 6px
+            int plateSep = 4;
+            int plateLen = 20;
+
+            if (isHorizontal) {
+                 // Lines at mx +/- plateSep
+                 // Vertical plates
+                 svg << "<line x1=\"" << mx - plateSep << "\" y1=\"" << my - plateLen/2 << "\" x2=\"" << mx - plateSep << "\" y2=\"" << my + plateLen/2 << "\" class=\"wire\" />";
+                 svg << "<line x1=\"" << mx + plateSep << "\" y1=\"" << my - plateLen/2 << "\" x2=\"" << mx + plateSep << "\" y2=\"" << my + plateLen/2 << "\" class=\"wire\" />";
+                 // Connecting wires
+                 svg << "<line x1=\"" << sx1 << "\" y1=\"" << sy1 << "\" x2=\"" << mx - plateSep << "\" y2=\"" << sy1 << "\" class=\"wire\" />";
+                 svg << "<line x1=\"" << sx2 << "\" y1=\"" << sy2 << "\" x2=\"" << mx + plateSep << "\" y2=\"" << sy2 << "\" class=\"wire\" />";
+            } else {
+                 // Lines at my +/- plateSep
+                 // Horizontal plates
+                 svg << "<line x1=\"" << mx - plateLen/2 << "\" y1=\"" << my - plateSep << "\" x2=\"" << mx + plateLen/2 << "\" y2=\"" << my - plateSep << "\" class=\"wire\" />";
+                 svg << "<line x1=\"" << mx - plateLen/2 << "\" y1=\"" << my + plateSep << "\" x2=\"" << mx + plateLen/2 << "\" y2=\"" << my + plateSep << "\" class=\"wire\" />";
+                 // Connecting wires
+                 svg << "<line x1=\"" << sx1 << "\" y1=\"" << sy1 << "\" x2=\"" << sx1 << "\" y2=\"" << my - plateSep << "\" class=\"wire\" />";
+                 svg << "<line x1=\"" << sx2 << "\" y1=\"" << sy2 << "\" x2=\"" << sx2 << "\" y2=\"" << my + plateSep << "\" class=\"wire\" />";
+            }
+             svg << "<text x=\"" << (mx + (isHorizontal ? 0 : 15)) << "\" y=\"" << (my + (isHorizontal ? -15 : 0)) << "\" class=\"text\">" << c.getValueLabel() << "</text>" << std::endl;
+
+        } else if (c.type == INDUCTOR) {
+            // Coils (Bumps)
+            int coilRadius = 5;
+            int numCoils = 4;
+            // Total length needed is roughly numCoils * 2 * radius
+            // We fit it between sx1 and sx2 (which is 2*gap = 30px)
+            // 4 coils * 10px = 40px might be too big. Let's do 3 coils aka 30px.
+
+            svg << "<path d=\"M " << sx1 << " " << sy1 << " ";
+            
+            if (isHorizontal) {
+                // Determine step direction
+                int dx = (sx2 > sx1) ? 1 : -1;
+                // Draw arcs
+                double step = (double)(sx2 - sx1) / 3.0; // 3 coils
+                for(int i=0; i<3; i++) {
+                    double currX = sx1 + i * step;
+                    double nextX = sx1 + (i + 1) * step;
+                    // Cubic Bezier: control points up
+                    // q control end matches quadratic
+                    // svg arc: A rx ry rot large-arc-flag sweep-flag x y
+                    // Let's use simple Q for bump
+                    // Control point in middle-up
+                    double cx = (currX + nextX) / 2.0;
+                    double cy = sy1 - 10; // Bump up
+                    svg << "Q " << cx << " " << cy << " " << nextX << " " << sy1 << " ";
+                }
+            } else {
+                int dy = (sy2 > sy1) ? 1 : -1;
+                 double step = (double)(sy2 - sy1) / 3.0;
+                 for(int i=0; i<3; i++) {
+                    double currY = sy1 + i * step;
+                    double nextY = sy1 + (i + 1) * step;
+                    double cy = (currY + nextY) / 2.0;
+                    double cx = sx1 + 10; // Bump right
+                    svg << "Q " << cx << " " << cy << " " << sx1 << " " << nextY << " ";
+                 }
+            }
+            svg << "\" class=\"wire\" />" << std::endl;
+             svg << "<text x=\"" << (mx + (isHorizontal ? 0 : 15)) << "\" y=\"" << (my + (isHorizontal ? -15 : 0)) << "\" class=\"text\">" << c.getValueLabel() << "</text>" << std::endl;
+        
+        } else if (c.type == SWITCH) {
+            // Refined Switch Drawing
+            // Gap is between sx1 and sx2.
+            
+            // 1. Terminals (Dots)
+            svg << "<circle cx=\"" << sx1 << "\" cy=\"" << sy1 << "\" r=\"2.5\" class=\"node\" />" << std::endl;
+            svg << "<circle cx=\"" << sx2 << "\" cy=\"" << sy2 << "\" r=\"2.5\" class=\"node\" />" << std::endl;
+            
+            // 2. Lever Geometry
+            double leverLen = sqrt(pow(sx2-sx1,2) + pow(sy2-sy1,2)); // Distance
+            // Base at sx1.
+            
+            double baseAngle = atan2(sy2-sy1, sx2-sx1); // Angle of the wire line
+            
+            double openAngleOffset = -0.6; // ~35 degrees counter-clock-wise
+            
+            double tipX, tipY;
+            
+            if (c.startsOpen) {
+                // Draw Open Lever
+                tipX = sx1 + leverLen * cos(baseAngle + openAngleOffset);
+                tipY = sy1 + leverLen * sin(baseAngle + openAngleOffset);
+                
+                svg << "<line x1=\"" << sx1 << "\" y1=\"" << sy1 << "\" x2=\"" << tipX << "\" y2=\"" << tipY << "\" style=\"stroke:black; stroke-width:2;\" />" << std::endl;
+
+            } else {
+                // Draw Closed Lever
+                svg << "<line x1=\"" << sx1 << "\" y1=\"" << sy1 << "\" x2=\"" << sx2 << "\" y2=\"" << sy2 << "\" style=\"stroke:black; stroke-width:2;\" />" << std::endl;
+            }
+            
+            // Label "t=0 Opening/Closing"
+            std::string label = c.startsOpen ? "t=0 Closing" : "t=0 Opening";
+            
+            // Position it above/below mid point
+            double mx_lab = (sx1 + sx2)/2;
+            double my_lab = (sy1 + sy2)/2;
+            
+            // Shift based on orientation/state to avoid overlap
+            if (isHorizontal) {
+                my_lab -= 20; 
+            } else {
+                mx_lab += 25; 
+            }
+            
+            svg << "<text x=\"" << mx_lab << "\" y=\"" << my_lab << "\" class=\"text\" font-size=\"11\" text-anchor=\"middle\">" << label << "</text>" << std::endl;
+        }
+    }
+};
+
+// --- Generation Logic ---
+
+// Random connected topology on a w x h grid (nodes indexed y*w + x, edges stored as (u, v) with u < v).
+// 1. Randomized Kruskal: shuffle all grid edges and keep those joining two components -> spanning tree.
+// 2. Close loops with half of the rejected edges (at least 4, i.e. the full grid for 3x3).
+// Union-find makes the whole pass O(E alpha(E)), so 1000x1000 grids take milliseconds.
+std::vector<std::pair<int, int>> generateGridTopology(int w, int h, Rng& rng) {
+    int numNodes = w * h;
+    std::vector<std::pair<int, int>> gridEdges;
+    gridEdges.reserve(2 * numNodes);
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            int u = y * w + x;
+            if (x < w - 1) gridEdges.push_back({u, u + 1});
+            if (y < h - 1) gridEdges.push_back({u, u + w});
+        }
+    }
+    std::shuffle(gridEdges.begin(), gridEdges.end(), rng);
+
+    DisjointSet sets(numNodes);
+    std::vector<std::pair<int, int>> edges;
+    std::vector<std::pair<int, int>> rejected;
+    edges.reserve(numNodes - 1);
+    for (const auto& e : gridEdges) {
+        if (sets.unite(e.first, e.second)) edges.push_back(e);
+        else rejected.push_back(e);
+    }
+
+    // Rejected edges are already in random order
+    size_t cyclesToAdd = std::min(rejected.size(), std::max<size_t>(4, rejected.size() / 2));
+    edges.insert(edges.end(), rejected.begin(), rejected.begin() + cyclesToAdd);
+    return edges;
+}
+
+Circuit generateGridCircuit(uint64_t seed, int w = 3, int h = 3) {
+    // Default 3x3 grid = 9 nodes
+    Circuit circuit(w, h, seed);
+    Rng& rng = circuit.rng;
+
+    // 1-2. Spanning tree + extra loop-forming edges
+    std::vector<std::pair<int, int>> edges = generateGridTopology(w, h, rng);
+    circuit.components.reserve(edges.size());
+
+    // 3. Assign Components
+    int rCount = 0, vCount = 0, iCount = 0, cCount = 0, lCount = 0;
+    bool hasSource = false;
+    bool hasSwitched = false;
+    bool hasDynamic = false; // Has L or C
+    
+    // Decide if this is RL or RC circuit
+    bool isRC = (rng.below(2) == 0);
+
+    // To make it look "smart", try to put voltage sources on the perimeter
+    auto isPerimeter = [&](int n) {
+        int x = n % w;
+        int y = n / w;
+        return x==0 || x==w-1 || y==0 || y==h-1;
+    };
+
+    // Shuffle edges to randomize assignment order
+    std::shuffle(edges.begin(), edges.end(), rng);
+
+    for (const auto& edge : edges) {
+        Component c;
+        c.nodeA_idx = edge.first;
+        c.nodeB_idx = edge.second;
+        c.pA = circuit.nodes[edge.first];
+        c.pB = circuit.nodes[edge.second];
+
+        bool perimeterEdge = isPerimeter(edge.first) && isPerimeter(edge.second);
+        
+        // Priority 1: Dynamic Element (L or C) - Place exactly one
+        if (!hasDynamic && (rng.below(10) < 3)) { // 30% chance to place if not yet placed
+             if (isRC) {
+                 c.type = CAPACITOR;
+                 c.name = "C1";
+                 c.value = 10.0 * (rng.below(10) + 1); // uF
+             } else {
+                 c.type = INDUCTOR;
+                 c.name = "L1";
+                 c.value = 1.0 * (rng.below(10) + 1); // mH
+             }
+             hasDynamic = true;
+             circuit.addComponent(std::move(c));
+             continue;
+        }
+        
+        // Priority 2: Switch - Place exactly one
+        if (!hasSwitched && (rng.below(10) < 3)) {
+            c.type = SWITCH;
+            c.name = "Sw1";
+            c.value = 0; // No value
+            c.startsOpen = (rng.below(2) == 0);
+            hasSwitched = true;
+             circuit.addComponent(std::move(c));
+             continue;
+        }
+
+        int typeRoll = rng.below(100);
+        
+        if (!hasSource && perimeterEdge && (rng.below(2)==0)) {
+             // Check total source count (vCount + iCount)
+             if (vCount + iCount < 2) {
+                 c.type = VOLTAGE_SOURCE;
+                 c.name = "V" + std::to_string(++vCount);
+                 c.value = 10.0;
+                 hasSource = true;
+             } else {
+                 // Fallback to Resistor if max sources reached
+                 c.type = RESISTOR;
+                 c.name = "R" + std::to_string(++rCount);
+                 c.value = 100.0 * (rng.below(10) + 1);
+             }
+        } else if (typeRoll < 60) {
+            // Resistor (High probability to ensure connectivity)
+            c.type = RESISTOR;
+            c.name = "R" + std::to_string(++rCount);
+            c.value = 100.0 * (rng.below(10) + 1);
+        } else if (typeRoll < 85) {
+             // Voltage Source
+             if (vCount + iCount < 2) {
+                 c.type = VOLTAGE_SOURCE;
+                 c.name = "V" + std::to_string(++vCount);
+                 c.value = 5.0 * (rng.below(4) + 1);
+                 hasSource = true;
+             } else {
+                 // Fallback
+                 c.type = RESISTOR;
+                 c.name = "R" + std::to_string(++rCount);
+                 c.value = 100.0 * (rng.below(10) + 1);
+             }
+        } else {
+             // Current Source
+             if (vCount + iCount < 2) {
+                 c.type = CURRENT_SOURCE;
+                 c.name = "I" + std::to_string(++iCount);
+                 c.value = 1.0 * (rng.below(5) + 1);
+                 hasSource = true;
+             } else {
+                 // Fallback
+                 c.type = RESISTOR;
+                 c.name = "R" + std::to_string(++rCount);
+                 c.value = 100.0 * (rng.below(10) + 1);
+             }
+        }
+        circuit.addComponent(std::move(c));
+    }
+    
+    // Ensure we have at least one dynamic element and one switch
+    bool foundDyn = false;
+    bool foundSw = false;
+    for(auto& c : circuit.components) {
+        if(c.type == CAPACITOR || c.type == INDUCTOR) foundDyn = true;
+        if(c.type == SWITCH) foundSw = true;
+    }
+    
+    if (!foundDyn) {
+        // Force replace last component
+        Component& c = circuit.components.back();
+        if (isRC) { c.type = CAPACITOR; c.name = "C1"; c.value = 100.0; }
+        else { c.type = INDUCTOR; c.name = "L1"; c.value = 10.0; }
+    }
+    if (!foundSw && circuit.components.size() > 1) {
+        // Force replace second to last (if not dyn)
+        int idx = circuit.components.size() - 2;
+        if (idx >= 0 && circuit.components[idx].type != CAPACITOR && circuit.components[idx].type != INDUCTOR) {
+            circuit.components[idx].type = SWITCH;
+            circuit.components[idx].name = "Sw1";
+            circuit.components[idx].startsOpen = (rng.below(2)==0);
+        }
+    }
+    
+    // Generate question text (generic for transient)
+    circuit.generateQuestion(); // Logic mostly unused now for interactiveness, but keeps Question Text in SVG?
+    // Let's update generateQuestion to mention the transient nature.
+    
+    // We can just set the text manually here for the SVG.
+    // "Calculate i(t)" or "Calculate v(t)"
+    std::string var = isRC ? "v_C(t)" : "i_L(t)";
+    circuit.questionText = "The switch changes state at t=0. Calculate the transient response " + var + ".";
+    circuit.targetComp = nullptr; // Will be set by solver auto-detect? 
+    // Actually solveTransient needs targetComp.
+    // Let's find it.
+    for(auto& c : circuit.components) {
+        if(c.type == CAPACITOR || c.type == INDUCTOR) {
+            circuit.targetComp = &c;
+            break;
+        }
+    }
+
+    return circuit;
+}
+
+// ========== Generate AC Steady State Circuit ==========
+Circuit generateACCircuit(uint64_t seed, int w = 3, int h = 3) {
+    Circuit circuit(w, h, seed);
+    Rng& rng = circuit.rng;
+    circuit.exerciseType = AC_STEADY_STATE;
+    
+    // Spanning tree + extra edges
+    std::vector<std::pair<int, int>> edges = generateGridTopology(w, h, rng);
+    circuit.components.reserve(edges.size());
+    
+    // Assign components
+    int rCount = 0, vCount = 0, iCount = 0, cCount = 0, lCount = 0;
+    
+    // Decide number of sources (1 or 2)
+    int numSources = (rng.below(2) == 0) ? 1 : 2;
+    int sourcesPlaced = 0;
+    
+    auto isPerimeter = [&](int n) {
+        int x = n % w;
+        int y = n / w;
+        return x==0 || x==w-1 || y==0 || y==h-1;
+    };
+    
+    std::shuffle(edges.begin(), edges.end(), rng);
+    
+    // Place at least 2 reactive components (L/C)
+    int reactiveCount = 0;
+    int reactiveTarget = 2 + rng.below(2); // 2-3 reactive components
+    
+    for (const auto& edge : edges) {
+        Component c;
+        c.nodeA_idx = edge.first;
+        c.nodeB_idx = edge.second;
+        c.pA = circuit.nodes[edge.first];
+        c.pB = circuit.nodes[edge.second];
+        
+        bool perimeterEdge = isPerimeter(edge.first) && isPerimeter(edge.second);
+        
+        // Priority 1: Place reactive components
+        if (reactiveCount < reactiveTarget && (rng.below(10) < 4)) {
+            if (rng.below(2) == 0) {
+                c.type = CAPACITOR;
+                c.name = "C" + std::to_string(++cCount);
+                c.value = 1.0 * (rng.below(10) + 1); // µF
+            } else {
+                c.type = INDUCTOR;
+                c.name = "L" + std::to_string(++lCount);
+                c.value = 1.0 * (rng.below(10) + 1); // mH
+            }
+            reactiveCount++;
+            circuit.addComponent(std::move(c));
+            continue;
+        }
+        
+        // Priority 2: Sources
+        if (sourcesPlaced < numSources && perimeterEdge) {
+            if (rng.below(2) == 0) {
+                c.type = VOLTAGE_SOURCE;
+                c.name = "V" + std::to_string(++vCount);
+                c.value = 5.0 * (rng.below(4) + 1);
+            } else {
+                c.type = CURRENT_SOURCE;
+                c.name = "I" + std::to_string(++iCount);
+                c.value = 1.0 * (rng.below(3) + 1);
+            }
+            sourcesPlaced++;
+            circuit.addComponent(std::move(c));
+            continue;
+        }
+        
+        // Default: Resistors
+        c.type = RESISTOR;
+        c.name = "R" + std::to_string(++rCount);
+        c.value = 10.0 * (rng.below(10) + 1);
+        circuit.addComponent(std::move(c));
+    }
+    
+    // Ensure we have at least one source
+    if (sourcesPlaced == 0 && !circuit.components.empty()) {
+        Component& c = circuit.components[0];
+        c.type = VOLTAGE_SOURCE;
+        c.name = "V1";
+        c.value = 10.0;
+        sourcesPlaced = 1;
+    }
+    
+    // Ensure we have at least 2 reactive components
+    if (reactiveCount < 2) {
+        for (size_t i = 0; i < circuit.components.size() && reactiveCount < 2; ++i) {
+            if (circuit.components[i].type == RESISTOR) {
+                if (rng.below(2) == 0) {
+                    circuit.components[i].type = CAPACITOR;
+                    circuit.components[i].name = "C" + std::to_string(++cCount);
+                    circuit.components[i].value = 1.0 * (rng.below(10) + 1);
+                } else {
+                    circuit.components[i].type = INDUCTOR;
+                    circuit.components[i].name = "L" + std::to_string(++lCount);
+                    circuit.components[i].value = 1.0 * (rng.below(10) + 1);
+                }
+                reactiveCount++;
+            }
+        }
+    }
+    
+    // Pick 1-3 resistors for power calculation
+    std::vector<Component*> resistors;
+    for (auto& c : circuit.components) {
+        if (c.type == RESISTOR) resistors.push_back(&c);
+    }
+    
+    if (!resistors.empty()) {
+        int numPowerQuestions = std::min((int)resistors.size(), 1 + rng.below(3));
+        std::shuffle(resistors.begin(), resistors.end(), rng);
+        for (int i = 0; i < numPowerQuestions && i < (int)resistors.size(); ++i) {
+            resistors[i]->highlightRed = true;
+            circuit.targetResistors.push_back(resistors[i]);
+        }
+    }
+    
+    // ===== INTELLIGENT FREQUENCY SELECTION WITH ROUND VALUES =====
+    int strategy = rng.below(10);
+    
+    // Possible round omega values (rad/s)
+    std::vector<int> roundOmegas = {10, 50, 100, 200, 300, 500, 1000, 2000, 5000, 7000, 10000};
+    
+    if (strategy < 4 && cCount > 0 && lCount > 0) {
+        // Strategy 1 (40%): Resonance - ω = 1/√(LC)
+        Component* selectedL = nullptr;
+        Component* selectedC = nullptr;
+        for (auto& c : circuit.components) {
+            if (!selectedL && c.type == INDUCTOR) selectedL = &c;
+            if (!selectedC && c.type == CAPACITOR) selectedC = &c;
+            if (selectedL && selectedC) break;
+        }
+        
+        if (selectedL && selectedC) {
+            double L_h = selectedL->value * 1e-3;
+            double C_f = selectedC->value * 1e-6;
+            double omega_resonance = 1.0 / std::sqrt(L_h * C_f);
+            
+            // Find closest round omega
+            int closestOmega = roundOmegas[0];
+            double minDiff = std::abs(omega_resonance - closestOmega);
+            for (int omega : roundOmegas) {
+                double diff = std::abs(omega_resonance - omega);
+                if (diff < minDiff) {
+                    minDiff = diff;
+                    closestOmega = omega;
+                }
+            }
+            circuit.omega = closestOmega;
+            circuit.frequency = circuit.omega / (2.0 * 3.14159265359);
+        } else {
+            circuit.omega = 1000.0;
+            circuit.frequency = circuit.omega / (2.0 * 3.14159265359);
+        }
+    } else if (strategy < 8) {
+        // Strategy 2 (40%): Unit simplification - ω = 1000 rad/s
+        circuit.omega = 1000.0;
+        circuit.frequency = circuit.omega / (2.0 * 3.14159265359);
+    } else {
+        // Strategy 3 (20%): Random round value
+        circuit.omega = roundOmegas[rng.below(roundOmegas.size())];
+        circuit.frequency = circuit.omega / (2.0 * 3.14159265359);
+    }
+    
+    // Generate question text
+    std::stringstream ss;
+    
+    // Randomly choose sin or cos
+    circuit.sourceWaveform = (rng.below(2) == 0) ? "sin" : "cos";
+    
+    // Generate random amplitude (1-10 A)
+    std::vector<int> possibleAmps = {1, 2, 3, 5, 10};
+    circuit.sourceAmplitude = possibleAmps[rng.below(possibleAmps.size())];
+    
+    // Show waveform with concrete amplitude value
+    ss << "Circuito AC con i_s(t) = " << circuit.sourceAmplitude << "*" 
+       << circuit.sourceWaveform << "(" << (int)circuit.omega << "t) A. ";
+    
+    if (!circuit.targetResistors.empty()) {
+        ss << "Calcola la potenza media assorbita da ";
+        for (size_t i = 0; i < circuit.targetResistors.size(); ++i) {
+            ss << circuit.targetResistors[i]->name;
+            if (i < circuit.targetResistors.size() - 1) ss << ", ";
+        }
+        ss << ". ";
+    }
+    
+    if (sourcesPlaced == 1) {
+       ss << "Calcola il fattore di potenza del generatore.";
+    }
+    
+    circuit.questionText = ss.str();
+    
+    return circuit;
+}
+
+
+// Largest reduced denominator of a nice answer (initial, final, tau in ms)
+const int64_t NICE_MAX_DENOMINATOR = 100;
+// Seeds tried for a nice DC exercise: about 1 in 6 of 3x3 grids passes, 1 in 130 of 5x5
+const int NICE_MAX_ATTEMPTS = 256;
+
+// Whether a DC exercise has answers a student can give exactly: the systems solve without
+// leaving __int128 (which also rejects singular ones) and each answer is a fraction with a
+// small denominator
+bool isNice(Circuit& c) {
+    Circuit::ExactTransient e;
+    if (!c.targetComp || !c.solveTransientExact(e, EXACT_INT128) || !e.hasTau) return false;
+    for (const Rational& q : {e.initialVal, e.finalVal, e.tau * Rational(1000.0)}) {
+        int64_t num, den;
+        if (!q.small(num, den) || den > NICE_MAX_DENOMINATOR) return false;
+    }
+    return true;
+}
+
+// An exercise is fully identified by (seed, type, size): regenerating it gives the same circuit.
+// With niceExercises, a DC exercise that is not nice is replaced by the first nice one from
+// deriveSeed(seed, 1), deriveSeed(seed, 2), ... (the circuit records the seed it came from,
+// which is nice and so regenerates itself), or kept if none is found.
+Circuit generateExercise(ExerciseType type, uint64_t seed, int w = 3, int h = 3) {
+    if (type == AC_STEADY_STATE) return generateACCircuit(seed, w, h);
+    Circuit c = generateGridCircuit(seed, w, h);
+    if (!niceExercises || isNice(c)) return c;
+    for (int attempt = 1; attempt < NICE_MAX_ATTEMPTS; ++attempt) {
+        Circuit retry = generateGridCircuit(deriveSeed(seed, attempt), w, h);
+        if (isNice(retry)) return retry;
+    }
+    return c;
+}
+
+// Fresh seed for runs that don't ask for a specific one
+uint64_t randomSeed() {
+    static std::atomic<uint64_t> counter(0);
+    uint64_t x = (uint64_t)time(0) ^ ((uint64_t)std::random_device()() << 32) ^ counter++;
+    return Rng::splitmix64(x) & SEED_MASK;
+}
+
+// ========== Solving Exercises ==========
+
+// Answers of one exercise (only the member matching its type is filled in)
+struct ExerciseSolution {
+    Circuit::ACResult ac;
+    Circuit::TransientResult transient = {0, 0, 0, {}};
+    Circuit::ExactTransient exact;  // With exactAnswers
+    bool hasExact = false;          // False if not asked for, or the DC systems are singular
+    std::vector<Circuit::Sensitivity> sensitivities; // Headless mode only (see Circuit::sensitivities)
+};
+
+ExerciseSolution solveExercise(Circuit& c) {
+    ExerciseSolution sol;
+    if (c.exerciseType == AC_STEADY_STATE) {
+        sol.ac = c.solveAC();
+    } else {
+        sol.transient = c.solveTransient();
+        sol.hasExact = exactAnswers && c.solveTransientExact(sol.exact);
+    }
+    return sol;
+}
+
+// Solve many exercises together for bank generation. The MNA systems of all circuits are
+// collected and the small ones go through the batched dense solver (grouped by size, one
+// SIMD lane per system); systems the circuit would give to the sparse backend are solved
+// one by one as usual. Answers are those of solveExercise() on each circuit. DC exercises
+// only go through network reduction (see Circuit::reduceTransient) for its worked steps,
+// with withSteps: on these sizes the batched MNA solve is cheaper, and the values agree
+// to rounding.
+void solveExercisesBatched(std::vector<Circuit>& circuits, std::vector<ExerciseSolution>& solutions,
+                           bool withSteps = false) {
+    size_t count = circuits.size();
+    solutions.assign(count, ExerciseSolution());
+
+    std::vector<std::vector<MNASystem<double>>> dcSystems(count);
+    std::vector<std::vector<std::vector<double>>> dcSolutions(count);
+    std::vector<MNASystem<Complex>> acSystems;
+    std::vector<int> acOwner;
+    acSystems.reserve(count);
+
+    std::vector<const MNASystem<double>*> dcBatch;
+    std::vector<std::vector<double>*> dcTargets;
+    for (size_t k = 0; k < count; ++k) {
+        Circuit& c = circuits[k];
+        if (c.exerciseType == AC_STEADY_STATE) {
+            acSystems.push_back(c.buildACMNA());
+            acOwner.push_back((int)k);
+        } else if (c.targetComp && !(withSteps && c.solverKind == SOLVER_AUTO && c.reduceTransient(solutions[k].transient))) {
+            dcSystems[k] = c.buildTransientSystems();
+            dcSolutions[k].resize(dcSystems[k].size());
+            for (size_t m = 0; m < dcSystems[k].size(); ++m) {
+                if (c.useSparseSolver(dcSystems[k][m].n)) {
+                    dcSolutions[k][m] = c.solveSystem(dcSystems[k][m], m == 1 ? &dcSolutions[k][0] : nullptr);
+                } else {
+                    dcBatch.push_back(&dcSystems[k][m]);
+                    dcTargets.push_back(&dcSolutions[k][m]);
+                }
+            }
+        }
+    }
+
+    std::vector<std::vector<double>> dcX;
+    solveDenseBatch(dcBatch, dcX);
+    for (size_t m = 0; m < dcX.size(); ++m) *dcTargets[m] = dcBatch[m]->expanded(dcX[m]);
+    for (size_t k = 0; k < count; ++k) {
+        if (!dcSolutions[k].empty()) solutions[k].transient = circuits[k].transientFromSolutions(dcSolutions[k]);
+        if (exactAnswers && circuits[k].exerciseType != AC_STEADY_STATE) {
+            solutions[k].hasExact = circuits[k].solveTransientExact(solutions[k].exact);
+        }
+    }
+
+    std::vector<const MNASystem<Complex>*> acBatch;
+    std::vector<int> acBatchOwner;
+    for (size_t m = 0; m < acSystems.size(); ++m) {
+        Circuit& c = circuits[acOwner[m]];
+        if (c.useSparseSolver(acSystems[m].n)) {
+            solutions[acOwner[m]].ac = c.acFromSolution(c.solveSystem(acSystems[m]));
+        } else {
+            acBatch.push_back(&acSystems[m]);
+            acBatchOwner.push_back(acOwner[m]);
+        }
+    }
+    std::vector<std::vector<Complex>> acX;
+    solveDenseBatch(acBatch, acX);
+    for (size_t m = 0; m < acX.size(); ++m) {
+        solutions[acBatchOwner[m]].ac = circuits[acBatchOwner[m]].acFromSolution(acBatch[m]->expanded(acX[m]));
+    }
+}
+
+// ========== Live Re-solve (incremental value changes) ==========
+
+// Most components whose changes IncrementalSolver carries as low-rank corrections before it
+// refactors: each adds a triangular solve per change and k^2 work per solve
+const int INCREMENTAL_MAX_RANK = 8;
+
+// One MNA system kept factored while component values change. A two-terminal admittance
+// from node a to node b stamps Y u u^T with u = e_a - e_b, so a new value is the rank-1
+// change d u u^T (d = new - factored Y), and with k changed components
+//   (A + U D U^T)^-1 b = y - Z (I + D U^T Z)^-1 D U^T y,   y = A^-1 b, Z = A^-1 U
+// (Sherman-Morrison-Woodbury). A change costs one triangular solve for its column of Z and
+// a solve costs a k x k dense solve, instead of a refactorization. Past
+// INCREMENTAL_MAX_RANK changed components, or if the correction is singular, the values are
+// refilled into the kept pattern and ordering and refactored. Source values only touch the
+// right-hand side. The layout (plan) is fixed: values may change, not the topology.
+template <class T>
+class IncrementalSolver {
+public:
+    IncrementalSolver(const Circuit::StampPlan& stampPlan, std::vector<T> stampTable)
+        : plan(stampPlan), table(std::move(stampTable)) {
+        sys = plan.assemble(table);
+        A = SparseMatrix<T>::fromSystem(sys, &slots);
+        order = minimumDegreeOrdering(A.symmetricAdjacency());
+
+        // Terminals of each admittance from its diagonal stamps, and which values reach the rhs
+        size_t count = (table.size() - Circuit::SLOT_COMPONENTS) / 2;
+        terminals.assign(count, std::make_pair(-1, -1));
+        inRhs.assign(count, 0);
+        for (size_t k = 0; k < plan.slots.size(); ++k) {
+            int slot = plan.slots[k] - Circuit::SLOT_COMPONENTS;
+            if (slot < 0 || slot % 2 != 0 || plan.rows[k] != plan.cols[k]) continue;
+            auto& t = terminals[slot / 2];
+            if (t.first < 0) t.first = plan.rows[k];
+            else t.second = plan.rows[k];
+        }
+        for (int slot : plan.rhsSlots) {
+            if (slot >= Circuit::SLOT_COMPONENTS) inRhs[(slot - Circuit::SLOT_COMPONENTS) / 2] = 1;
+        }
+        refactor();
+    }
+
+    // Component comp now has table value `value` (see Circuit::dcStampValue, acStampValue)
+    void setValue(size_t comp, const T& value) {
+        table[Circuit::valueSlot(comp)] = value;
+        table[Circuit::negatedSlot(comp)] = Circuit::negated(value);
+        if (inRhs[comp]) {
+            sys = plan.assemble(table);
+            y = lu.solve(sys.rhs);
+        }
+        if (terminals[comp].first < 0) return;
+
+        for (auto& term : terms) {
+            if (term.comp == (int)comp) {
+                term.delta = value - factored[comp];
+                return;
+            }
+        }
+        if ((int)terms.size() == INCREMENTAL_MAX_RANK) {
+            refactor();
+            return;
+        }
+        Term term;
+        term.comp = (int)comp;
+        term.a = terminals[comp].first;
+        term.b = terminals[comp].second;
+        term.delta = value - factored[comp];
+        std::vector<T> u(sys.n, T(0.0));
+        u[term.a] = T(1.0);
+        if (term.b >= 0) u[term.b] = T(-1.0);
+        term.z = lu.solve(u);
+        terms.push_back(std::move(term));
+    }
+
+    // Solution in the full layout (see MNASystem::expanded)
+    std::vector<T> solve() {
+        int k = (int)terms.size();
+        if (k == 0) return sys.expanded(y);
+
+        // S c = D U^T y with S = I + D U^T Z, by Gaussian elimination with partial pivoting
+        std::vector<T> S(k * k), c(k);
+        for (int p = 0; p < k; ++p) {
+            for (int q = 0; q < k; ++q) S[p * k + q] = terms[p].delta * dot(terms[p], terms[q].z);
+            S[p * k + p] = S[p * k + p] + T(1.0);
+            c[p] = terms[p].delta * dot(terms[p], y);
+        }
+        for (int j = 0; j < k; ++j) {
+            int piv = j;
+            double colMax = 0.0;
+            for (int i = j; i < k; ++i) {
+                colMax = std::max(colMax, magSq(S[i * k + j]));
+                if (magSq(S[i * k + j]) > magSq(S[piv * k + j])) piv = i;
             }
-            
-            svg << "<text x=\"" << mx_lab << "\" y=\"" << my_lab << "\" class=\"text\" font-size=\"11\" text-anchor=\"middle\">" << label << "</text>" << std::endl;
+            if (colMax == 0.0 || magSq(S[piv * k + j]) < 1e-24 * colMax) {
+                // The update is (nearly) singular on its own: start over from the new values
+                refactor();
+                return sys.expanded(y);
+            }
+            if (piv != j) {
+                for (int q = 0; q < k; ++q) std::swap(S[j * k + q], S[piv * k + q]);
+                std::swap(c[j], c[piv]);
+            }
+            for (int i = j + 1; i < k; ++i) {
+                T f = S[i * k + j] / S[j * k + j];
+                for (int q = j; q < k; ++q) S[i * k + q] = S[i * k + q] - f * S[j * k + q];
+                c[i] = c[i] - f * c[j];
+            }
+        }
+        for (int j = k - 1; j >= 0; --j) {
+            for (int q = j + 1; q < k; ++q) c[j] = c[j] - S[j * k + q] * c[q];
+            c[j] = c[j] / S[j * k + j];
+        }
+
+        std::vector<T> x(y);
+        for (int p = 0; p < k; ++p) {
+            for (int i = 0; i < sys.n; ++i) x[i] = x[i] - c[p] * terms[p].z[i];
         }
+        return sys.expanded(x);
+    }
+
+    // Number of components carried as low-rank corrections since the last factorization
+    int rank() const { return (int)terms.size(); }
+
+private:
+    struct Term {
+        int comp, a, b; // Terminals: unknowns a and b (-1: ground)
+        T delta;        // Current minus factored value
+        std::vector<T> z; // A^-1 u
+    };
+
+    // u^T v for the term's u = e_a - e_b
+    static T dot(const Term& term, const std::vector<T>& v) {
+        return term.b >= 0 ? v[term.a] - v[term.b] : v[term.a];
+    }
+
+    void refactor() {
+        sys = plan.assemble(table);
+        A.refill(slots, sys.vals);
+        lu.factor(A, order);
+        y = lu.solve(sys.rhs);
+        factored.resize(terminals.size());
+        for (size_t i = 0; i < terminals.size(); ++i) factored[i] = table[Circuit::valueSlot(i)];
+        terms.clear();
     }
+
+    Circuit::StampPlan plan;
+    std::vector<T> table;
+    MNASystem<T> sys{0}; // Right-hand side and layout at the current values
+    SparseMatrix<T> A;
+    std::vector<int> slots, order;
+    SparseLU<T> lu;
+    std::vector<std::pair<int, int>> terminals; // Per component, -1: no admittance stamp
+    std::vector<char> inRhs;
+    std::vector<T> factored; // Per component, its value in the factorization
+    std::vector<T> y;        // A^-1 rhs
+    std::vector<Term> terms;
 };
 
-// --- Generation Logic ---
+// Answers of one exercise kept up to date while its component values change (e.g. dragged
+// in an editor): its MNA systems are factored once and every change is a low-rank update
+// (see IncrementalSolver). Answers agree with solveExercise() to rounding, without worked
+// steps or exact answers. The circuit must outlive it, and only component values may change.
+class LiveExercise {
+public:
+    explicit LiveExercise(Circuit& circuit) : c(circuit) {
+        if (c.exerciseType == AC_STEADY_STATE) {
+            ac.emplace_back(c.stampPlan(false, false, false, false), c.acStampTable(c.omega));
+        } else if (c.targetComp) {
+            // As buildTransientSystems(): initial state, final state, then the target opened
+            // with sources killed and 1 A injected
+            dc.emplace_back(c.stampPlan(true, true, false, false), c.dcStampTable<double>(0.0));
+            dc.emplace_back(c.stampPlan(true, false, false, false), c.dcStampTable<double>(0.0));
+            dc.emplace_back(c.stampPlan(true, false, true, true, true), c.dcStampTable<double>(1.0));
+        }
+    }
 
-Circuit generateGridCircuit() {
-    // 2x2 or 3x2 grid
-    int w = 3;
-    int h = 3; // 3x3 grid = 9 nodes
-    Circuit circuit(w, h);
+    void setValue(size_t comp, double value) {
+        Component& component = c.components[comp];
+        component.value = value;
+        for (auto& s : ac) s.setValue(comp, c.acStampValue(component, c.omega));
+        if (dc.empty() || &component == c.targetComp) return; // The target only enters tau
+        for (auto& s : dc) s.setValue(comp, c.dcStampValue<double>(component));
+    }
 
-    // Track edges to avoid duplicates
-    std::vector<std::pair<int, int>> edges;
-    std::set<std::pair<int, int>> existingEdges; // Stores indices
+    ExerciseSolution solution() {
+        ExerciseSolution sol;
+        if (!ac.empty()) sol.ac = c.acFromSolution(ac[0].solve());
+        if (!dc.empty()) {
+            std::vector<std::vector<double>> x;
+            for (auto& s : dc) x.push_back(s.solve());
+            sol.transient = c.transientFromSolutions(x);
+        }
+        return sol;
+    }
 
-    // 1. Spanning Tree on Grid
-    // Nodes are indexed 0..w*h-1
-    int numNodes = w * h;
-    std::vector<int> visited = {0};
-    std::vector<int> unvisited;
-    for(int i=1; i<numNodes; ++i) unvisited.push_back(i);
+private:
+    Circuit& c;
+    std::vector<IncrementalSolver<double>> dc;
+    std::vector<IncrementalSolver<Complex>> ac;
+};
+
+// ========== JSON Output Helpers ==========
+
+std::string jsonEscape(const std::string& s) {
+    std::string out;
+    out.reserve(s.size() + 16);
+    for (char ch : s) {
+        switch (ch) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if ((unsigned char)ch < 0x20) {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", (unsigned char)ch);
+                    out += buf;
+                } else {
+                    out += ch;
+                }
+        }
+    }
+    return out;
+}
+
+// JSON has no inf/nan literals; degenerate answers (e.g. tau of a shorted L) become null
+std::string jsonNumber(double v) {
+    if (!std::isfinite(v)) return "null";
+    std::ostringstream ss;
+    ss << v;
+    return ss.str();
+}
+
+// Write the solution fields of the JSON object (without braces).
+// pretty = true keeps the one-field-per-line layout the GUIs parse in headless mode,
+// pretty = false writes everything on a single line for the serve protocol.
+void writeSolutionFields(std::ostream& out, const Circuit& c, const ExerciseSolution& sol, bool pretty) {
+    const char* sep = pretty ? ",\n" : ", ";
+    const char* ind = pretty ? "  " : "";
+
+    if (c.exerciseType == AC_STEADY_STATE) {
+        const Circuit::ACResult& result = sol.ac;
+        out << ind << "\"exercise_type\": \"AC\"" << sep;
+        out << ind << "\"frequency\": " << jsonNumber(c.frequency) << sep;
+        out << ind << "\"omega\": " << jsonNumber(c.omega) << sep;
+        out << ind << "\"source_waveform\": \"" << c.sourceWaveform << "\"" << sep;
+        out << ind << "\"source_amplitude\": " << c.sourceAmplitude << sep;
+        out << ind << "\"avg_power\": {" << (pretty ? "\n" : "");
 
-    auto addEdge = [&](int u, int v) {
-        if (u > v) std::swap(u, v);
-        if (existingEdges.find({u, v}) == existingEdges.end()) {
-            existingEdges.insert({u, v});
-            edges.push_back({u, v});
+        size_t count = 0;
+        for (const auto& pair : result.avgPower) {
+            out << (pretty ? "    " : "") << "\"" << pair.first << "\": " << jsonNumber(pair.second);
+            if (count < result.avgPower.size() - 1) out << ",";
+            if (pretty) out << "\n";
+            count++;
         }
-    };
 
-    // Helper to get neighbors on grid
-    auto getNeighbors = [&](int u) {
-        std::vector<int> n;
-        int x = u % w;
-        int y = u / w;
-        if (x > 0) n.push_back(u - 1);
-        if (x < w - 1) n.push_back(u + 1);
-        if (y > 0) n.push_back(u - w);
-        if (y < h - 1) n.push_back(u + w);
-        return n;
+        out << ind << "}";
+        if (result.hasPowerFactor) {
+            out << sep << ind << "\"power_factor\": " << jsonNumber(result.powerFactor);
+        }
+    } else {
+        const Circuit::TransientResult& result = sol.transient;
+        std::string var = (c.targetComp && c.targetComp->type == INDUCTOR) ? "i_L" : "v_C";
+        out << ind << "\"exercise_type\": \"DC\"" << sep;
+        out << ind << "\"initial\": " << jsonNumber(result.initialVal) << sep;
+        out << ind << "\"final\": " << jsonNumber(result.finalVal) << sep;
+        out << ind << "\"tau\": " << jsonNumber(result.tau) << sep;
+        out << ind << "\"variable\": \"" << var << "\"" << sep;
+        out << ind << "\"steps\": [";
+        for (size_t k = 0; k < result.steps.size(); ++k) {
+            out << (k ? ", " : "") << "\"" << jsonEscape(result.steps[k]) << "\"";
+        }
+        out << "]";
+        if (exactAnswers) {
+            const Circuit::ExactTransient& e = sol.exact;
+            auto exact = [&](const char* key, bool has, const Rational& q) {
+                out << sep << ind << "\"" << key << "\": ";
+                if (has) out << "\"" << q.toString() << "\"";
+                else out << "null";
+            };
+            exact("initial_exact", sol.hasExact, e.initialVal);
+            exact("final_exact", sol.hasExact, e.finalVal);
+            exact("tau_exact", sol.hasExact && e.hasTau, e.tau);
+        }
+    }
+
+    // "sensitivities": {"<answer>": {"<component>": d(answer)/d(value), ...}, ...}
+    if (!sol.sensitivities.empty()) {
+        out << sep << ind << "\"sensitivities\": {" << (pretty ? "\n" : "");
+        for (size_t k = 0; k < sol.sensitivities.size(); ++k) {
+            const Circuit::Sensitivity& s = sol.sensitivities[k];
+            out << (pretty ? "    " : "") << "\"" << s.answer << "\": {";
+            bool first = true;
+            for (size_t i = 0; i < c.components.size(); ++i) {
+                if (c.components[i].type == WIRE || c.components[i].type == SWITCH) continue;
+                out << (first ? "" : ", ") << "\"" << jsonEscape(c.components[i].name) << "\": " << jsonNumber(s.d[i] + 0.0); // + 0.0: no "-0"
+                first = false;
+            }
+            out << "}";
+            if (k + 1 < sol.sensitivities.size()) out << ",";
+            if (pretty) out << "\n";
+        }
+        out << ind << "}";
+    }
+}
+
+// Solve the circuit and write its solution fields
+void writeSolutionFields(std::ostream& out, Circuit& c, bool pretty) {
+    writeSolutionFields(out, c, solveExercise(c), pretty);
+}
+
+// Write the fields of a solved exercise (seed, size, question, solution and optionally
+// the inline SVG) on a single line. Shared by serve and batch.
+void writeExerciseFields(std::ostream& out, Circuit& c, const ExerciseSolution& sol, bool includeSvg) {
+    out << "\"seed\": " << c.seed << ", \"width\": " << c.width << ", \"height\": " << c.height << ", ";
+    out << "\"question\": \"" << jsonEscape(c.questionText) << "\", ";
+    writeSolutionFields(out, c, sol, false);
+
+    if (includeSvg) {
+        std::ostringstream svg;
+        c.writeSVG(svg);
+        out << ", \"svg\": \"" << jsonEscape(svg.str()) << "\"";
+    }
+}
+
+// Generate one exercise from its seed, solve it and write its fields
+void writeExerciseFields(std::ostream& out, ExerciseType type, int w, int h, uint64_t seed, bool includeSvg) {
+    Circuit c = generateExercise(type, seed, w, h);
+    writeExerciseFields(out, c, solveExercise(c), includeSvg);
+}
+
+// ========== Serve Mode (persistent worker) ==========
+
+// Minimal parser for the flat request objects of the serve protocol, e.g.
+//   {"id": 7, "type": "AC", "width": 3, "height": 3, "seed": 1234}
+// Values are returned as raw text (strings unquoted); the keys of string values go to
+// strings if given, so a value can be written back with its type. Nested objects are not
+// supported.
+bool parseFlatJSON(const std::string& line, std::map<std::string, std::string>& fields, std::string& error,
+                   std::set<std::string>* strings = nullptr) {
+    size_t i = 0;
+    auto skipWs = [&]() { while (i < line.size() && isspace((unsigned char)line[i])) i++; };
+    auto parseString = [&](std::string& outStr) {
+        if (i >= line.size() || line[i] != '"') return false;
+        i++;
+        while (i < line.size() && line[i] != '"') {
+            if (line[i] == '\\' && i + 1 < line.size()) i++;
+            outStr += line[i++];
+        }
+        if (i >= line.size()) return false;
+        i++;
+        return true;
     };
 
-    // Randomized Prim's/DFS style growth
-    while (!unvisited.empty()) {
-        std::vector<std::pair<int, int>> candidates;
-        for (int u : visited) {
-            for (int v : getNeighbors(u)) {
-                bool isUnvisited = false;
-                for(int uv : unvisited) if(uv == v) isUnvisited = true;
-                if (isUnvisited) {
-                    candidates.push_back({u, v});
+    skipWs();
+    if (i >= line.size() || line[i] != '{') { error = "expected '{'"; return false; }
+    i++;
+    skipWs();
+    if (i < line.size() && line[i] == '}') return true;
+
+    while (i < line.size()) {
+        skipWs();
+        std::string key;
+        if (!parseString(key)) { error = "expected key string"; return false; }
+        skipWs();
+        if (i >= line.size() || line[i] != ':') { error = "expected ':' after \"" + key + "\""; return false; }
+        i++;
+        skipWs();
+        std::string value;
+        if (i < line.size() && line[i] == '"') {
+            if (!parseString(value)) { error = "unterminated string"; return false; }
+            if (strings) strings->insert(key);
+        } else {
+            while (i < line.size() && line[i] != ',' && line[i] != '}' && !isspace((unsigned char)line[i])) {
+                value += line[i++];
+            }
+            if (value.empty() || value[0] == '{' || value[0] == '[') { error = "unsupported value for \"" + key + "\""; return false; }
+        }
+        fields[key] = value;
+        skipWs();
+        if (i < line.size() && line[i] == ',') { i++; continue; }
+        if (i < line.size() && line[i] == '}') return true;
+        error = "expected ',' or '}'";
+        return false;
+    }
+    error = "unexpected end of input";
+    return false;
+}
+
+// Reads one JSON request per line from stdin and answers with one JSON line on stdout:
+//   -> {"id": 1, "type": "DC", "width": 3, "height": 3, "seed": 42}
+//   <- {"id": 1, "seed": 42, "width": 3, "height": 3, "question": "...", "exercise_type": "DC", ..., "svg": "<svg ...>"}
+// Errors are reported as {"id": 1, "error": "..."} and the worker keeps running.
+const long long SERVE_MAX_CELLS = 4096; // Largest grid (width * height) one request may ask for
+
+int runServe() {
+    std::ios::sync_with_stdio(false);
+    std::string line;
+
+    while (std::getline(std::cin, line)) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+
+        std::map<std::string, std::string> req;
+        std::set<std::string> strings;
+        std::string error;
+        std::ostringstream out;
+        out << "{";
+        bool ok = parseFlatJSON(line, req, error, &strings);
+        if (ok && req.count("id")) {
+            // Echo the id so clients can match responses to requests: with its JSON type if
+            // it is an integer, else as a string
+            auto idIt = req.find("id");
+            const char* text = idIt->second.c_str();
+            char* end = nullptr;
+            errno = 0;
+            std::strtoll(text, &end, 10);
+            bool numeric = !strings.count("id") && !idIt->second.empty() && !isspace((unsigned char)text[0]) &&
+                           *end == '\0' && errno == 0;
+            if (numeric) out << "\"id\": " << idIt->second << ", ";
+            else out << "\"id\": \"" << jsonEscape(idIt->second) << "\", ";
+        }
+
+        ExerciseType type = DC_TRANSIENT;
+        int w = 3, h = 3;
+        uint64_t seed = 0;
+        if (ok) {
+            std::string typeArg = req.count("type") ? req["type"] : "DC";
+            if (typeArg == "AC" || typeArg == "ac") type = AC_STEADY_STATE;
+            else if (typeArg != "DC" && typeArg != "dc") { ok = false; error = "unknown type '" + typeArg + "'"; }
+        }
+        if (ok) {
+            try {
+                if (req.count("width")) w = std::stoi(req["width"]);
+                if (req.count("height")) h = std::stoi(req["height"]);
+                if (req.count("seed")) {
+                    // stoull accepts "-5" by wrapping it around, so reject signs explicitly
+                    const std::string& text = req["seed"];
+                    size_t pos = 0;
+                    if (text.find('-') != std::string::npos) throw std::out_of_range("seed");
+                    seed = std::stoull(text, &pos);
+                    if (pos != text.size() || seed > SEED_MASK) throw std::out_of_range("seed");
+                } else {
+                    seed = randomSeed();
                 }
+            } catch (const std::exception&) {
+                ok = false;
+                error = "invalid numeric field";
+            }
+            if (ok && (w < 2 || h < 2)) { ok = false; error = "grid must be at least 2x2"; }
+            if (ok && (long long)w * h > SERVE_MAX_CELLS) {
+                ok = false;
+                error = "grid must have at most " + std::to_string(SERVE_MAX_CELLS) + " cells";
             }
         }
-        if (candidates.empty()) break;
-        int idx = rand() % candidates.size();
-        std::pair<int, int> edge = candidates[idx];
-        addEdge(edge.first, edge.second);
-        visited.push_back(edge.second);
-        for(size_t i=0; i<unvisited.size(); ++i) {
-            if (unvisited[i] == edge.second) {
-                unvisited.erase(unvisited.begin() + i);
-                break;
+
+        if (ok) {
+            std::ostringstream fields;
+            try {
+                writeExerciseFields(fields, type, w, h, seed, true);
+                out << fields.str() << "}";
+            } catch (const std::exception& e) {
+                ok = false;
+                error = std::string("generation failed: ") + e.what();
             }
         }
+        if (!ok) out << "\"error\": \"" << jsonEscape(error) << "\"}";
+        std::cout << out.str() << "\n" << std::flush;
     }
+    return 0;
+}
 
-    // 2. Add extra edges (Cycle forming)
-    int cyclesToAdd = 4;
-    for (int i=0; i<cyclesToAdd * 10; ++i) {
-        if (cyclesToAdd <= 0) break;
-        int u = rand() % numNodes;
-        auto neighbors = getNeighbors(u);
-        int v = neighbors[rand() % neighbors.size()];
-        int u_s = std::min(u, v);
-        int v_s = std::max(u, v);
-        if (existingEdges.find({u_s, v_s}) == existingEdges.end()) {
-            addEdge(u_s, v_s);
-            cyclesToAdd--;
+// ========== Batch Mode (exercise banks) ==========
+
+// circuit_generator batch --type AC|DC --count N [--threads T] [--seed S] [--width W] [--height H] [--svg] [--solver K]
+//                         [--precision P] [--steps] [--exact] [--nice]
+// Writes N exercises as NDJSON to stdout. Exercise i is generated from deriveSeed(S, i) on
+// whichever worker picks it up, and lines are written in index order, so the stream is
+// byte-identical for a given seed regardless of the thread count.
+int runBatch(int argc, char* argv[]) {
+    ExerciseType type = DC_TRANSIENT;
+    long long count = 1;
+    int numThreads = (int)std::max(1u, std::thread::hardware_concurrency());
+    uint64_t baseSeed = randomSeed();
+    int w = 3, h = 3;
+    bool includeSvg = false;
+    bool withSteps = false; // Worked reduction steps of DC exercises (always on in serve/headless)
+
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        try {
+            if (arg == "--type" && hasValue) {
+                std::string t = argv[++i];
+                if (t == "AC" || t == "ac") type = AC_STEADY_STATE;
+                else if (t == "DC" || t == "dc") type = DC_TRANSIENT;
+                else { std::cerr << "Unknown exercise type: " << t << std::endl; return 1; }
+            }
+            else if (arg == "--count" && hasValue) count = std::stoll(argv[++i]);
+            else if (arg == "--threads" && hasValue) numThreads = std::stoi(argv[++i]);
+            else if (arg == "--seed" && hasValue) baseSeed = std::stoull(argv[++i]);
+            else if (arg == "--width" && hasValue) w = std::stoi(argv[++i]);
+            else if (arg == "--height" && hasValue) h = std::stoi(argv[++i]);
+            else if (arg == "--svg") includeSvg = true;
+            else if (arg == "--steps") withSteps = true;
+            else if ((arg == "--solver" || arg == "--precision") && hasValue) ++i; // Handled in main()
+            else if (arg == "--exact" || arg == "--nice") {} // Handled in main()
+            else { std::cerr << "Unknown batch option: " << arg << std::endl; return 1; }
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value for " << arg << std::endl;
+            return 1;
         }
     }
+    if (count < 0 || numThreads < 1 || w < 2 || h < 2) {
+        std::cerr << "Invalid batch parameters" << std::endl;
+        return 1;
+    }
 
-    // 3. Assign Components
-    int rCount = 0, vCount = 0, iCount = 0, cCount = 0, lCount = 0;
-    bool hasSource = false;
-    bool hasSwitched = false;
-    bool hasDynamic = false; // Has L or C
-    
-    // Decide if this is RL or RC circuit
-    bool isRC = (rand() % 2 == 0);
+    std::ios::sync_with_stdio(false);
 
-    // To make it look "smart", try to put voltage sources on the perimeter
-    auto isPerimeter = [&](int n) {
-        int x = n % w;
-        int y = n / w;
-        return x==0 || x==w-1 || y==0 || y==h-1;
-    };
+    // Work in chunks: workers fill the chunk's slots out of order, then the chunk is
+    // written in order. Chunks are large enough that the join is negligible.
+    const int BATCH_EXERCISES = 256;
+    const long long chunkSize = std::max<long long>(1024, 256LL * numThreads);
+    std::vector<std::string> slots;
 
-    // Shuffle edges to randomize assignment order
-    std::random_shuffle(edges.begin(), edges.end());
+    for (long long chunkStart = 0; chunkStart < count; chunkStart += chunkSize) {
+        long long chunkLen = std::min(chunkSize, count - chunkStart);
+        slots.assign(chunkLen, std::string());
+        std::atomic<long long> next(0);
 
-    for (const auto& edge : edges) {
-        Component c;
-        c.nodeA_idx = edge.first;
-        c.nodeB_idx = edge.second;
-        c.pA = circuit.nodes[edge.first];
-        c.pB = circuit.nodes[edge.second];
+        // Each worker takes runs of BATCH_EXERCISES consecutive exercises and solves every
+        // run together with the batched solver
+        auto worker = [&]() {
+            std::ostringstream line;
+            std::vector<Circuit> circuits;
+            std::vector<ExerciseSolution> solutions;
+            for (long long first = next.fetch_add(BATCH_EXERCISES); first < chunkLen;
+                 first = next.fetch_add(BATCH_EXERCISES)) {
+                long long last = std::min<long long>(chunkLen, first + BATCH_EXERCISES);
+                circuits.clear();
+                circuits.reserve(last - first); // No reallocation: circuits hold pointers into themselves
+                for (long long k = first; k < last; ++k) {
+                    circuits.push_back(generateExercise(type, deriveSeed(baseSeed, chunkStart + k), w, h));
+                }
+                solveExercisesBatched(circuits, solutions, withSteps);
 
-        bool perimeterEdge = isPerimeter(edge.first) && isPerimeter(edge.second);
-        
-        // Priority 1: Dynamic Element (L or C) - Place exactly one
-        if (!hasDynamic && (rand() % 10 < 3)) { // 30% chance to place if not yet placed
-             if (isRC) {
-                 c.type = CAPACITOR;
-                 c.name = "C1";
-                 c.value = 10.0 * (rand()%10 + 1); // uF
-             } else {
-                 c.type = INDUCTOR;
-                 c.name = "L1";
-                 c.value = 1.0 * (rand()%10 + 1); // mH
-             }
-             hasDynamic = true;
-             circuit.addComponent(c);
-             continue;
+                for (long long k = first; k < last; ++k) {
+                    line.str("");
+                    line << "{\"index\": " << chunkStart + k << ", ";
+                    writeExerciseFields(line, circuits[k - first], solutions[k - first], includeSvg);
+                    line << "}\n";
+                    slots[k] = line.str();
+                }
+            }
+        };
+
+        int spawn = (int)std::min<long long>(numThreads, chunkLen);
+        std::vector<std::thread> pool;
+        for (int t = 1; t < spawn; ++t) pool.emplace_back(worker);
+        worker();
+        for (auto& th : pool) th.join();
+
+        for (const auto& s : slots) std::cout << s;
+    }
+    std::cout.flush();
+    return 0;
+}
+
+
+// ========== Sweep Mode (frequency response) ==========
+
+// Solves one AC circuit at many frequencies. Only the admittances change with omega, so the
+// stamp plan (see Circuit::StampPlan), the CSC structure (with the slot of every stamp) and the fill-reducing
+// ordering are set up once; each frequency refills the values and refactors numerically.
+// With the ordering paid once, sparse LU refactors faster than banded LU at every size, so
+// the banded backend is only used here when it is asked for explicitly.
+// Copies are independent, one per sweep thread.
+class ACSweep {
+public:
+    explicit ACSweep(const Circuit& circuit)
+        : c(circuit), plan(circuit.stampPlan(false, false, false, false)), base(circuit.buildACMNA()),
+          n(base.n), sparse(circuit.useSparseSolver(n)), banded(circuit.solverKind == SOLVER_BANDED) {
+        values.resize(plan.slots.size());
+        if (sparse) {
+            MNASystem<Complex> pattern(n);
+            pattern.reserve(plan.slots.size());
+            for (size_t k = 0; k < plan.slots.size(); ++k) pattern.add(plan.rows[k], plan.cols[k], Complex(1, 0));
+            A = SparseMatrix<Complex>::fromSystem(pattern, &slots);
+            if (banded) {
+                order = reverseCuthillMcKee(A.symmetricAdjacency());
+            } else if (c.solverKind == SOLVER_NESTED) {
+                std::vector<Point> pts = c.unknownPoints(base);
+                order = nestedDissectionOrdering(A.symmetricAdjacency(), &pts);
+            } else {
+                order = minimumDegreeOrdering(A.symmetricAdjacency());
+            }
         }
-        
-        // Priority 2: Switch - Place exactly one
-        if (!hasSwitched && (rand() % 10 < 3)) {
-            c.type = SWITCH;
-            c.name = "Sw1";
-            c.value = 0; // No value
-            c.startsOpen = (rand() % 2 == 0);
-            hasSwitched = true;
-             circuit.addComponent(c);
-             continue;
+    }
+
+    // Solution of the AC system at omegaVal in the full layout: node voltages 1..N-1, then
+    // V-source currents
+    std::vector<Complex> solve(double omegaVal) {
+        std::vector<Complex> table = c.acStampTable(omegaVal);
+        for (size_t k = 0; k < plan.slots.size(); ++k) values[k] = table[plan.slots[k]];
+
+        if (sparse) {
+            A.refill(slots, values);
+            if (banded) {
+                bandLU.factor(A, order);
+                return base.expanded(bandLU.solve(base.rhs));
+            }
+            lu.factor(A, order);
+            return base.expanded(lu.solve(base.rhs));
         }
+        ComplexMatrix M(n, n);
+        for (size_t k = 0; k < plan.slots.size(); ++k) M.add(plan.rows[k], plan.cols[k], values[k]);
+        return base.expanded(ComplexMatrix::solve(std::move(M), base.rhs));
+    }
 
-        int typeRoll = rand() % 100;
-        
-        if (!hasSource && perimeterEdge && (rand()%2==0)) {
-             // Check total source count (vCount + iCount)
-             if (vCount + iCount < 2) {
-                 c.type = VOLTAGE_SOURCE;
-                 c.name = "V" + std::to_string(++vCount);
-                 c.value = 10.0;
-                 hasSource = true;
-             } else {
-                 // Fallback to Resistor if max sources reached
-                 c.type = RESISTOR;
-                 c.name = "R" + std::to_string(++rCount);
-                 c.value = 100.0 * (rand()%10 + 1);
-             }
-        } else if (typeRoll < 60) {
-            // Resistor (High probability to ensure connectivity)
-            c.type = RESISTOR;
-            c.name = "R" + std::to_string(++rCount);
-            c.value = 100.0 * (rand()%10 + 1);
-        } else if (typeRoll < 85) {
-             // Voltage Source
-             if (vCount + iCount < 2) {
-                 c.type = VOLTAGE_SOURCE;
-                 c.name = "V" + std::to_string(++vCount);
-                 c.value = 5.0 * (rand()%4 + 1);
-                 hasSource = true;
-             } else {
-                 // Fallback
-                 c.type = RESISTOR;
-                 c.name = "R" + std::to_string(++rCount);
-                 c.value = 100.0 * (rand()%10 + 1);
-             }
-        } else {
-             // Current Source
-             if (vCount + iCount < 2) {
-                 c.type = CURRENT_SOURCE;
-                 c.name = "I" + std::to_string(++iCount);
-                 c.value = 1.0 * (rand()%5 + 1);
-                 hasSource = true;
-             } else {
-                 // Fallback
-                 c.type = RESISTOR;
-                 c.name = "R" + std::to_string(++rCount);
-                 c.value = 100.0 * (rand()%10 + 1);
-             }
+private:
+    const Circuit& c;
+    Circuit::StampPlan plan;
+    MNASystem<Complex> base; // Right-hand side and unknown layout (independent of omega)
+    int n;
+    bool sparse, banded;
+    std::vector<Complex> values;
+    SparseMatrix<Complex> A;
+    std::vector<int> slots, order;
+    SparseLU<Complex> lu;
+    BandedLU<Complex> bandLU;
+};
+
+// circuit_generator sweep [--seed S] [--width W] [--height H] [--points N] [--fmin F] [--fmax F] [--threads T] [--solver K]
+//                         [--precision P]
+// Generates the AC exercise for the seed and writes its frequency response as CSV, one row
+// per log-spaced frequency (default: two decades either side of the exercise frequency):
+//   frequency,omega,V<i>_mag,V<i>_deg,...,P_<R>,...[,power_factor]
+// for every node i > 0 with a component on it and every target resistor. Frequencies are
+// split into contiguous ranges across threads and rows are written in frequency order.
+int runSweep(int argc, char* argv[]) {
+    uint64_t seed = randomSeed();
+    int w = 3, h = 3;
+    int points = 1000;
+    double fmin = 0.0, fmax = 0.0;
+    int numThreads = (int)std::max(1u, std::thread::hardware_concurrency());
+
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        try {
+            if (arg == "--seed" && hasValue) seed = std::stoull(argv[++i]);
+            else if (arg == "--width" && hasValue) w = std::stoi(argv[++i]);
+            else if (arg == "--height" && hasValue) h = std::stoi(argv[++i]);
+            else if (arg == "--points" && hasValue) points = std::stoi(argv[++i]);
+            else if (arg == "--fmin" && hasValue) fmin = std::stod(argv[++i]);
+            else if (arg == "--fmax" && hasValue) fmax = std::stod(argv[++i]);
+            else if (arg == "--threads" && hasValue) numThreads = std::stoi(argv[++i]);
+            else if ((arg == "--solver" || arg == "--precision") && hasValue) ++i; // Handled in main()
+            else if (arg == "--exact" || arg == "--nice") {} // Handled in main(), no effect on AC
+            else { std::cerr << "Unknown sweep option: " << arg << std::endl; return 1; }
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value for " << arg << std::endl;
+            return 1;
         }
-        circuit.addComponent(c);
     }
-    
-    // Ensure we have at least one dynamic element and one switch
-    bool foundDyn = false;
-    bool foundSw = false;
-    for(auto& c : circuit.components) {
-        if(c.type == CAPACITOR || c.type == INDUCTOR) foundDyn = true;
-        if(c.type == SWITCH) foundSw = true;
+
+    Circuit c = generateACCircuit(seed, w, h);
+    if (fmin <= 0.0) fmin = c.frequency / 100.0;
+    if (fmax <= 0.0) fmax = c.frequency * 100.0;
+    if (points < 1 || numThreads < 1 || w < 2 || h < 2 || !(fmax >= fmin)) {
+        std::cerr << "Invalid sweep parameters" << std::endl;
+        return 1;
     }
-    
-    if (!foundDyn) {
-        // Force replace last component
-        Component& c = circuit.components.back();
-        if (isRC) { c.type = CAPACITOR; c.name = "C1"; c.value = 100.0; }
-        else { c.type = INDUCTOR; c.name = "L1"; c.value = 10.0; }
+
+    // Nodes worth reporting: everything but ground and unused grid points
+    std::vector<char> used(c.nodes.size(), 0);
+    for (const auto& comp : c.components) {
+        used[comp.nodeA_idx] = 1;
+        used[comp.nodeB_idx] = 1;
     }
-    if (!foundSw && circuit.components.size() > 1) {
-        // Force replace second to last (if not dyn)
-        int idx = circuit.components.size() - 2;
-        if (idx >= 0 && circuit.components[idx].type != CAPACITOR && circuit.components[idx].type != INDUCTOR) {
-            circuit.components[idx].type = SWITCH;
-            circuit.components[idx].name = "Sw1";
-            circuit.components[idx].startsOpen = (rand()%2==0);
+    std::vector<int> reportNodes;
+    for (size_t i = 1; i < used.size(); ++i) {
+        if (used[i]) reportNodes.push_back((int)i);
+    }
+
+    std::ios::sync_with_stdio(false);
+    Circuit::ACResult probe = c.acFromSolution(std::vector<Complex>(c.nodes.size(), Complex(0, 0)));
+    std::cout << "frequency,omega";
+    for (int i : reportNodes) std::cout << ",V" << i << "_mag,V" << i << "_deg";
+    for (const auto& pair : probe.avgPower) std::cout << ",P_" << pair.first;
+    if (probe.hasPowerFactor) std::cout << ",power_factor";
+    std::cout << "\n";
+
+    const double PI = std::acos(-1.0);
+    std::vector<std::string> rows(points);
+    ACSweep prototype(c);
+
+    auto worker = [&](int first, int last) {
+        ACSweep sweep(prototype);
+        std::ostringstream line;
+        line << std::setprecision(6);
+        for (int k = first; k < last; ++k) {
+            double f = (points == 1) ? fmin : fmin * std::pow(fmax / fmin, (double)k / (points - 1));
+            double omegaVal = 2.0 * PI * f;
+            std::vector<Complex> x = sweep.solve(omegaVal);
+            Circuit::ACResult result = c.acFromSolution(x);
+
+            line.str("");
+            line << f << "," << omegaVal;
+            for (int i : reportNodes) line << "," << x[i - 1].magnitude() << "," << x[i - 1].phase() * 180.0 / PI;
+            for (const auto& pair : result.avgPower) line << "," << pair.second;
+            if (result.hasPowerFactor) line << "," << result.powerFactor;
+            line << "\n";
+            rows[k] = line.str();
+        }
+    };
+
+    int spawn = std::min(numThreads, points);
+    std::vector<std::thread> pool;
+    for (int t = 1; t < spawn; ++t) pool.emplace_back(worker, (int)((long long)points * t / spawn), (int)((long long)points * (t + 1) / spawn));
+    worker(0, (int)((long long)points / spawn));
+    for (auto& th : pool) th.join();
+
+    for (const auto& row : rows) std::cout << row;
+    std::cout.flush();
+    return 0;
+}
+
+// ========== Benchmark Mode ==========
+
+// Average wall time of fn() in microseconds over reps runs
+template <class F>
+double benchMicros(int reps, F fn) {
+    auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < reps; ++r) fn();
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(t1 - t0).count() / reps;
+}
+
+// circuit_generator bench [--reps R]
+// Times the linear solvers on the MNA systems of generated grid circuits.
+int runBench(int argc, char* argv[]) {
+    int reps = 2000;
+    for (int i = 2; i + 1 < argc; ++i) {
+        if (std::string(argv[i]) == "--reps") reps = std::max(1, atoi(argv[i + 1]));
+    }
+    volatile double sink = 0.0; // Keeps the optimizer from dropping the solves
+
+    std::cout << "Dense LU on DC MNA systems (initial switch state)" << std::endl;
+    std::cout << std::setw(8) << "grid" << std::setw(8) << "n"
+              << std::setw(22) << "factor+solve [us]" << std::setw(18) << "re-solve [us]" << std::endl;
+    for (int w : {3, 4, 6, 8, 12, 16, 24}) {
+        Circuit c = generateGridCircuit(1, w, w);
+        MNASystem<double> sys = c.buildMNA(true, false);
+        Matrix A = denseMatrix(sys);
+        int n = sys.n;
+        int r = std::max(1, reps * 64 / (n * n));
+
+        double full = benchMicros(r, [&]() { sink = sink + Matrix::solve(A, sys.rhs)[0]; });
+        LUFactorization lu(A);
+        std::vector<double> x(n), work(n);
+        double resolve = benchMicros(r, [&]() {
+            std::copy(sys.rhs.begin(), sys.rhs.end(), x.begin());
+            lu.solveInPlace(x.data(), work.data());
+            sink = sink + x[0];
+        });
+
+        std::cout << std::setw(8) << (std::to_string(w) + "x" + std::to_string(w)) << std::setw(8) << n
+                  << std::setw(22) << std::fixed << std::setprecision(2) << full
+                  << std::setw(18) << resolve << std::endl;
+    }
+
+    // Node compaction: unknowns of the full layout vs the system actually solved
+    std::cout << std::endl << "DC systems after node compaction (256 circuits, both switch states)" << std::endl;
+    std::cout << std::setw(8) << "grid" << std::setw(14) << "full n" << std::setw(14) << "compact n"
+              << std::setw(18) << "solve [us]" << std::endl;
+    for (int w : {3, 6, 12, 24}) {
+        double fullN = 0, compactN = 0;
+        std::vector<MNASystem<double>> systems;
+        for (int e = 0; e < 256; ++e) {
+            Circuit c = generateGridCircuit(deriveSeed(1, e), w, w);
+            for (bool initial : {true, false}) {
+                systems.push_back(c.buildMNA(initial, false));
+                fullN += systems.back().expand.size();
+                compactN += systems.back().n;
+            }
         }
+        Circuit solver(w, w);
+        double t = benchMicros(std::max(1, reps / 1000), [&]() {
+            for (const auto& sys : systems) sink = sink + solver.solveSystem(sys)[0];
+        }) / systems.size();
+        std::cout << std::setw(8) << (std::to_string(w) + "x" + std::to_string(w))
+                  << std::setw(14) << std::setprecision(1) << fullN / systems.size()
+                  << std::setw(14) << compactN / systems.size()
+                  << std::setw(18) << std::setprecision(2) << t << std::endl;
     }
-    
-    // Generate question text (generic for transient)
-    circuit.generateQuestion(); // Logic mostly unused now for interactiveness, but keeps Question Text in SVG?
-    // Let's update generateQuestion to mention the transient nature.
-    
-    // We can just set the text manually here for the SVG.
-    // "Calculate i(t)" or "Calculate v(t)"
-    std::string var = isRC ? "v_C(t)" : "i_L(t)";
-    circuit.questionText = "The switch changes state at t=0. Calculate the transient response " + var + ".";
-    circuit.targetComp = nullptr; // Will be set by solver auto-detect? 
-    // Actually solveTransient needs targetComp.
-    // Let's find it.
-    for(auto& c : circuit.components) {
-        if(c.type == CAPACITOR || c.type == INDUCTOR) {
-            circuit.targetComp = &c;
-            break;
+
+    // Medium systems: banded LU after RCM vs the general sparse LU
+    std::cout << std::endl << "Banded LU (RCM) vs sparse LU (minimum degree), factor+solve [us]" << std::endl;
+    std::cout << std::setw(8) << "grid" << std::setw(8) << "n" << std::setw(8) << "kl" << std::setw(12) << "band MB"
+              << std::setw(12) << "DC banded" << std::setw(12) << "DC sparse"
+              << std::setw(12) << "AC banded" << std::setw(12) << "AC sparse" << std::endl;
+    for (int w : {8, 12, 16, 24, 32, 48}) {
+        MNASystem<double> dc = generateGridCircuit(1, w, w).buildMNA(false, false);
+        MNASystem<Complex> ac = generateACCircuit(1, w, w).buildACMNA();
+        SparseMatrix<double> A = SparseMatrix<double>::fromSystem(dc);
+        BandedLU<double> band;
+        band.factor(A, reverseCuthillMcKee(A.symmetricAdjacency()));
+        int r = std::max(1, reps * 32 / (dc.n * band.kl));
+
+        std::cout << std::setw(8) << (std::to_string(w) + "x" + std::to_string(w)) << std::setw(8) << dc.n
+                  << std::setw(8) << band.kl << std::setw(12) << std::setprecision(2) << band.storage() * 8e-6
+                  << std::setprecision(1)
+                  << std::setw(12) << benchMicros(r, [&]() { sink = sink + solveBandedSystem(dc)[0]; })
+                  << std::setw(12) << benchMicros(r, [&]() { sink = sink + solveSparseSystem(dc)[0]; })
+                  << std::setw(12) << benchMicros(r, [&]() { sink = sink + solveBandedSystem(ac)[0].real; })
+                  << std::setw(12) << benchMicros(r, [&]() { sink = sink + solveSparseSystem(ac)[0].real; })
+                  << std::endl;
+    }
+
+    // Fill-reducing orderings for the sparse LU: factor size (L+U nonzeros, thousands) and
+    // ordering / numeric factor time. Natural order is only run on the smaller grids.
+    std::cout << std::endl << "Sparse LU by ordering (DC final state): fill [k], order and factor [ms]" << std::endl;
+    std::cout << std::setw(8) << "grid" << std::setw(8) << "n" << std::setw(10) << "natural"
+              << std::setw(10) << "min deg" << std::setw(8) << "order" << std::setw(8) << "factor"
+              << std::setw(10) << "ND geom" << std::setw(8) << "order" << std::setw(8) << "factor"
+              << std::setw(10) << "ND BFS" << std::setw(8) << "order" << std::setw(8) << "factor" << std::endl;
+    for (int w : {16, 32, 64, 128}) {
+        Circuit c = generateGridCircuit(1, w, w);
+        MNASystem<double> sys = c.buildMNA(false, false);
+        SparseMatrix<double> A = SparseMatrix<double>::fromSystem(sys);
+        std::vector<Point> pts = c.unknownPoints(sys);
+        int r = std::max(1, reps * 4 / sys.n);
+        std::cout << std::setw(8) << (std::to_string(w) + "x" + std::to_string(w)) << std::setw(8) << sys.n;
+        SparseLU<double> lu;
+        if (w <= 64) {
+            std::vector<int> natural(sys.n);
+            for (int i = 0; i < sys.n; ++i) natural[i] = i;
+            lu.factor(A, natural);
+            std::cout << std::setw(10) << std::setprecision(1) << lu.factorNonZeros() * 1e-3;
+        } else {
+            std::cout << std::setw(10) << "-";
+        }
+        auto column = [&](const std::function<std::vector<int>()>& ordering) {
+            std::vector<int> order;
+            double tOrder = benchMicros(r, [&]() { order = ordering(); });
+            double tFactor = benchMicros(r, [&]() { lu.factor(A, order); sink = sink + lu.Udiag[0]; });
+            std::cout << std::setw(10) << std::setprecision(1) << lu.factorNonZeros() * 1e-3
+                      << std::setw(8) << std::setprecision(2) << tOrder * 1e-3 << std::setw(8) << tFactor * 1e-3;
+        };
+        column([&]() { return minimumDegreeOrdering(A.symmetricAdjacency()); });
+        column([&]() { return nestedDissectionOrdering(A.symmetricAdjacency(), &pts); });
+        column([&]() { return nestedDissectionOrdering(A.symmetricAdjacency()); });
+        std::cout << std::endl;
+    }
+
+    // Large resistive DC systems: sparse LU vs PCG on the nodal form per preconditioner.
+    // "warm" is multigrid PCG started from the initial state's solution, as solveTransient() does.
+    std::cout << std::endl << "DC final state, per solve [us]: sparse LU vs PCG (iterations and time)" << std::endl;
+    std::cout << std::setw(8) << "grid" << std::setw(8) << "n" << std::setw(14) << "sparse LU"
+              << std::setw(8) << "Jacobi" << std::setw(12) << "[us]" << std::setw(8) << "IC(0)" << std::setw(12) << "[us]"
+              << std::setw(8) << "AMG" << std::setw(12) << "[us]" << std::setw(8) << "warm" << std::setw(12) << "[us]"
+              << std::setw(12) << "residual" << std::endl;
+    for (int w : {8, 16, 32, 64, 128, 256}) {
+        Circuit c = generateGridCircuit(1, w, w);
+        MNASystem<double> initial = c.buildMNA(true, false);
+        MNASystem<double> sys = c.buildMNA(false, false);
+        int r = std::max(1, reps * 16 / (sys.n * 8));
+        double direct = benchMicros(r, [&]() { sink = sink + solveSparseSystem(sys)[0]; });
+
+        std::vector<double> x;
+        PCGStats jacobi, ic0, amg, warm;
+        double tJacobi = benchMicros(r, [&]() {
+            x.clear();
+            solveNodalPCG(sys, x, &jacobi, PRECOND_JACOBI);
+            sink = sink + x[0];
+        });
+        double tIC0 = benchMicros(r, [&]() {
+            x.clear();
+            solveNodalPCG(sys, x, &ic0, PRECOND_IC0);
+            sink = sink + x[0];
+        });
+        double tAMG = benchMicros(r, [&]() {
+            x.clear();
+            solveNodalPCG(sys, x, &amg);
+            sink = sink + x[0];
+        });
+        std::vector<double> x0;
+        solveNodalPCG(initial, x0);
+        std::vector<double> guess = sys.compacted(initial.expanded(x0));
+        double tWarm = benchMicros(r, [&]() {
+            x = guess;
+            solveNodalPCG(sys, x, &warm);
+            sink = sink + x[0];
+        });
+
+        std::cout << std::setw(8) << (std::to_string(w) + "x" + std::to_string(w)) << std::setw(8) << sys.n
+                  << std::setw(14) << std::setprecision(1) << direct
+                  << std::setw(8) << jacobi.iterations << std::setw(12) << tJacobi
+                  << std::setw(8) << ic0.iterations << std::setw(12) << tIC0
+                  << std::setw(8) << amg.iterations << std::setw(12) << tAMG
+                  << std::setw(8) << warm.iterations << std::setw(12) << tWarm
+                  << std::setw(12) << std::scientific << std::setprecision(1) << amg.residual
+                  << std::fixed << std::endl;
+    }
+
+    std::vector<SimdKernels> kernels = availableSimdKernels();
+    std::cout << std::endl << "Dense complex LU on AC MNA systems, factor+solve [us] per kernel" << std::endl;
+    std::cout << std::setw(8) << "grid" << std::setw(8) << "n";
+    for (const auto& k : kernels) std::cout << std::setw(12) << k.name;
+    std::cout << std::endl;
+    for (int w : {3, 4, 6, 8, 12, 16, 24}) {
+        Circuit c = generateACCircuit(1, w, w);
+        MNASystem<Complex> sys = c.buildACMNA();
+        ComplexMatrix A = denseMatrix(sys);
+        int n = sys.n;
+        int r = std::max(1, reps * 16 / (n * n));
+
+        std::cout << std::setw(8) << (std::to_string(w) + "x" + std::to_string(w)) << std::setw(8) << n;
+        for (const auto& k : kernels) {
+            double t = benchMicros(r, [&]() { sink = sink + ComplexLUFactorization(A, k).solve(sys.rhs)[0].real; });
+            std::cout << std::setw(12) << std::fixed << std::setprecision(2) << t;
         }
+        std::cout << std::endl;
     }
 
-    return circuit;
-}
+    // Medium dense systems: unblocked LU vs BlockedLU on 1..N threads (random dense matrices,
+    // where every tile takes part in the update)
+    std::vector<int> threadCounts;
+    int cores = (int)std::max(1u, std::thread::hardware_concurrency());
+    for (int t = 1; t < cores; t *= 2) threadCounts.push_back(t);
+    threadCounts.push_back(cores);
+    std::cout << std::endl << "Dense LU, factor+solve [ms]: unblocked vs blocked by threads (" << cores << " hardware threads)" << std::endl;
+    std::cout << std::setw(8) << "type" << std::setw(8) << "n" << std::setw(12) << "unblocked";
+    for (int t : threadCounts) std::cout << std::setw(12) << (std::to_string(t) + " thr");
+    std::cout << std::endl;
+    Rng denseRng(1);
+    std::uniform_real_distribution<double> entry(-1.0, 1.0);
+    for (int n : {256, 512, 1024}) {
+        Matrix A(n, n);
+        ComplexMatrix C(n, n);
+        std::vector<double> b(n);
+        std::vector<Complex> bc(n);
+        for (int i = 0; i < n; ++i) {
+            b[i] = entry(denseRng);
+            bc[i] = Complex(entry(denseRng), entry(denseRng));
+            for (int j = 0; j < n; ++j) {
+                A.at(i, j) = entry(denseRng);
+                C.add(i, j, Complex(entry(denseRng), entry(denseRng)));
+            }
+        }
+        int r = std::max(1, reps * 2 / n / 8);
 
-// ========== Generate AC Steady State Circuit ==========
-Circuit generateACCircuit() {
-    int w = 3;
-    int h = 3;
-    Circuit circuit(w, h);
-    circuit.exerciseType = AC_STEADY_STATE;
-    
-    // Track edges
-    std::vector<std::pair<int, int>> edges;
-    std::set<std::pair<int, int>> existingEdges;
-    
-    int numNodes = w * h;
-    std::vector<int> visited = {0};
-    std::vector<int> unvisited;
-    for(int i=1; i<numNodes; ++i) unvisited.push_back(i);
-    
-    auto addEdge = [&](int u, int v) {
-        if (u > v) std::swap(u, v);
-        if (existingEdges.find({u, v}) == existingEdges.end()) {
-            existingEdges.insert({u, v});
-            edges.push_back({u, v});
+        std::cout << std::setw(8) << "DC" << std::setw(8) << n << std::setprecision(2)
+                  << std::setw(12) << benchMicros(r, [&]() { sink = sink + LUFactorization(A).solve(b)[0]; }) * 1e-3;
+        for (int t : threadCounts) {
+            ThreadPool pool(t);
+            std::cout << std::setw(12) << benchMicros(r, [&]() { sink = sink + BlockedLU<double>(A, pool).solve(b)[0]; }) * 1e-3;
         }
+        std::cout << std::endl;
+        std::cout << std::setw(8) << "AC" << std::setw(8) << n
+                  << std::setw(12) << benchMicros(r, [&]() { sink = sink + ComplexLUFactorization(C).solve(bc)[0].real; }) * 1e-3;
+        for (int t : threadCounts) {
+            ThreadPool pool(t);
+            std::cout << std::setw(12) << benchMicros(r, [&]() { sink = sink + BlockedLU<Complex>(C, pool).solve(bc)[0].real; }) * 1e-3;
+        }
+        std::cout << std::endl;
+    }
+
+    // Mixed precision: single-precision factor plus refinement against the double factor, on
+    // random dense systems (BlockedLU) and grid circuits (sparse LU)
+    std::cout << std::endl << "Mixed-precision LU with refinement vs double, factor+solve [ms]" << std::endl;
+    std::cout << std::setw(8) << "type" << std::setw(8) << "factor" << std::setw(8) << "n" << std::setw(10) << "double"
+              << std::setw(10) << "mixed" << std::setw(8) << "steps" << std::setw(12) << "bwd error" << std::endl;
+    auto mixedRow = [&](const char* type, bool dense, const auto& sys, const auto& solveDouble) {
+        int r = std::max(1, reps * 8 / sys.n / 16);
+        RefinementStats st;
+        auto x = solveDouble();
+        double tDouble = benchMicros(r, [&]() { x = solveDouble(); });
+        double tMixed = benchMicros(r, [&]() { solveMixedPrecision(sys, x, dense, &st); });
+        std::cout << std::setw(8) << type << std::setw(8) << (dense ? "dense" : "sparse") << std::setw(8) << sys.n
+                  << std::setprecision(2) << std::setw(10) << tDouble * 1e-3 << std::setw(10) << tMixed * 1e-3
+                  << std::setw(8) << (st.converged ? std::to_string(st.iterations) : "fail")
+                  << std::setw(12) << std::scientific << std::setprecision(1) << st.backwardError << std::fixed << std::endl;
     };
-    
-    auto getNeighbors = [&](int u) {
-        std::vector<int> n;
-        int x = u % w;
-        int y = u / w;
-        if (x > 0) n.push_back(u - 1);
-        if (x < w - 1) n.push_back(u + 1);
-        if (y > 0) n.push_back(u - w);
-        if (y < h - 1) n.push_back(u + w);
-        return n;
-    };
-   
-    // Spanning tree
-    while (!unvisited.empty()) {
-        std::vector<std::pair<int, int>> candidates;
-        for (int u : visited) {
-            for (int v : getNeighbors(u)) {
-                bool isUnvisited = false;
-                for(int uv : unvisited) if(uv == v) isUnvisited = true;
-                if (isUnvisited) {
-                    candidates.push_back({u, v});
-                }
+    for (int n : {512, 1024}) {
+        MNASystem<double> dc(n);
+        MNASystem<Complex> ac(n);
+        dc.reserve((size_t)n * n);
+        ac.reserve((size_t)n * n);
+        for (int i = 0; i < n; ++i) {
+            dc.rhs[i] = entry(denseRng);
+            ac.rhs[i] = Complex(entry(denseRng), entry(denseRng));
+            for (int j = 0; j < n; ++j) {
+                dc.add(i, j, entry(denseRng));
+                ac.add(i, j, Complex(entry(denseRng), entry(denseRng)));
             }
         }
-        if (candidates.empty()) break;
-        int idx = rand() % candidates.size();
-        std::pair<int, int> edge = candidates[idx];
-        addEdge(edge.first, edge.second);
-        visited.push_back(edge.second);
-        for(size_t i=0; i<unvisited.size(); ++i) {
-            if (unvisited[i] == edge.second) {
-                unvisited.erase(unvisited.begin() + i);
-                break;
-            }
+        mixedRow("DC", true, dc, [&]() { return BlockedLU<double>(denseMatrix(dc)).solve(dc.rhs); });
+        mixedRow("AC", true, ac, [&]() { return BlockedLU<Complex>(denseMatrix(ac)).solve(ac.rhs); });
+    }
+    for (int w : {64, 128}) {
+        MNASystem<double> dc = generateGridCircuit(1, w, w).buildMNA(false, false);
+        MNASystem<Complex> ac = generateACCircuit(1, w, w).buildACMNA();
+        mixedRow("DC", false, dc, [&]() { return solveSparseSystem(dc); });
+        mixedRow("AC", false, ac, [&]() { return solveSparseSystem(ac); });
+    }
+
+    // Independent subcircuits: eight grid circuits chained by single resistors (a bridge between
+    // node 1 of one and node 1 of the next), split at the articulation points and solved on
+    // 1..N threads plus the coupling system, vs one sparse LU of the whole system. Plain grid
+    // circuits have only small pendant pieces and stay in one part.
+    std::cout << std::endl << "Block decomposition of 8 chained grids vs sparse LU, factor+solve [ms]" << std::endl;
+    std::cout << std::setw(8) << "type" << std::setw(8) << "grid" << std::setw(8) << "n" << std::setw(8) << "parts"
+              << std::setw(8) << "|S|" << std::setw(10) << "largest" << std::setw(10) << "sparse";
+    for (int t : threadCounts) std::cout << std::setw(12) << (std::to_string(t) + " thr");
+    std::cout << std::endl;
+    auto blocksRow = [&](const char* type, int w, auto sub) {
+        using T = typename decltype(sub.rhs)::value_type;
+        const int copies = 8;
+        MNASystem<T> sys(sub.n * copies);
+        sys.reserve(sub.vals.size() * copies + 4 * copies);
+        for (int k = 0; k < copies; ++k) {
+            int base = k * sub.n;
+            for (size_t e = 0; e < sub.vals.size(); ++e) sys.add(base + sub.rows[e], base + sub.cols[e], sub.vals[e]);
+            for (int i = 0; i < sub.n; ++i) sys.rhs[base + i] = sub.rhs[i];
+            if (k == 0) continue;
+            T g(1e-3);
+            sys.add(base - sub.n, base - sub.n, g);
+            sys.add(base, base, g);
+            sys.add(base - sub.n, base, T(0) - g);
+            sys.add(base, base - sub.n, T(0) - g);
         }
+        int r = std::max(1, reps / 8 * 1024 / sys.n);
+        auto x = solveSparseSystem(sys);
+        BlockStats st;
+        solveByBlocks(sys, x, &st);
+        std::cout << std::setw(8) << type << std::setw(8) << (std::to_string(w) + "x" + std::to_string(w))
+                  << std::setw(8) << sys.n << std::setw(8) << st.parts << std::setw(8) << st.separator
+                  << std::setw(10) << st.largestPart << std::setprecision(2)
+                  << std::setw(10) << benchMicros(r, [&]() { x = solveSparseSystem(sys); }) * 1e-3;
+        for (int t : threadCounts) {
+            ThreadPool pool(t);
+            std::cout << std::setw(12) << benchMicros(r, [&]() { solveByBlocks(sys, x, nullptr, pool); }) * 1e-3;
+        }
+        std::cout << std::endl;
+    };
+    for (int w : {32, 64, 128}) {
+        blocksRow("DC", w, generateGridCircuit(1, w, w).buildMNA(false, false));
+        blocksRow("AC", w, generateACCircuit(1, w, w).buildACMNA());
     }
-    
-    // Add extra edges
-    int cyclesToAdd = 4;
-    for (int i=0; i<cyclesToAdd * 10; ++i) {
-        if (cyclesToAdd <= 0) break;
-        int u = rand() % numNodes;
-        auto neighbors = getNeighbors(u);
-        if (neighbors.empty()) continue;
-        int v = neighbors[rand() % neighbors.size()];
-        int u_s = std::min(u, v);
-        int v_s = std::max(u, v);
-        if (existingEdges.find({u_s, v_s}) == existingEdges.end()) {
-            addEdge(u_s, v_s);
-            cyclesToAdd--;
+
+    // Hand-calculation path for DC exercises: series-parallel and Y-Delta reduction of the
+    // three networks seen by the target vs solving the three MNA systems, on the exercises
+    // that reduce
+    std::cout << std::endl << "DC transient by network reduction vs MNA, per exercise [us] (256 exercises)" << std::endl;
+    std::cout << std::setw(8) << "grid" << std::setw(10) << "reduced" << std::setw(12) << "reduction"
+              << std::setw(12) << "+ steps" << std::setw(10) << "MNA" << std::endl;
+    for (int w : {3, 4, 6, 8}) {
+        std::vector<Circuit> circuits;
+        circuits.reserve(256); // targetComp points into each circuit's components
+        for (int e = 0; e < 256; ++e) {
+            Circuit c = generateGridCircuit(deriveSeed(1, e), w, w);
+            Circuit::TransientResult result;
+            if (c.reduceTransient(result)) circuits.push_back(std::move(c));
         }
+        if (circuits.empty()) continue;
+        int r = std::max(1, reps / 1000);
+        auto reduction = [&](bool withSteps) {
+            return benchMicros(r, [&]() {
+                for (const auto& c : circuits) {
+                    Circuit::TransientResult result;
+                    c.reduceTransient(result, withSteps);
+                    sink = sink + result.tau;
+                }
+            }) / circuits.size();
+        };
+        double mna = benchMicros(r, [&]() {
+            for (auto& c : circuits) {
+                std::vector<std::vector<double>> x;
+                for (const auto& sys : c.buildTransientSystems()) x.push_back(c.solveSystem(sys, x.size() == 1 ? &x[0] : nullptr));
+                sink = sink + c.transientFromSolutions(x).tau;
+            }
+        }) / circuits.size();
+        std::cout << std::setw(8) << (std::to_string(w) + "x" + std::to_string(w))
+                  << std::setw(10) << (std::to_string(circuits.size()) + "/256") << std::setprecision(2)
+                  << std::setw(12) << reduction(false) << std::setw(12) << reduction(true) << std::setw(10) << mna << std::endl;
     }
-    
-    // Assign components
-    int rCount = 0, vCount = 0, iCount = 0, cCount = 0, lCount = 0;
-    
-    // Decide number of sources (1 or 2)
-    int numSources = (rand() % 2 == 0) ? 1 : 2;
-    int sourcesPlaced = 0;
-    
-    auto isPerimeter = [&](int n) {
-        int x = n % w;
-        int y = n / w;
-        return x==0 || x==w-1 || y==0 || y==h-1;
-    };
-    
-    std::random_shuffle(edges.begin(), edges.end());
-    
-    // Place at least 2 reactive components (L/C)
-    int reactiveCount = 0;
-    int reactiveTarget = 2 + rand() % 2; // 2-3 reactive components
-    
-    for (const auto& edge : edges) {
-        Component c;
-        c.nodeA_idx = edge.first;
-        c.nodeB_idx = edge.second;
-        c.pA = circuit.nodes[edge.first];
-        c.pB = circuit.nodes[edge.second];
-        
-        bool perimeterEdge = isPerimeter(edge.first) && isPerimeter(edge.second);
-        
-        // Priority 1: Place reactive components
-        if (reactiveCount < reactiveTarget && (rand() % 10 < 4)) {
-            if (rand() % 2 == 0) {
-                c.type = CAPACITOR;
-                c.name = "C" + std::to_string(++cCount);
-                c.value = 1.0 * (rand()%10 + 1); // µF
-            } else {
-                c.type = INDUCTOR;
-                c.name = "L" + std::to_string(++lCount);
-                c.value = 1.0 * (rand()%10 + 1); // mH
+
+    // Exact answers: integer width reached and cost against the double MNA solve
+    std::cout << std::endl << "Exact DC answers vs double MNA, per exercise [us] (64 exercises)" << std::endl;
+    std::cout << std::setw(8) << "grid" << std::setw(8) << "exact" << std::setw(8) << "int64" << std::setw(8) << "int128"
+              << std::setw(8) << "bigint" << std::setw(8) << "nice" << std::setw(12) << "exact" << std::setw(10) << "MNA" << std::endl;
+    for (int w : {3, 4, 6}) {
+        std::vector<Circuit> circuits;
+        circuits.reserve(64);
+        for (int e = 0; e < 64; ++e) circuits.push_back(generateGridCircuit(deriveSeed(1, e), w, w));
+        int solved = 0, nice = 0, widths[3] = {0, 0, 0};
+        for (auto& c : circuits) {
+            Circuit::ExactTransient result;
+            if (c.solveTransientExact(result)) {
+                solved++;
+                widths[result.width]++;
             }
-            reactiveCount++;
-            circuit.addComponent(c);
-            continue;
+            nice += isNice(c);
         }
-        
-        // Priority 2: Sources
-        if (sourcesPlaced < numSources && perimeterEdge) {
-            if (rand() % 2 == 0) {
-                c.type = VOLTAGE_SOURCE;
-                c.name = "V" + std::to_string(++vCount);
-                c.value = 5.0 * (rand()%4 + 1);
-            } else {
-                c.type = CURRENT_SOURCE;
-                c.name = "I" + std::to_string(++iCount);
-                c.value = 1.0 * (rand()%3 + 1);
+        int r = std::max(1, reps / 2000);
+        double exact = benchMicros(r, [&]() {
+            for (auto& c : circuits) {
+                Circuit::ExactTransient result;
+                c.solveTransientExact(result);
+                sink = sink + result.tau.toDouble();
             }
-            sourcesPlaced++;
-            circuit.addComponent(c);
-            continue;
-        }
-        
-        // Default: Resistors
-        c.type = RESISTOR;
-        c.name = "R" + std::to_string(++rCount);
-        c.value = 10.0 * (rand()%10 + 1);
-        circuit.addComponent(c);
-    }
-    
-    // Ensure we have at least one source
-    if (sourcesPlaced == 0 && !circuit.components.empty()) {
-        Component& c = circuit.components[0];
-        c.type = VOLTAGE_SOURCE;
-        c.name = "V1";
-        c.value = 10.0;
-        sourcesPlaced = 1;
+        }) / circuits.size();
+        double mna = benchMicros(r, [&]() {
+            for (auto& c : circuits) {
+                std::vector<std::vector<double>> x;
+                for (const auto& sys : c.buildTransientSystems()) x.push_back(c.solveSystem(sys, x.size() == 1 ? &x[0] : nullptr));
+                sink = sink + c.transientFromSolutions(x).tau;
+            }
+        }) / circuits.size();
+        std::cout << std::setw(8) << (std::to_string(w) + "x" + std::to_string(w)) << std::setw(8) << solved
+                  << std::setw(8) << widths[EXACT_INT64] << std::setw(8) << widths[EXACT_INT128] << std::setw(8) << widths[EXACT_BIGINT]
+                  << std::setw(8) << nice << std::setprecision(3) << std::setw(12) << exact << std::setw(10) << mna << std::endl;
     }
-    
-    // Ensure we have at least 2 reactive components
-    if (reactiveCount < 2) {
-        for (size_t i = 0; i < circuit.components.size() && reactiveCount < 2; ++i) {
-            if (circuit.components[i].type == RESISTOR) {
-                if (rand() % 2 == 0) {
-                    circuit.components[i].type = CAPACITOR;
-                    circuit.components[i].name = "C" + std::to_string(++cCount);
-                    circuit.components[i].value = 1.0 * (rand()%10 + 1);
-                } else {
-                    circuit.components[i].type = INDUCTOR;
-                    circuit.components[i].name = "L" + std::to_string(++lCount);
-                    circuit.components[i].value = 1.0 * (rand()%10 + 1);
+
+    // Classroom sizes: the fixed-size solvers against the general dense LU
+    std::cout << std::endl << "Systems of up to " << FIXED_MAX_SIZE << " unknowns, per system [us]: fixed-size vs general dense LU"
+              << std::endl;
+    std::cout << std::setw(8) << "type" << std::setw(8) << "grid" << std::setw(10) << "systems" << std::setw(10) << "fixed"
+              << std::setw(10) << "general" << std::endl;
+    for (int w : {2, 3, 4}) {
+        std::vector<MNASystem<double>> dc;
+        std::vector<MNASystem<Complex>> ac;
+        for (int e = 0; e < 256; ++e) {
+            for (auto& sys : generateGridCircuit(deriveSeed(1, e), w, w).buildTransientSystems()) {
+                if (sys.n >= 1 && sys.n <= FIXED_MAX_SIZE) dc.push_back(std::move(sys));
+            }
+            MNASystem<Complex> sys = generateACCircuit(deriveSeed(1, e), w, w).buildACMNA();
+            if (sys.n >= 1 && sys.n <= FIXED_MAX_SIZE) ac.push_back(std::move(sys));
+        }
+        int r = std::max(1, reps / 100);
+        auto row = [&](const char* type, const auto& systems) {
+            if (systems.empty()) return;
+            double fixed = benchMicros(r, [&]() {
+                for (const auto& sys : systems) {
+                    std::remove_reference_t<decltype(sys.rhs)> x;
+                    solveFixedSize(sys, x);
+                    sink = sink + magSq(x[0]);
                 }
-                reactiveCount++;
+            }) / systems.size();
+            double general = benchMicros(r, [&]() {
+                for (const auto& sys : systems) {
+                    auto x = decltype(denseMatrix(sys))::solve(denseMatrix(sys), sys.rhs);
+                    sink = sink + magSq(x[0]);
+                }
+            }) / systems.size();
+            std::cout << std::setw(8) << type << std::setw(8) << (std::to_string(w) + "x" + std::to_string(w))
+                      << std::setw(10) << systems.size() << std::setprecision(3) << std::setw(10) << fixed
+                      << std::setw(10) << general << std::endl;
+        };
+        row("DC", dc);
+        row("AC", ac);
+    }
+
+    // Bank workloads: thousands of tiny systems, one by one vs the batched solver
+    std::cout << std::endl << "Small systems of 1024 exercises, per system [us]: one by one vs batched per kernel" << std::endl;
+    std::cout << std::setw(8) << "type" << std::setw(8) << "grid" << std::setw(10) << "single";
+    for (const auto& k : kernels) std::cout << std::setw(12) << k.name;
+    std::cout << std::endl;
+    const int exercises = 1024;
+    int batchReps = std::max(1, reps / 200);
+    for (int w : {3, 4}) {
+        std::vector<MNASystem<double>> dc;
+        std::vector<MNASystem<Complex>> ac;
+        for (int e = 0; e < exercises; ++e) {
+            Circuit dcCircuit = generateGridCircuit(deriveSeed(1, e), w, w);
+            if (dcCircuit.targetComp) {
+                for (auto& sys : dcCircuit.buildTransientSystems()) dc.push_back(std::move(sys));
             }
+            ac.push_back(generateACCircuit(deriveSeed(1, e), w, w).buildACMNA());
+        }
+        std::vector<const MNASystem<double>*> dcPtr;
+        std::vector<const MNASystem<Complex>*> acPtr;
+        for (const auto& sys : dc) dcPtr.push_back(&sys);
+        for (const auto& sys : ac) acPtr.push_back(&sys);
+        std::string grid = std::to_string(w) + "x" + std::to_string(w);
+
+        double single = benchMicros(batchReps, [&]() {
+            for (const auto& sys : dc) sink = sink + Matrix::solve(denseMatrix(sys), sys.rhs)[0];
+        }) / dc.size();
+        std::cout << std::setw(8) << "DC" << std::setw(8) << grid << std::setw(10) << single;
+        for (const auto& k : kernels) {
+            std::vector<std::vector<double>> x;
+            double t = benchMicros(batchReps, [&]() { solveDenseBatch(dcPtr, x, k); sink = sink + x[0][0]; }) / dc.size();
+            std::cout << std::setw(12) << t;
+        }
+        std::cout << std::endl;
+
+        single = benchMicros(batchReps, [&]() {
+            for (const auto& sys : ac) sink = sink + ComplexLUFactorization(denseMatrix(sys)).solve(sys.rhs)[0].real;
+        }) / ac.size();
+        std::cout << std::setw(8) << "AC" << std::setw(8) << grid << std::setw(10) << single;
+        for (const auto& k : kernels) {
+            std::vector<std::vector<Complex>> x;
+            double t = benchMicros(batchReps, [&]() { solveDenseBatch(acPtr, x, k); sink = sink + x[0][0].real; }) / ac.size();
+            std::cout << std::setw(12) << t;
         }
+        std::cout << std::endl;
     }
-    
-    // Pick 1-3 resistors for power calculation
-    std::vector<Component*> resistors;
-    for (auto& c : circuit.components) {
-        if (c.type == RESISTOR) resistors.push_back(&c);
+
+    // Assembly: compiling the stamp plan (the old component walk) vs re-assembly from it
+    std::cout << std::endl << "DC assembly of the three transient systems, per exercise [us]: compile + assemble vs reused plan"
+              << std::endl;
+    std::cout << std::setw(8) << "grid" << std::setw(10) << "stamps" << std::setw(12) << "compile" << std::setw(12) << "reused" << std::endl;
+    for (int w : {3, 8, 32}) {
+        Circuit c = generateGridCircuit(1, w, w);
+        if (!c.targetComp) continue;
+        int r = std::max(1, reps * 4 / (w * w));
+        auto assembleAll = [&](bool fresh) {
+            bool configs[3][3] = {{true, false, false}, {false, false, false}, {false, true, true}}; // As buildTransientSystems
+            for (auto& k : configs) {
+                std::vector<double> table = c.dcStampTable<double>(k[2] ? 1.0 : 0.0);
+                MNASystem<double> sys = fresh ? c.compileStampPlan(true, k[0], k[1], k[2], k[2]).assemble(table)
+                                              : c.stampPlan(true, k[0], k[1], k[2], k[2]).assemble(table);
+                sink = sink + sys.vals[0];
+            }
+        };
+        double compile = benchMicros(r, [&]() { assembleAll(true); });
+        double reused = benchMicros(r, [&]() { assembleAll(false); });
+        std::cout << std::setw(8) << (std::to_string(w) + "x" + std::to_string(w)) << std::setw(10) << c.buildMNA(false, false).vals.size()
+                  << std::setprecision(3) << std::setw(12) << compile << std::setw(12) << reused << std::endl;
     }
-    
-    if (!resistors.empty()) {
-        int numPowerQuestions = std::min((int)resistors.size(), 1 + rand() % 3);
-        std::random_shuffle(resistors.begin(), resistors.end());
-        for (int i = 0; i < numPowerQuestions && i < (int)resistors.size(); ++i) {
-            resistors[i]->highlightRed = true;
-            circuit.targetResistors.push_back(resistors[i]);
+
+    // Live value changes: solving the edited exercise again vs low-rank updates (LiveExercise)
+    std::cout << std::endl << "DC exercise after changing one resistor, per change [us]: full re-solve vs incremental update"
+              << std::endl;
+    std::cout << std::setw(8) << "grid" << std::setw(8) << "n" << std::setw(14) << "full" << std::setw(14) << "incremental" << std::endl;
+    for (int w : {8, 16, 32, 64}) {
+        Circuit c = generateGridCircuit(1, w, w);
+        if (!c.targetComp) continue;
+        std::vector<size_t> resistors;
+        for (size_t i = 0; i < c.components.size(); ++i) {
+            if (c.components[i].type == RESISTOR) resistors.push_back(i);
         }
+        int n = c.buildMNA(false, false).n;
+        int r = std::max(4, reps * 4 / (n * 8));
+        size_t next = 0;
+        auto change = [&]() {
+            size_t i = resistors[next++ % resistors.size()];
+            return std::make_pair(i, c.components[i].value * 1.01);
+        };
+        double full = benchMicros(r, [&]() {
+            auto v = change();
+            c.components[v.first].value = v.second;
+            sink = sink + solveExercise(c).transient.tau;
+        });
+        LiveExercise live(c);
+        double incremental = benchMicros(r, [&]() {
+            auto v = change();
+            live.setValue(v.first, v.second);
+            sink = sink + live.solution().transient.tau;
+        });
+        std::cout << std::setw(8) << (std::to_string(w) + "x" + std::to_string(w)) << std::setw(8) << n
+                  << std::setw(14) << full << std::setw(14) << incremental << std::endl;
     }
-    
-    // ===== INTELLIGENT FREQUENCY SELECTION WITH ROUND VALUES =====
-    int strategy = rand() % 10;
-    
-    // Possible round omega values (rad/s)
-    std::vector<int> roundOmegas = {10, 50, 100, 200, 300, 500, 1000, 2000, 5000, 7000, 10000};
-    
-    if (strategy < 4 && cCount > 0 && lCount > 0) {
-        // Strategy 1 (40%): Resonance - ω = 1/√(LC)
-        Component* selectedL = nullptr;
-        Component* selectedC = nullptr;
-        for (auto& c : circuit.components) {
-            if (!selectedL && c.type == INDUCTOR) selectedL = &c;
-            if (!selectedC && c.type == CAPACITOR) selectedC = &c;
-            if (selectedL && selectedC) break;
-        }
-        
-        if (selectedL && selectedC) {
-            double L_h = selectedL->value * 1e-3;
-            double C_f = selectedC->value * 1e-6;
-            double omega_resonance = 1.0 / std::sqrt(L_h * C_f);
-            
-            // Find closest round omega
-            int closestOmega = roundOmegas[0];
-            double minDiff = std::abs(omega_resonance - closestOmega);
-            for (int omega : roundOmegas) {
-                double diff = std::abs(omega_resonance - omega);
-                if (diff < minDiff) {
-                    minDiff = diff;
-                    closestOmega = omega;
-                }
-            }
-            circuit.omega = closestOmega;
-            circuit.frequency = circuit.omega / (2.0 * 3.14159265359);
-        } else {
-            circuit.omega = 1000.0;
-            circuit.frequency = circuit.omega / (2.0 * 3.14159265359);
+
+    // Repeated transient solves of one topology (new source values each time): factoring
+    // every state again vs the factorization cache
+    std::cout << std::endl << "DC exercise re-solved with new source values, per solve [us]: refactor vs factorization cache"
+              << std::endl;
+    std::cout << std::setw(8) << "grid" << std::setw(8) << "n" << std::setw(14) << "refactor" << std::setw(14) << "cached" << std::endl;
+    for (int w : {8, 16, 32, 64}) {
+        Circuit c = generateGridCircuit(1, w, w);
+        if (!c.targetComp) continue;
+        c.solverKind = SOLVER_SPARSE; // Past network reduction, as for circuits it does not reduce
+        std::vector<size_t> sources;
+        for (size_t i = 0; i < c.components.size(); ++i) {
+            if (c.components[i].type == VOLTAGE_SOURCE || c.components[i].type == CURRENT_SOURCE) sources.push_back(i);
         }
-    } else if (strategy < 8) {
-        // Strategy 2 (40%): Unit simplification - ω = 1000 rad/s
-        circuit.omega = 1000.0;
-        circuit.frequency = circuit.omega / (2.0 * 3.14159265359);
-    } else {
-        // Strategy 3 (20%): Random round value
-        circuit.omega = roundOmegas[rand() % roundOmegas.size()];
-        circuit.frequency = circuit.omega / (2.0 * 3.14159265359);
+        if (sources.empty()) continue;
+        int n = c.buildMNA(false, false).n;
+        int r = std::max(4, reps * 4 / (n * 8));
+        size_t next = 0;
+        auto resolve = [&](bool cached) {
+            c.components[sources[next++ % sources.size()]].value *= 1.01;
+            if (!cached) c.factorizations.clear();
+            sink = sink + c.solveTransient().tau;
+        };
+        double refactor = benchMicros(r, [&]() { resolve(false); });
+        double cached = benchMicros(r, [&]() { resolve(true); });
+        std::cout << std::setw(8) << (std::to_string(w) + "x" + std::to_string(w)) << std::setw(8) << n
+                  << std::setw(14) << refactor << std::setw(14) << cached << std::endl;
     }
-    
-    // Generate question text
-    std::stringstream ss;
-    
-    // Randomly choose sin or cos
-    circuit.sourceWaveform = (rand() % 2 == 0) ? "sin" : "cos";
-    
-    // Generate random amplitude (1-10 A)
-    std::vector<int> possibleAmps = {1, 2, 3, 5, 10};
-    circuit.sourceAmplitude = possibleAmps[rand() % possibleAmps.size()];
-    
-    // Show waveform with concrete amplitude value
-    ss << "Circuito AC con i_s(t) = " << circuit.sourceAmplitude << "*" 
-       << circuit.sourceWaveform << "(" << (int)circuit.omega << "t) A. ";
-    
-    if (!circuit.targetResistors.empty()) {
-        ss << "Calcola la potenza media assorbita da ";
-        for (size_t i = 0; i < circuit.targetResistors.size(); ++i) {
-            ss << circuit.targetResistors[i]->name;
-            if (i < circuit.targetResistors.size() - 1) ss << ", ";
+
+    // Multi-port equivalents: one Req-style injection solve per port vs the Schur complement
+    std::cout << std::endl << "DC impedance matrix of 8 ports [us]: one injection solve per port vs Schur complement" << std::endl;
+    std::cout << std::setw(8) << "grid" << std::setw(8) << "n" << std::setw(14) << "per port" << std::setw(14) << "schur" << std::endl;
+    for (int w : {8, 16, 32}) {
+        Circuit c = generateGridCircuit(1, w, w);
+        if (!c.targetComp) continue;
+        // Resistors spread over the grid, skipping any whose removal leaves a terminal floating
+        std::vector<const Component*> ports;
+        Circuit::MultiPort<double> mp;
+        for (size_t i = 0; i < c.components.size() && ports.size() < 8; i += c.components.size() / 24 + 1) {
+            if (c.components[i].type != RESISTOR) continue;
+            ports.push_back(&c.components[i]);
+            if (!c.dcMultiPort(ports, false, mp)) ports.pop_back();
         }
-        ss << ". ";
+        if (ports.size() < 8) continue;
+
+        // The injection route on a copy with every port opened: each port in turn is the
+        // target (plans are per target, so they are dropped in between)
+        Circuit opened = c;
+        opened.targetComp = &opened.components[c.targetComp - c.components.data()];
+        for (const Component* p : ports) opened.components[p - c.components.data()].type = CAPACITOR;
+        int n = c.buildMNA(false, false).n;
+        int r = std::max(2, reps / (n * 4));
+        double perPort = benchMicros(r, [&]() {
+            for (const Component* p : ports) {
+                opened.targetComp = &opened.components[p - c.components.data()];
+                opened.stampPlans.clear();
+                std::vector<double> v = opened.nodeVoltages(opened.solveSystem(opened.buildMNA(false, true, 1.0, true)));
+                sink = sink + v[p->nodeA_idx] - v[p->nodeB_idx];
+            }
+        });
+        double schur = benchMicros(r, [&]() {
+            c.dcMultiPort(ports, false, mp);
+            sink = sink + mp.Z[0];
+        });
+        std::cout << std::setw(8) << (std::to_string(w) + "x" + std::to_string(w)) << std::setw(8) << n
+                  << std::setw(14) << perPort << std::setw(14) << schur << std::endl;
     }
-    
-    if (sourcesPlaced == 1) {
-       ss << "Calcola il fattore di potenza del generatore.";
+
+    // Sensitivities: one perturbed solve per component (forward differences) vs adjoint solves
+    std::cout << std::endl << "DC sensitivities of initial/final/tau to every component [us]: perturbed solves vs adjoint" << std::endl;
+    std::cout << std::setw(8) << "grid" << std::setw(12) << "components" << std::setw(14) << "perturbed" << std::setw(14) << "adjoint" << std::endl;
+    for (int w : {3, 8, 16}) {
+        Circuit c = generateGridCircuit(1, w, w);
+        if (!c.targetComp) continue;
+        int r = std::max(2, reps / (w * w * w));
+        double perturbed = benchMicros(r, [&]() {
+            double base = c.solveTransient().tau;
+            for (auto& comp : c.components) {
+                if (comp.type == WIRE || comp.type == SWITCH) continue;
+                double v = comp.value;
+                comp.value = v * (1.0 + 1e-6);
+                sink = sink + (c.solveTransient().tau - base) / (v * 1e-6);
+                comp.value = v;
+            }
+        });
+        double adjoint = benchMicros(r, [&]() { sink = sink + c.sensitivities()[2].d[0]; });
+        std::cout << std::setw(8) << (std::to_string(w) + "x" + std::to_string(w)) << std::setw(12) << c.components.size()
+                  << std::setw(14) << perturbed << std::setw(14) << adjoint << std::endl;
     }
-    
-    circuit.questionText = ss.str();
-    
-    return circuit;
+
+    // Frequency sweeps: rebuilding and reordering the system at every frequency vs ACSweep
+    std::cout << std::endl << "AC sweep, per frequency [us]: full setup vs reused pattern/ordering" << std::endl;
+    std::cout << std::setw(8) << "grid" << std::setw(8) << "n" << std::setw(14) << "full" << std::setw(14) << "reused" << std::endl;
+    for (int w : {4, 8, 16, 32}) {
+        Circuit c = generateACCircuit(1, w, w);
+        int n = c.buildACMNA().n;
+        int r = std::max(1, reps * 4 / (n * 8));
+        double full = benchMicros(r, [&]() {
+            c.omega *= 1.001;
+            sink = sink + c.solveSystem(c.buildACMNA())[0].real;
+        });
+        ACSweep sweep(c);
+        double reused = benchMicros(r, [&]() {
+            c.omega *= 1.001;
+            sink = sink + sweep.solve(c.omega)[0].real;
+        });
+        std::cout << std::setw(8) << (std::to_string(w) + "x" + std::to_string(w)) << std::setw(8) << n
+                  << std::setw(14) << full << std::setw(14) << reused << std::endl;
+    }
+    return 0;
 }
 
+bool parseSolverKind(const std::string& name, LinearSolverKind& kind) {
+    if (name == "auto") kind = SOLVER_AUTO;
+    else if (name == "dense") kind = SOLVER_DENSE;
+    else if (name == "sparse") kind = SOLVER_SPARSE;
+    else if (name == "pcg") kind = SOLVER_ITERATIVE;
+    else if (name == "banded") kind = SOLVER_BANDED;
+    else if (name == "nd") kind = SOLVER_NESTED;
+    else if (name == "blocks") kind = SOLVER_BLOCKS;
+    else return false;
+    return true;
+}
 
 int main(int argc, char* argv[]) {
-    srand(time(0));
-    
+    // --solver auto|dense|sparse|pcg|banded|nd|blocks applies to every mode
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::string(argv[i]) == "--solver" && !parseSolverKind(argv[i + 1], defaultSolverKind)) {
+            std::cerr << "Unknown solver: " << argv[i + 1] << std::endl;
+            return 1;
+        }
+    }
+    // --precision double|mixed: mixed factors the systems of solveMNA()/solveAC() in
+    // single precision and refines in double, falling back to double when that fails
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::string(argv[i]) != "--precision") continue;
+        std::string p = argv[i + 1];
+        if (p == "double" || p == "mixed") {
+            defaultMixedPrecision = (p == "mixed");
+        } else {
+            std::cerr << "Unknown precision: " << p << std::endl;
+            return 1;
+        }
+    }
+
+    // --exact adds the DC answers as exact fractions ("initial_exact", "final_exact",
+    // "tau_exact"); --nice only generates DC exercises whose answers are simple fractions
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--exact") exactAnswers = true;
+        if (std::string(argv[i]) == "--nice") niceExercises = true;
+    }
+
+    // Persistent worker: many exercises per process over stdin/stdout
+    if (argc > 1 && std::string(argv[1]) == "serve") {
+        return runServe();
+    }
+
+    // Exercise bank generation on all cores
+    if (argc > 1 && std::string(argv[1]) == "batch") {
+        return runBatch(argc, argv);
+    }
+
+    // Frequency response of one AC exercise as CSV
+    if (argc > 1 && std::string(argv[1]) == "sweep") {
+        return runSweep(argc, argv);
+    }
+
+    // Solver timings
+    if (argc > 1 && std::string(argv[1]) == "bench") {
+        return runBench(argc, argv);
+    }
+
     // Check for Headless Mode and Exercise Type
     bool headless = false;
     ExerciseType exerciseType = DC_TRANSIENT;
@@ -1493,8 +7600,27 @@ int main(int argc, char* argv[]) {
         }
     }
     
+    // --seed N regenerates a specific exercise, --width/--height set the grid size
+    uint64_t seed = randomSeed();
+    int w = 3, h = 3;
+    for (int i = 1; i + 1 < argc; ++i) {
+        std::string arg = argv[i];
+        try {
+            if (arg == "--seed") seed = std::stoull(argv[i + 1]);
+            else if (arg == "--width") w = std::stoi(argv[i + 1]);
+            else if (arg == "--height") h = std::stoi(argv[i + 1]);
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value for " << arg << ": " << argv[i + 1] << std::endl;
+            return 1;
+        }
+    }
+    if (w < 2 || h < 2) {
+        std::cerr << "Grid must be at least 2x2" << std::endl;
+        return 1;
+    }
+    
     // Generate appropriate circuit
-    Circuit c = (exerciseType == AC_STEADY_STATE) ? generateACCircuit() : generateGridCircuit();
+    Circuit c = generateExercise(exerciseType, seed, w, h);
     
     if (!headless) {
         // Text Output
@@ -1503,6 +7629,7 @@ int main(int argc, char* argv[]) {
         } else {
             std::cout << "Generated First Order Circuit with Switch." << std::endl;
         }
+        std::cout << "Seed: " << c.seed << " (use --seed " << c.seed << " to regenerate this exercise)" << std::endl;
         for(const auto& comp : c.components) {
             std::cout << comp.toString() << std::endl;
         }
@@ -1512,40 +7639,22 @@ int main(int argc, char* argv[]) {
     // Visual Output
     c.exportSVG("circuit.svg");
     
+    if (headless) {
+        // JSON Output for GUI
+        std::cout << "{" << std::endl;
+        std::cout << "  \"seed\": " << c.seed << "," << std::endl;
+        ExerciseSolution sol = solveExercise(c);
+        sol.sensitivities = c.sensitivities(); // Which components matter most, for the GUI
+        writeSolutionFields(std::cout, c, sol, true);
+        std::cout << std::endl << "}" << std::endl;
+        return 0;
+    }
+
     // Solve and output
     if (exerciseType == AC_STEADY_STATE) {
         // AC Mode
         Circuit::ACResult result = c.solveAC();
         
-        if (headless) {
-            // JSON Output for GUI
-            std::cout << "{" << std::endl;
-            std::cout << "  \"exercise_type\": \"AC\"," << std::endl;
-            std::cout << "  \"frequency\": " << c.frequency << "," << std::endl;
-            std::cout << "  \"omega\": " << c.omega << "," << std::endl;
-            std::cout << "  \"source_waveform\": \"" << c.sourceWaveform << "\"," << std::endl;
-            std::cout << "  \"source_amplitude\": " << c.sourceAmplitude << "," << std::endl;
-            std::cout << "  \"avg_power\": {" << std::endl;
-            
-            size_t count = 0;
-            for (const auto& pair : result.avgPower) {
-                std::cout << "    \"" << pair.first << "\": " << pair.second;
-                if (count < result.avgPower.size() - 1) std::cout << ",";
-                std::cout << std::endl;
-                count++;
-            }
-            
-            std::cout << "  }";
-            if (result.hasPowerFactor) {
-                std::cout << "," << std::endl;
-                std::cout << "  \"power_factor\": " << result.powerFactor << std::endl;
-            } else {
-                std::cout << std::endl;
-            }
-            std::cout << "}" << std::endl;
-            return 0;
-        }
-        
         // Interactive AC mode (terminal)
         std::cout << "\n=== AC Circuit Analysis ===" << std::endl;
         std::cout << "Frequency: " << c.frequency << " Hz" << std::endl;
@@ -1563,22 +7672,43 @@ int main(int argc, char* argv[]) {
         // DC Transient Mode
         Circuit::TransientResult result = c.solveTransient();
         std::string var = (c.targetComp && c.targetComp->type == INDUCTOR) ? "i_L" : "v_C";
-        
-        if (headless) {
-            // JSON Output for GUI
-            std::cout << "{" << std::endl;
-            std::cout << "  \"exercise_type\": \"DC\"," << std::endl;
-            std::cout << "  \"initial\": " << result.initialVal << "," << std::endl;
-            std::cout << "  \"final\": " << result.finalVal << "," << std::endl;
-            std::cout << "  \"tau\": " << result.tau << "," << std::endl;
-            std::cout << "  \"variable\": \"" << var << "\"" << std::endl;
-            std::cout << "}" << std::endl;
-            return 0;
-        }
+        Circuit::ExactTransient exact;
+        bool hasExact = exactAnswers && c.solveTransientExact(exact);
         
         // Interactive Solver (Terminal)
         double userAnswer;
         
+        // With --exact, an answer given as a fraction p/q must equal the exact one
+        auto askExact = [&](std::string prompt, const Rational& correctVal) {
+            std::cout << "\n> " << prompt << ": ";
+            std::string text;
+            size_t slash = std::string::npos;
+            long long p = 0, q = 0;
+            try {
+                if (std::cin >> text) {
+                    slash = text.find('/');
+                    if (slash == std::string::npos) userAnswer = std::stod(text);
+                    else { p = std::stoll(text.substr(0, slash)); q = std::stoll(text.substr(slash + 1)); }
+                }
+            } catch (const std::exception&) {
+                text.clear();
+            }
+            if (text.empty() || (slash != std::string::npos && q == 0)) {
+                std::cout << "Invalid input." << std::endl;
+                exit(0);
+            }
+            double correctNum = correctVal.toDouble();
+            bool correct;
+            if (slash != std::string::npos) {
+                correct = (Rational(BigInt(p), BigInt(q)) == correctVal);
+            } else {
+                double diff = std::abs(userAnswer - correctNum);
+                correct = ((std::abs(correctNum) > 1e-9) ? (diff / std::abs(correctNum)) : diff) < 0.05;
+            }
+            if (correct) std::cout << "Correct!" << std::endl;
+            else std::cout << "Incorrect. The correct answer was: " << correctVal.toString() << " (" << correctNum << ")" << std::endl;
+        };
+        
         auto ask = [&](std::string prompt, double correctVal) {
             std::cout << "\n> " << prompt << ": ";
             if (std::cin >> userAnswer) {
@@ -1595,9 +7725,15 @@ int main(int argc, char* argv[]) {
             }
         };
         
-        ask("Calculate " + var + "(0-) [Initial Value]", result.initialVal);
-        ask("Calculate " + var + "(infinity) [Final Value]", result.finalVal);
-        ask("Calculate Tau (Time Constant)", result.tau);
+        if (hasExact) {
+            askExact("Calculate " + var + "(0-) [Initial Value]", exact.initialVal);
+            askExact("Calculate " + var + "(infinity) [Final Value]", exact.finalVal);
+        } else {
+            ask("Calculate " + var + "(0-) [Initial Value]", result.initialVal);
+            ask("Calculate " + var + "(infinity) [Final Value]", result.finalVal);
+        }
+        if (hasExact && exact.hasTau) askExact("Calculate Tau (Time Constant)", exact.tau);
+        else ask("Calculate Tau (Time Constant)", result.tau);
         
         std::cout << "\nThe full transient response is: " << var << "(t) = " 
                   << result.finalVal << " + (" << result.initialVal << " - " << result.finalVal << ") * e^(-t / " << result.tau << ")" << std::endl;
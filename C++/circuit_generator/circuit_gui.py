@@ -4,6 +4,8 @@ import subprocess
 import json
 import os
 
+from generator_worker import GeneratorWorker
+
 # Configuration
 GENERATOR_PATH = "./circuit_generator"
 SVG_PATH = "circuit.svg"
@@ -68,6 +70,7 @@ class CircuitApp:
         self.exercise_type = "DC"  # DC or AC
         self.exercise_history = []  # Stack of (circuit_data, solution, exercise_type)
         self.current_index = -1  # Current position in history
+        self.worker = GeneratorWorker(GENERATOR_PATH)  # Persistent `circuit_generator serve` process
         
         # Main container - zero padding
         main_container = tk.Frame(root, bg=COLORS['bg'])
@@ -413,23 +416,16 @@ class CircuitApp:
         self.question_label.config(text="")
             
         try:
-            # 1. Run C++ Generator with exercise type
-            exercise_arg = self.exercise_type
-            result = subprocess.run([GENERATOR_PATH, "headless", exercise_arg], capture_output=True, text=True)
-            if result.returncode != 0:
-                messagebox.showerror("Errore", "Generatore fallito:\n" + result.stderr)
+            # 1. Ask the persistent C++ worker for a new exercise
+            self.solution = self.worker.request(self.exercise_type)
+            if 'error' in self.solution:
+                messagebox.showerror("Errore", "Generatore fallito:\n" + self.solution['error'])
                 self.status_label.config(text="Errore generazione circuito", fg=COLORS['error'])
                 return
-                
-            # Parse JSON
-            output_str = result.stdout.strip()
-            start_idx = output_str.find("{")
-            end_idx = output_str.rfind("}") + 1
-            if start_idx != -1 and end_idx != -1:
-                json_str = output_str[start_idx:end_idx]
-                self.solution = json.loads(json_str)
-            else:
-                raise ValueError("Nessun JSON trovato nell'output")
+            
+            # The SVG comes back inline; write it out for the PNG conversion
+            with open(SVG_PATH, 'w') as f:
+                f.write(self.solution.pop('svg'))
             
             # 2. Convert SVG to PNG
             subprocess.run(["rsvg-convert", SVG_PATH, "-o", PNG_PATH], check=True)
@@ -544,3 +540,4 @@ if __name__ == "__main__":
     root = tk.Tk()
     app = CircuitApp(root)
     root.mainloop()
+    app.worker.close()
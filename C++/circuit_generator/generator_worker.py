@@ -0,0 +1,80 @@
+"""
+Persistent circuit_generator worker shared by the web app and the Tk GUI
+"""
+
+import subprocess
+import threading
+import queue
+import json
+
+GENERATION_TIMEOUT = 5  # Seconds to wait for the worker's reply
+
+
+class GenerationTimeout(Exception):
+    pass
+
+
+class GeneratorWorker:
+    """Long-lived `circuit_generator serve` process (one JSON request/response per line)"""
+
+    def __init__(self, path):
+        self.path = path
+        self.proc = None
+        self.lines = None
+        self.lock = threading.Lock()
+        self.next_id = 0
+
+    def _start(self):
+        self.proc = subprocess.Popen(
+            [self.path, "serve"],
+            stdin=subprocess.PIPE,
+            stdout=subprocess.PIPE,
+            stderr=subprocess.DEVNULL,
+            text=True,
+            bufsize=1
+        )
+        # Replies are read on a thread so a request can wait with a deadline;
+        # each process gets its own queue, so a killed worker's output is dropped
+        self.lines = queue.Queue()
+        threading.Thread(target=self._read, args=(self.proc, self.lines), daemon=True).start()
+
+    @staticmethod
+    def _read(proc, lines):
+        for line in proc.stdout:
+            lines.put(line)
+        lines.put("")  # EOF
+
+    def _kill(self):
+        try:
+            self.proc.kill()
+            self.proc.wait(timeout=1)
+        except Exception:
+            pass
+        self.proc = None
+
+    def close(self):
+        with self.lock:
+            if self.proc is not None:
+                self._kill()
+
+    def request(self, exercise_type):
+        with self.lock:
+            if self.proc is None or self.proc.poll() is not None:
+                self._start()
+            self.next_id += 1
+            try:
+                self.proc.stdin.write(json.dumps({'id': self.next_id, 'type': exercise_type}) + "\n")
+                self.proc.stdin.flush()
+                line = self.lines.get(timeout=GENERATION_TIMEOUT)
+            except queue.Empty:
+                # Hung worker: replace it so later requests are not stuck behind it
+                self._kill()
+                self._start()
+                raise GenerationTimeout()
+            except (BrokenPipeError, OSError):
+                line = ""
+            if not line:
+                # Worker died; it is restarted on the next request
+                self.proc = None
+                raise RuntimeError("Generator worker exited unexpectedly")
+            return json.loads(line)
@@ -9,12 +9,16 @@ import subprocess
 import json
 import os
 
+from generator_worker import GeneratorWorker, GenerationTimeout
+
 app = Flask(__name__)
 
 GENERATOR_PATH = "./circuit_generator"
 SVG_PATH = "circuit.svg"
 PNG_PATH = "circuit.png"
 
+worker = GeneratorWorker(GENERATOR_PATH)
+
 @app.route('/')
 def index():
     """Serve the main web interface"""
@@ -28,26 +32,14 @@ def generate_circuit(exercise_type):
         if exercise_type not in ['DC', 'AC']:
             return jsonify({'error': 'Invalid exercise type'}), 400
         
-        # Run C++ generator
-        result = subprocess.run(
-            [GENERATOR_PATH, "headless", exercise_type],
-            capture_output=True,
-            text=True,
-            timeout=5
-        )
-        
-        if result.returncode != 0:
-            return jsonify({'error': f'Generator failed: {result.stderr}'}), 500
+        # Ask the persistent C++ worker for a new exercise
+        solution = worker.request(exercise_type)
+        if 'error' in solution:
+            return jsonify({'error': f"Generator failed: {solution['error']}"}), 500
         
-        # Parse JSON output
-        output = result.stdout.strip()
-        start = output.find("{")
-        end = output.rfind("}") + 1
-        
-        if start == -1 or end == 0:
-            return jsonify({'error': 'No JSON found in output'}), 500
-        
-        solution = json.loads(output[start:end])
+        # The SVG comes back inline; write it out for the PNG conversion
+        with open(SVG_PATH, 'w') as f:
+            f.write(solution.pop('svg'))
         
         # Convert SVG to PNG
         subprocess.run(
@@ -63,8 +55,10 @@ def generate_circuit(exercise_type):
             'png_path': PNG_PATH
         })
         
-    except subprocess.TimeoutExpired:
+    except GenerationTimeout:
         return jsonify({'error': 'Generation timeout'}), 500
+    except subprocess.TimeoutExpired:
+        return jsonify({'error': 'PNG conversion timeout'}), 500
     except json.JSONDecodeError as e:
         return jsonify({'error': f'Invalid JSON: {str(e)}'}), 500
     except Exception as e: